@@ -0,0 +1,322 @@
+/*
+ * Cryptographic API.
+ *
+ * Glue code for the SHA-224/SHA-256 Secure Hash Algorithm assembler
+ * implementations for ARM, with an optional NEON assisted variant.
+ *
+ * Derived from crypto/sha256_generic.c
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+#include <crypto/internal/hash.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/mm.h>
+#include <linux/types.h>
+#include <crypto/sha.h>
+#include <asm/byteorder.h>
+#include <asm/neon.h>
+
+asmlinkage void sha256_block_data_order(u32 *digest, const u8 *data,
+					unsigned int blocks);
+asmlinkage void sha256_block_neon(u32 *digest, const u8 *data,
+				  unsigned int blocks);
+
+typedef void (sha256_blocks_fn)(u32 *digest, const u8 *data,
+				unsigned int blocks);
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+/*
+ * NEON is only usable from process context; softirq users (IPsec)
+ * fall back to the integer implementation.
+ */
+static void sha256_neon_blocks(u32 *digest, const u8 *data,
+			       unsigned int blocks)
+{
+	if (kernel_neon_usable()) {
+		kernel_neon_begin();
+		sha256_block_neon(digest, data, blocks);
+		kernel_neon_end();
+	} else {
+		sha256_block_data_order(digest, data, blocks);
+	}
+}
+#endif
+
+static int sha224_arm_init(struct shash_desc *desc)
+{
+	struct sha256_state *sctx = shash_desc_ctx(desc);
+
+	*sctx = (struct sha256_state){
+		.state = { SHA224_H0, SHA224_H1, SHA224_H2, SHA224_H3,
+			   SHA224_H4, SHA224_H5, SHA224_H6, SHA224_H7 },
+	};
+
+	return 0;
+}
+
+static int sha256_arm_init(struct shash_desc *desc)
+{
+	struct sha256_state *sctx = shash_desc_ctx(desc);
+
+	*sctx = (struct sha256_state){
+		.state = { SHA256_H0, SHA256_H1, SHA256_H2, SHA256_H3,
+			   SHA256_H4, SHA256_H5, SHA256_H6, SHA256_H7 },
+	};
+
+	return 0;
+}
+
+static void __sha256_update(struct shash_desc *desc, const u8 *data,
+			    unsigned int len, sha256_blocks_fn *fn)
+{
+	struct sha256_state *sctx = shash_desc_ctx(desc);
+	unsigned int partial, done, blocks;
+
+	partial = sctx->count & 0x3f;
+	sctx->count += len;
+	done = 0;
+
+	if ((partial + len) > 63) {
+		if (partial) {
+			done = 64 - partial;
+			memcpy(sctx->buf + partial, data, done);
+			fn(sctx->state, sctx->buf, 1);
+		}
+
+		blocks = (len - done) / SHA256_BLOCK_SIZE;
+		if (blocks) {
+			fn(sctx->state, data + done, blocks);
+			done += blocks * SHA256_BLOCK_SIZE;
+		}
+
+		partial = 0;
+	}
+	memcpy(sctx->buf + partial, data + done, len - done);
+}
+
+static void __sha256_final(struct shash_desc *desc, u8 *out,
+			   unsigned int digestsize, sha256_blocks_fn *fn)
+{
+	struct sha256_state *sctx = shash_desc_ctx(desc);
+	__be32 *dst = (__be32 *)out;
+	__be64 bits;
+	unsigned int index, pad_len, i;
+	static const u8 padding[64] = { 0x80, };
+
+	/* Save number of bits */
+	bits = cpu_to_be64(sctx->count << 3);
+
+	/* Pad out to 56 mod 64. */
+	index = sctx->count & 0x3f;
+	pad_len = (index < 56) ? (56 - index) : ((64+56) - index);
+	__sha256_update(desc, padding, pad_len, fn);
+
+	/* Append length (before padding) */
+	__sha256_update(desc, (const u8 *)&bits, sizeof(bits), fn);
+
+	/* Store state in digest */
+	for (i = 0; i < digestsize / sizeof(u32); i++)
+		dst[i] = cpu_to_be32(sctx->state[i]);
+
+	/* Zeroize sensitive information. */
+	memset(sctx, 0, sizeof(*sctx));
+}
+
+static int sha256_arm_update(struct shash_desc *desc, const u8 *data,
+			     unsigned int len)
+{
+	__sha256_update(desc, data, len, sha256_block_data_order);
+	return 0;
+}
+
+static int sha256_arm_final(struct shash_desc *desc, u8 *out)
+{
+	__sha256_final(desc, out, SHA256_DIGEST_SIZE, sha256_block_data_order);
+	return 0;
+}
+
+static int sha224_arm_final(struct shash_desc *desc, u8 *out)
+{
+	__sha256_final(desc, out, SHA224_DIGEST_SIZE, sha256_block_data_order);
+	return 0;
+}
+
+static int sha256_arm_export(struct shash_desc *desc, void *out)
+{
+	struct sha256_state *sctx = shash_desc_ctx(desc);
+
+	memcpy(out, sctx, sizeof(*sctx));
+	return 0;
+}
+
+static int sha256_arm_import(struct shash_desc *desc, const void *in)
+{
+	struct sha256_state *sctx = shash_desc_ctx(desc);
+
+	memcpy(sctx, in, sizeof(*sctx));
+	return 0;
+}
+
+static struct shash_alg sha256_arm_algs[] = { {
+	.digestsize	=	SHA256_DIGEST_SIZE,
+	.init		=	sha256_arm_init,
+	.update		=	sha256_arm_update,
+	.final		=	sha256_arm_final,
+	.export		=	sha256_arm_export,
+	.import		=	sha256_arm_import,
+	.descsize	=	sizeof(struct sha256_state),
+	.statesize	=	sizeof(struct sha256_state),
+	.base		=	{
+		.cra_name	=	"sha256",
+		.cra_driver_name=	"sha256-asm",
+		.cra_priority	=	150,
+		.cra_flags	=	CRYPTO_ALG_TYPE_SHASH,
+		.cra_blocksize	=	SHA256_BLOCK_SIZE,
+		.cra_module	=	THIS_MODULE,
+	}
+}, {
+	.digestsize	=	SHA224_DIGEST_SIZE,
+	.init		=	sha224_arm_init,
+	.update		=	sha256_arm_update,
+	.final		=	sha224_arm_final,
+	.export		=	sha256_arm_export,
+	.import		=	sha256_arm_import,
+	.descsize	=	sizeof(struct sha256_state),
+	.statesize	=	sizeof(struct sha256_state),
+	.base		=	{
+		.cra_name	=	"sha224",
+		.cra_driver_name=	"sha224-asm",
+		.cra_priority	=	150,
+		.cra_flags	=	CRYPTO_ALG_TYPE_SHASH,
+		.cra_blocksize	=	SHA224_BLOCK_SIZE,
+		.cra_module	=	THIS_MODULE,
+	}
+} };
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+
+static int sha256_neon_update(struct shash_desc *desc, const u8 *data,
+			      unsigned int len)
+{
+	__sha256_update(desc, data, len, sha256_neon_blocks);
+	return 0;
+}
+
+static int sha256_neon_final(struct shash_desc *desc, u8 *out)
+{
+	__sha256_final(desc, out, SHA256_DIGEST_SIZE, sha256_neon_blocks);
+	return 0;
+}
+
+static int sha224_neon_final(struct shash_desc *desc, u8 *out)
+{
+	__sha256_final(desc, out, SHA224_DIGEST_SIZE, sha256_neon_blocks);
+	return 0;
+}
+
+static struct shash_alg sha256_neon_algs[] = { {
+	.digestsize	=	SHA256_DIGEST_SIZE,
+	.init		=	sha256_arm_init,
+	.update		=	sha256_neon_update,
+	.final		=	sha256_neon_final,
+	.export		=	sha256_arm_export,
+	.import		=	sha256_arm_import,
+	.descsize	=	sizeof(struct sha256_state),
+	.statesize	=	sizeof(struct sha256_state),
+	.base		=	{
+		.cra_name	=	"sha256",
+		.cra_driver_name=	"sha256-neon",
+		.cra_priority	=	250,
+		.cra_flags	=	CRYPTO_ALG_TYPE_SHASH,
+		.cra_blocksize	=	SHA256_BLOCK_SIZE,
+		.cra_module	=	THIS_MODULE,
+	}
+}, {
+	.digestsize	=	SHA224_DIGEST_SIZE,
+	.init		=	sha224_arm_init,
+	.update		=	sha256_neon_update,
+	.final		=	sha224_neon_final,
+	.export		=	sha256_arm_export,
+	.import		=	sha256_arm_import,
+	.descsize	=	sizeof(struct sha256_state),
+	.statesize	=	sizeof(struct sha256_state),
+	.base		=	{
+		.cra_name	=	"sha224",
+		.cra_driver_name=	"sha224-neon",
+		.cra_priority	=	250,
+		.cra_flags	=	CRYPTO_ALG_TYPE_SHASH,
+		.cra_blocksize	=	SHA224_BLOCK_SIZE,
+		.cra_module	=	THIS_MODULE,
+	}
+} };
+
+#endif /* CONFIG_KERNEL_MODE_NEON */
+
+static int sha256_register(struct shash_alg *algs, int count)
+{
+	int i, ret;
+
+	for (i = 0; i < count; i++) {
+		ret = crypto_register_shash(&algs[i]);
+		if (ret < 0)
+			goto err;
+	}
+	return 0;
+
+err:
+	while (--i >= 0)
+		crypto_unregister_shash(&algs[i]);
+	return ret;
+}
+
+static void sha256_unregister(struct shash_alg *algs, int count)
+{
+	int i;
+
+	for (i = 0; i < count; i++)
+		crypto_unregister_shash(&algs[i]);
+}
+
+static int __init sha256_arm_mod_init(void)
+{
+	int ret;
+
+	ret = sha256_register(sha256_arm_algs, ARRAY_SIZE(sha256_arm_algs));
+	if (ret < 0)
+		return ret;
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+	if (cpu_has_neon()) {
+		ret = sha256_register(sha256_neon_algs,
+				      ARRAY_SIZE(sha256_neon_algs));
+		if (ret < 0)
+			sha256_unregister(sha256_arm_algs,
+					  ARRAY_SIZE(sha256_arm_algs));
+	}
+#endif
+	return ret;
+}
+
+static void __exit sha256_arm_mod_fini(void)
+{
+#ifdef CONFIG_KERNEL_MODE_NEON
+	if (cpu_has_neon())
+		sha256_unregister(sha256_neon_algs,
+				  ARRAY_SIZE(sha256_neon_algs));
+#endif
+	sha256_unregister(sha256_arm_algs, ARRAY_SIZE(sha256_arm_algs));
+}
+
+module_init(sha256_arm_mod_init);
+module_exit(sha256_arm_mod_fini);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("SHA-224 and SHA-256 Secure Hash Algorithm, ARM/NEON optimized");
+
+MODULE_ALIAS("sha224");
+MODULE_ALIAS("sha256");
@@ -0,0 +1,48 @@
+/*
+ *  arch/arm/include/asm/neon.h
+ *
+ *  Kernel mode NEON support.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ASM_ARM_NEON_H
+#define __ASM_ARM_NEON_H
+
+#include <linux/hardirq.h>
+#include <asm/hwcap.h>
+
+#define cpu_has_neon()		(!!(elf_hwcap & HWCAP_NEON))
+
+#ifdef CONFIG_KERNEL_MODE_NEON
+
+/*
+ * Users of NEON in kernel mode must bracket the NEON code with
+ * kernel_neon_begin() and kernel_neon_end().  The userland VFP/NEON
+ * state (if live in the registers) is saved and preemption is disabled
+ * until kernel_neon_end() is called.
+ *
+ * The VFP undefined instruction handler is not safe against softirqs,
+ * so NEON may only be used from process context.  Callers that can be
+ * reached from interrupt context must check kernel_neon_usable() first
+ * and fall back to an integer implementation if it returns false.
+ */
+void kernel_neon_begin(void);
+void kernel_neon_end(void);
+
+static inline int kernel_neon_usable(void)
+{
+	return cpu_has_neon() && !in_interrupt();
+}
+
+#else
+
+static inline int kernel_neon_usable(void)
+{
+	return 0;
+}
+
+#endif /* CONFIG_KERNEL_MODE_NEON */
+
+#endif /* __ASM_ARM_NEON_H */
@@ -0,0 +1,72 @@
+/*
+ *  linux/arch/arm/lib/copy_neon.h
+ *
+ *  Interface between the NEON bulk copy and checksum loops in
+ *  copy-neon.S and csum-neon.S, the glue in copy_neon_glue.c and
+ *  csum_neon_glue.c, and the copybench module.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#ifndef __ARM_LIB_COPY_NEON_H
+#define __ARM_LIB_COPY_NEON_H
+
+#include <linux/types.h>
+#include <linux/compiler.h>
+#include <asm/neon.h>
+
+/*
+ * Below this size the cost of kernel_neon_begin()/kernel_neon_end() and
+ * of aligning the destination outweighs the faster NEON loop.
+ */
+#define NEON_COPY_THRESHOLD	512
+
+extern int neon_copy_enabled;
+extern unsigned int neon_copy_pld_distance;
+
+static inline int neon_copy_usable(void)
+{
+	return neon_copy_enabled && kernel_neon_usable();
+}
+
+/*
+ * The NEON loops handle whole 64 byte blocks to a 16 byte aligned
+ * destination; the integer code does the head and the tail.
+ */
+static inline size_t neon_copy_head(const void *dst)
+{
+	return -(unsigned long)dst & 15;
+}
+
+/* The integer implementations, see memcpy.S etc. */
+extern void *__memcpy_arm(void *dst, const void *src, size_t n);
+extern void *__memset_arm(void *p, int c, size_t n);
+extern void __memzero_arm(void *p, size_t n);
+extern void __copy_page_arm(void *to, const void *from);
+
+/*
+ * The NEON loops.  They must be called between kernel_neon_begin() and
+ * kernel_neon_end(), with n a non-zero multiple of 64 and the
+ * destination 16 byte aligned.  'pld' is the prefetch distance in bytes.
+ */
+extern void __memcpy_neon(void *dst, const void *src, size_t n,
+			  unsigned int pld);
+extern void __memset_neon(void *p, int c, size_t n);
+extern void __copy_page_neon(void *to, const void *from, unsigned int pld);
+
+/* The integer checksum implementations, see csumpartial.S etc. */
+extern __wsum __csum_partial_arm(const void *buf, int len, __wsum sum);
+extern __wsum __csum_partial_copy_arm(const void *src, void *dst, int len,
+				      __wsum sum);
+
+/*
+ * The NEON checksum loops, with the same rules as above.  For
+ * __csum_partial_neon() it is buf that must be 16 byte aligned.  They
+ * return the checksum of the block alone, to be combined by the caller.
+ */
+extern __wsum __csum_partial_neon(const void *buf, int n, unsigned int pld);
+extern __wsum __csum_partial_copy_neon(const void *src, void *dst, int n,
+				       unsigned int pld);
+
+#endif /* __ARM_LIB_COPY_NEON_H */
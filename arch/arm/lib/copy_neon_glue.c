@@ -0,0 +1,134 @@
+/*
+ *  linux/arch/arm/lib/copy_neon_glue.c
+ *
+ *  Use the NEON unit for large memcpy(), memset() and copy_page()
+ *  calls.  These override the weak integer versions
+ *  in memcpy.S etc., which remain available as __memcpy_arm() and so on.
+ *
+ *  NEON can only be used from process context (see asm/neon.h), so
+ *  calls from interrupt context, and all calls before the VFP support
+ *  code has detected NEON, use the integer code.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/string.h>
+#include <asm/neon.h>
+#include <asm/page.h>
+
+#include "copy_neon.h"
+
+#undef memset
+
+int neon_copy_enabled __read_mostly = 1;
+EXPORT_SYMBOL(neon_copy_enabled);
+
+/*
+ * Distance in bytes between the source pointer and the pld issued by
+ * the NEON loops.  Four cache lines ahead suits Cortex-A8 at the usual
+ * DDR2 latencies; the copybench module can be used to retune it.
+ */
+unsigned int neon_copy_pld_distance __read_mostly = 256;
+EXPORT_SYMBOL(neon_copy_pld_distance);
+
+/* "noneoncopy" also turns off the NEON checksum routines. */
+static int __init noneoncopy_setup(char *str)
+{
+	neon_copy_enabled = 0;
+	return 1;
+}
+__setup("noneoncopy", noneoncopy_setup);
+
+void *memcpy(void *dst, const void *src, size_t n)
+{
+	size_t head, bulk;
+
+	if (n < NEON_COPY_THRESHOLD || !neon_copy_usable())
+		return __memcpy_arm(dst, src, n);
+
+	head = neon_copy_head(dst);
+	bulk = (n - head) & ~63;
+
+	if (head)
+		__memcpy_arm(dst, src, head);
+
+	kernel_neon_begin();
+	__memcpy_neon(dst + head, src + head, bulk, neon_copy_pld_distance);
+	kernel_neon_end();
+
+	n -= head + bulk;
+	if (n)
+		__memcpy_arm(dst + head + bulk, src + head + bulk, n);
+
+	return dst;
+}
+
+void *memset(void *p, int c, size_t n)
+{
+	size_t head, bulk;
+
+	if (n < NEON_COPY_THRESHOLD || !neon_copy_usable())
+		return __memset_arm(p, c, n);
+
+	head = neon_copy_head(p);
+	bulk = (n - head) & ~63;
+
+	if (head)
+		__memset_arm(p, c, head);
+
+	kernel_neon_begin();
+	__memset_neon(p + head, c, bulk);
+	kernel_neon_end();
+
+	n -= head + bulk;
+	if (n)
+		__memset_arm(p + head + bulk, c, n);
+
+	return p;
+}
+
+void __memzero(void *p, size_t n)
+{
+	size_t head, bulk;
+
+	if (n < NEON_COPY_THRESHOLD || !neon_copy_usable()) {
+		__memzero_arm(p, n);
+		return;
+	}
+
+	head = neon_copy_head(p);
+	bulk = (n - head) & ~63;
+
+	if (head)
+		__memzero_arm(p, head);
+
+	kernel_neon_begin();
+	__memset_neon(p + head, 0, bulk);
+	kernel_neon_end();
+
+	n -= head + bulk;
+	if (n)
+		__memzero_arm(p + head + bulk, n);
+}
+
+void copy_page(void *to, const void *from)
+{
+	if (!neon_copy_usable()) {
+		__copy_page_arm(to, from);
+		return;
+	}
+
+	kernel_neon_begin();
+	__copy_page_neon(to, from, neon_copy_pld_distance);
+	kernel_neon_end();
+}
+
+/*
+ * There is no NEON __copy_from_user() or __copy_to_user(): vld1 and vst1
+ * have no unprivileged forms, so they would not honour the user's access
+ * permissions the way the ldrt/strt based copies do.
+ */
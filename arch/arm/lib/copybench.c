@@ -0,0 +1,311 @@
+/*
+ *  linux/arch/arm/lib/copybench.c
+ *
+ *  Check and measure memcpy(), memset(), __copy_from_user(), copy_page()
+ *  and the csum_partial() family for a range of sizes and alignments,
+ *  with the NEON code disabled and enabled.  As with tcrypt, the module
+ *  prints its results and then fails to load, so it can simply be loaded
+ *  again, e.g.
+ *
+ *	modprobe copybench pld=320 msecs=200
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/gfp.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/sched.h>
+#include <linux/string.h>
+#include <linux/uaccess.h>
+#include <net/checksum.h>
+#include <asm/unaligned.h>
+
+#include "copy_neon.h"
+
+static unsigned int msecs = 100;
+module_param(msecs, uint, 0);
+MODULE_PARM_DESC(msecs, "Time spent on each measurement in milliseconds");
+
+static unsigned int pld;
+module_param(pld, uint, 0);
+MODULE_PARM_DESC(pld, "NEON prefetch distance to use (default: current)");
+
+#define BENCH_ORDER	8
+#define BENCH_SIZE	(PAGE_SIZE << BENCH_ORDER)
+#define BENCH_GUARD	64
+#define BENCH_CSUM_SEED	((__force __wsum)0x1234)
+#define SWEEP_LEN	1100
+
+static const unsigned int bench_sizes[] = {
+	64, 256, 512, 1024, 4096, 16384, 65536, 262144, 524288,
+};
+
+static const struct {
+	unsigned int dst;
+	unsigned int src;
+} bench_align[] = {
+	{ 0, 0 }, { 0, 4 }, { 8, 1 }, { 3, 13 },
+};
+
+enum {
+	BENCH_MEMCPY,
+	BENCH_MEMSET,
+	BENCH_COPY_FROM_USER,
+	BENCH_CSUM,
+	BENCH_CSUM_COPY,
+	BENCH_CSUM_FROM_USER,
+	BENCH_COPY_PAGE,
+};
+
+static const char *const bench_names[] = {
+	[BENCH_MEMCPY]		= "memcpy",
+	[BENCH_MEMSET]		= "memset",
+	[BENCH_COPY_FROM_USER]	= "copy_from_user",
+	[BENCH_CSUM]		= "csum",
+	[BENCH_CSUM_COPY]	= "csum_copy",
+	[BENCH_CSUM_FROM_USER]	= "csum_from_user",
+	[BENCH_COPY_PAGE]	= "copy_page",
+};
+
+static __wsum bench_sum;
+
+static int bench_run(int op, u8 *dst, u8 *src, size_t n)
+{
+	size_t i;
+	int err;
+
+	switch (op) {
+	case BENCH_MEMCPY:
+		memcpy(dst, src, n);
+		return 0;
+	case BENCH_MEMSET:
+		memset(dst, 0x5a, n);
+		return 0;
+	case BENCH_COPY_FROM_USER:
+		/* under KERNEL_DS, see copybench_init() */
+		return __copy_from_user(dst, (const void __user *)src, n) ?
+			-EFAULT : 0;
+	case BENCH_CSUM:
+		bench_sum = csum_partial(src, n, BENCH_CSUM_SEED);
+		return 0;
+	case BENCH_CSUM_COPY:
+		bench_sum = csum_partial_copy_nocheck(src, dst, n,
+						      BENCH_CSUM_SEED);
+		return 0;
+	case BENCH_CSUM_FROM_USER:
+		err = 0;
+		bench_sum = csum_partial_copy_from_user((const void __user *)src,
+							dst, n, BENCH_CSUM_SEED,
+							&err);
+		return err;
+	case BENCH_COPY_PAGE:
+		for (i = 0; i < n; i += PAGE_SIZE)
+			copy_page(dst + i, src + i);
+		return 0;
+	}
+
+	return -EINVAL;
+}
+
+/* A plain C Internet checksum to check the csum_partial() family against. */
+static __sum16 bench_csum_ref(const u8 *p, size_t n)
+{
+	u64 sum = (__force u32)BENCH_CSUM_SEED;
+	u8 last[2] = { 0, 0 };
+	size_t i;
+
+	for (i = 0; i + 1 < n; i += 2)
+		sum += get_unaligned((u16 *)(p + i));
+	if (n & 1) {
+		last[0] = p[n - 1];
+		sum += get_unaligned((u16 *)last);
+	}
+	while (sum >> 16)
+		sum = (sum & 0xffff) + (sum >> 16);
+
+	return (__force __sum16)~sum;
+}
+
+static int bench_check(int op, u8 *dst, u8 *src, size_t n)
+{
+	size_t i;
+	int err;
+
+	memset(dst - BENCH_GUARD, 0xee, n + 2 * BENCH_GUARD);
+	for (i = 0; i < n; i++)
+		src[i] = i * 7 + (i >> 8);
+
+	err = bench_run(op, dst, src, n);
+	if (err)
+		return err;
+
+	if (op == BENCH_CSUM || op == BENCH_CSUM_COPY ||
+	    op == BENCH_CSUM_FROM_USER)
+		if (csum_fold(bench_sum) != bench_csum_ref(src, n))
+			return -EIO;
+
+	for (i = 0; i < n && op != BENCH_CSUM; i++)
+		if (dst[i] != (op == BENCH_MEMSET ? 0x5a : src[i]))
+			return -EIO;
+
+	for (i = 1; i <= BENCH_GUARD; i++)
+		if (dst[-i] != 0xee || dst[n + i - 1] != 0xee)
+			return -EIO;
+
+	return 0;
+}
+
+/* Returns the bandwidth in MB/s. */
+static unsigned long bench_time(int op, u8 *dst, u8 *src, size_t n)
+{
+	unsigned long timeout;
+	u64 bytes = 0;
+	ktime_t start;
+	s64 ns;
+	int i;
+
+	bench_run(op, dst, src, n);
+
+	start = ktime_get();
+	timeout = jiffies + msecs_to_jiffies(msecs);
+	do {
+		for (i = 0; i < 16; i++)
+			bench_run(op, dst, src, n);
+		bytes += 16 * n;
+	} while (time_before(jiffies, timeout));
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	return ns > 0 ? div64_u64(bytes * 1000, ns) : 0;
+}
+
+static int bench_one(int op, u8 *dst, u8 *src, size_t n,
+		     unsigned int doff, unsigned int soff)
+{
+	unsigned long mbs[2];
+	int neon, err;
+
+	for (neon = 0; neon < 2; neon++) {
+		neon_copy_enabled = neon;
+
+		err = bench_check(op, dst + doff, src + soff, n);
+		if (err) {
+			printk(KERN_ERR "copybench: %s of %zu bytes (dst+%u, "
+			       "src+%u, %s) failed: %d\n", bench_names[op], n,
+			       doff, soff, neon ? "neon" : "int", err);
+			return err;
+		}
+
+		mbs[neon] = bench_time(op, dst + doff, src + soff, n);
+		cond_resched();
+	}
+
+	printk(KERN_INFO "copybench: %-14s %7zu dst+%-2u src+%-2u: "
+	       "%5lu MB/s int, %5lu MB/s neon\n", bench_names[op], n,
+	       doff, soff, mbs[0], mbs[1]);
+	return 0;
+}
+
+/*
+ * The NEON checksum code splits the buffer at the destination (or, for
+ * csum_partial(), source) alignment, and has to rotate partial sums that
+ * start at an odd offset, so check every length around the threshold at
+ * every alignment.
+ */
+static int csum_sweep(u8 *dst, u8 *src)
+{
+	unsigned int off;
+	size_t n;
+	int op, err;
+
+	neon_copy_enabled = 1;
+
+	for (op = BENCH_CSUM; op <= BENCH_CSUM_FROM_USER; op++)
+		for (off = 0; off < 16; off++) {
+			for (n = 0; n <= SWEEP_LEN; n++) {
+				err = bench_check(op, dst + off,
+						  src + (off * 5 & 15), n);
+				if (err) {
+					printk(KERN_ERR "copybench: %s of %zu "
+					       "bytes (dst+%u, src+%u) failed: "
+					       "%d\n", bench_names[op], n, off,
+					       off * 5 & 15, err);
+					return err;
+				}
+			}
+			cond_resched();
+		}
+
+	printk(KERN_INFO "copybench: checksums of 0 to %u bytes at all "
+	       "alignments ok\n", SWEEP_LEN);
+	return 0;
+}
+
+static int __init copybench_init(void)
+{
+	unsigned int old_pld = neon_copy_pld_distance;
+	int old_enabled = neon_copy_enabled;
+	unsigned long sbuf, dbuf;
+	mm_segment_t old_fs;
+	int op, i, j, err = 0;
+	u8 *src, *dst;
+
+	sbuf = __get_free_pages(GFP_KERNEL, BENCH_ORDER);
+	dbuf = __get_free_pages(GFP_KERNEL, BENCH_ORDER);
+	if (!sbuf || !dbuf) {
+		err = -ENOMEM;
+		goto out;
+	}
+
+	/* leave room for the guard bytes on both sides */
+	src = (u8 *)sbuf + PAGE_SIZE;
+	dst = (u8 *)dbuf + PAGE_SIZE;
+
+	if (pld)
+		neon_copy_pld_distance = pld;
+	printk(KERN_INFO "copybench: NEON prefetch distance %u bytes\n",
+	       neon_copy_pld_distance);
+
+	old_fs = get_fs();
+	set_fs(KERNEL_DS);
+
+	err = csum_sweep(dst, src);
+
+	for (op = BENCH_MEMCPY; op < BENCH_COPY_PAGE && !err; op++)
+		for (i = 0; i < ARRAY_SIZE(bench_sizes) && !err; i++)
+			for (j = 0; j < ARRAY_SIZE(bench_align) && !err; j++)
+				err = bench_one(op, dst, src, bench_sizes[i],
+						bench_align[j].dst,
+						bench_align[j].src);
+
+	for (i = 1; i <= 64 && !err; i *= 4)
+		err = bench_one(BENCH_COPY_PAGE, dst, src, i * PAGE_SIZE, 0, 0);
+
+	set_fs(old_fs);
+
+	neon_copy_pld_distance = old_pld;
+	neon_copy_enabled = old_enabled;
+
+out:
+	free_pages(dbuf, BENCH_ORDER);
+	free_pages(sbuf, BENCH_ORDER);
+
+	/* don't stay loaded, there is nothing to unload */
+	return err ? err : -EAGAIN;
+}
+
+static void __exit copybench_exit(void)
+{
+}
+
+module_init(copybench_init);
+module_exit(copybench_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("memcpy/memset/copy_page/copy_from_user/csum benchmark");
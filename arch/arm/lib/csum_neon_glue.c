@@ -0,0 +1,93 @@
+/*
+ *  linux/arch/arm/lib/csum_neon_glue.c
+ *
+ *  Use the NEON unit for large csum_partial() and
+ *  csum_partial_copy_nocheck() calls.  These override the weak integer
+ *  versions in csumpartial.S and csumpartialcopy.S, which remain
+ *  available as __csum_partial_arm() and __csum_partial_copy_arm().
+ *
+ *  As with the copy routines in copy_neon_glue.c, NEON is only used from
+ *  process context: the sendmsg() path and the receive checksum done by
+ *  the reader in recvmsg().  Checksums computed in softirq context use
+ *  the integer code.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation.
+ */
+#include <linux/kernel.h>
+#include <net/checksum.h>
+#include <asm/neon.h>
+
+#include "copy_neon.h"
+
+/*
+ * The buffer is split into an integer head, a NEON bulk of whole 64 byte
+ * blocks and an integer tail.  Each part is summed on its own and added
+ * in with csum_block_add(), which rotates the partial sum of a part that
+ * starts at an odd offset.
+ */
+__wsum csum_partial(const void *buff, int len, __wsum sum)
+{
+	int head, bulk;
+	__wsum part;
+
+	if (len < NEON_COPY_THRESHOLD || !neon_copy_usable())
+		return __csum_partial_arm(buff, len, sum);
+
+	head = neon_copy_head(buff);
+	bulk = (len - head) & ~63;
+
+	if (head)
+		sum = __csum_partial_arm(buff, head, sum);
+
+	kernel_neon_begin();
+	part = __csum_partial_neon(buff + head, bulk, neon_copy_pld_distance);
+	kernel_neon_end();
+	sum = csum_block_add(sum, part, head);
+
+	len -= head + bulk;
+	if (len) {
+		part = __csum_partial_arm(buff + head + bulk, len, 0);
+		sum = csum_block_add(sum, part, head + bulk);
+	}
+
+	return sum;
+}
+
+__wsum
+csum_partial_copy_nocheck(const void *src, void *dst, int len, __wsum sum)
+{
+	int head, bulk;
+	__wsum part;
+
+	if (len < NEON_COPY_THRESHOLD || !neon_copy_usable())
+		return __csum_partial_copy_arm(src, dst, len, sum);
+
+	head = neon_copy_head(dst);
+	bulk = (len - head) & ~63;
+
+	if (head)
+		sum = __csum_partial_copy_arm(src, dst, head, sum);
+
+	kernel_neon_begin();
+	part = __csum_partial_copy_neon(src + head, dst + head, bulk,
+					neon_copy_pld_distance);
+	kernel_neon_end();
+	sum = csum_block_add(sum, part, head);
+
+	len -= head + bulk;
+	if (len) {
+		part = __csum_partial_copy_arm(src + head + bulk,
+					       dst + head + bulk, len, 0);
+		sum = csum_block_add(sum, part, head + bulk);
+	}
+
+	return sum;
+}
+
+/*
+ * csum_partial_copy_from_user() stays on the ldrt based code in
+ * csumpartialcopyuser.S: vld1 would read user memory with kernel
+ * permissions.
+ */
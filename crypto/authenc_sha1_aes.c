@@ -0,0 +1,389 @@
+/*
+ * Fused authenc(hmac(sha1),cbc(aes)) for IPsec
+ *
+ * The authenc template builds this transform out of a separate cbc(aes)
+ * and hmac(sha1) pass, each walking the packet and each with its own
+ * sub-request.  Here the payload is processed one SHA-1 block (64 bytes)
+ * at a time: the chunk is CBC encrypted and then hashed while it is still
+ * in the L1 cache (or hashed and then decrypted), so the payload is read
+ * and written exactly once.  All per-packet state lives in the request
+ * context; nothing is allocated on the data path.
+ *
+ * Note that decryption writes the plaintext to the destination before the
+ * ICV has been checked.  The caller must discard it on -EBADMSG, as ESP
+ * does.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#include <crypto/aead.h>
+#include <crypto/aes.h>
+#include <crypto/algapi.h>
+#include <crypto/authenc.h>
+#include <crypto/rng.h>
+#include <crypto/scatterwalk.h>
+#include <crypto/sha.h>
+#include <linux/cryptohash.h>
+#include <linux/err.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/rtnetlink.h>
+#include <asm/unaligned.h>
+
+struct authenc_sha1_aes_ctx {
+	struct crypto_cipher *aes;
+	u32 ipad[SHA1_DIGEST_SIZE / 4];
+	u32 opad[SHA1_DIGEST_SIZE / 4];
+	u8 salt[AES_BLOCK_SIZE];
+};
+
+struct authenc_sha1_aes_reqctx {
+	struct sha1_state sha;
+	u32 W[SHA_WORKSPACE_WORDS];
+	u8 buf[SHA1_BLOCK_SIZE];
+	u8 iv[AES_BLOCK_SIZE];
+	u8 icv[SHA1_DIGEST_SIZE];
+	u8 ricv[SHA1_DIGEST_SIZE];
+};
+
+static void authenc_sha1_update(struct sha1_state *sctx, u32 *W,
+				const u8 *data, unsigned int len)
+{
+	unsigned int partial = sctx->count % SHA1_BLOCK_SIZE;
+
+	sctx->count += len;
+
+	if (partial) {
+		unsigned int n = min(len, SHA1_BLOCK_SIZE - partial);
+
+		memcpy(sctx->buffer + partial, data, n);
+		if (partial + n < SHA1_BLOCK_SIZE)
+			return;
+
+		sha_transform(sctx->state, sctx->buffer, W);
+		data += n;
+		len -= n;
+	}
+
+	for (; len >= SHA1_BLOCK_SIZE; data += SHA1_BLOCK_SIZE,
+				       len -= SHA1_BLOCK_SIZE)
+		sha_transform(sctx->state, (const char *)data, W);
+
+	memcpy(sctx->buffer, data, len);
+}
+
+static void authenc_sha1_final(struct sha1_state *sctx, u32 *W, u8 *out)
+{
+	static const u8 padding[SHA1_BLOCK_SIZE] = { 0x80, };
+	__be64 bits = cpu_to_be64(sctx->count << 3);
+	unsigned int index = sctx->count % SHA1_BLOCK_SIZE;
+	int i;
+
+	authenc_sha1_update(sctx, W, padding,
+			    index < 56 ? 56 - index : 120 - index);
+	authenc_sha1_update(sctx, W, (const u8 *)&bits, sizeof(bits));
+
+	for (i = 0; i < SHA1_DIGEST_SIZE / 4; i++)
+		put_unaligned_be32(sctx->state[i], out + i * 4);
+}
+
+/* Resume from a precomputed ipad/opad state, one block already hashed. */
+static void authenc_sha1_resume(struct sha1_state *sctx, const u32 *pad)
+{
+	memcpy(sctx->state, pad, SHA1_DIGEST_SIZE);
+	sctx->count = SHA1_BLOCK_SIZE;
+}
+
+static int authenc_sha1_aes_setkey(struct crypto_aead *authenc,
+				   const u8 *key, unsigned int keylen)
+{
+	struct authenc_sha1_aes_ctx *ctx = crypto_aead_ctx(authenc);
+	struct rtattr *rta = (void *)key;
+	struct crypto_authenc_key_param *param;
+	unsigned int authkeylen;
+	unsigned int enckeylen;
+	struct sha1_state sha;
+	u32 W[SHA_WORKSPACE_WORDS];
+	u8 pad[SHA1_BLOCK_SIZE];
+	int i, err;
+
+	if (!RTA_OK(rta, keylen))
+		goto badkey;
+	if (rta->rta_type != CRYPTO_AUTHENC_KEYA_PARAM)
+		goto badkey;
+	if (RTA_PAYLOAD(rta) < sizeof(*param))
+		goto badkey;
+
+	param = RTA_DATA(rta);
+	enckeylen = be32_to_cpu(param->enckeylen);
+
+	key += RTA_ALIGN(rta->rta_len);
+	keylen -= RTA_ALIGN(rta->rta_len);
+
+	if (keylen < enckeylen)
+		goto badkey;
+
+	authkeylen = keylen - enckeylen;
+
+	crypto_cipher_clear_flags(ctx->aes, CRYPTO_TFM_REQ_MASK);
+	crypto_cipher_set_flags(ctx->aes, crypto_aead_get_flags(authenc) &
+					  CRYPTO_TFM_REQ_MASK);
+	err = crypto_cipher_setkey(ctx->aes, key + authkeylen, enckeylen);
+	crypto_aead_set_flags(authenc, crypto_cipher_get_flags(ctx->aes) &
+				       CRYPTO_TFM_RES_MASK);
+	if (err)
+		return err;
+
+	/* Precompute the HMAC inner and outer states. */
+	memset(pad, 0, sizeof(pad));
+	if (authkeylen > SHA1_BLOCK_SIZE) {
+		sha = (struct sha1_state){
+			.state = { SHA1_H0, SHA1_H1, SHA1_H2, SHA1_H3, SHA1_H4 },
+		};
+		authenc_sha1_update(&sha, W, key, authkeylen);
+		authenc_sha1_final(&sha, W, pad);
+	} else {
+		memcpy(pad, key, authkeylen);
+	}
+
+	for (i = 0; i < SHA1_BLOCK_SIZE; i++)
+		pad[i] ^= 0x36;
+	ctx->ipad[0] = SHA1_H0;
+	ctx->ipad[1] = SHA1_H1;
+	ctx->ipad[2] = SHA1_H2;
+	ctx->ipad[3] = SHA1_H3;
+	ctx->ipad[4] = SHA1_H4;
+	sha_transform(ctx->ipad, pad, W);
+
+	for (i = 0; i < SHA1_BLOCK_SIZE; i++)
+		pad[i] ^= 0x36 ^ 0x5c;
+	ctx->opad[0] = SHA1_H0;
+	ctx->opad[1] = SHA1_H1;
+	ctx->opad[2] = SHA1_H2;
+	ctx->opad[3] = SHA1_H3;
+	ctx->opad[4] = SHA1_H4;
+	sha_transform(ctx->opad, pad, W);
+
+	memset(pad, 0, sizeof(pad));
+	memset(&sha, 0, sizeof(sha));
+	memset(W, 0, sizeof(W));
+	return 0;
+
+badkey:
+	crypto_aead_set_flags(authenc, CRYPTO_TFM_RES_BAD_KEY_LEN);
+	return -EINVAL;
+}
+
+static void authenc_cbc_encrypt(struct crypto_cipher *tfm, u8 *iv,
+				u8 *data, unsigned int len)
+{
+	for (; len; data += AES_BLOCK_SIZE, len -= AES_BLOCK_SIZE) {
+		crypto_xor(data, iv, AES_BLOCK_SIZE);
+		crypto_cipher_encrypt_one(tfm, data, data);
+		memcpy(iv, data, AES_BLOCK_SIZE);
+	}
+}
+
+static void authenc_cbc_decrypt(struct crypto_cipher *tfm, u8 *iv,
+				u8 *data, unsigned int len)
+{
+	u8 next[AES_BLOCK_SIZE];
+
+	for (; len; data += AES_BLOCK_SIZE, len -= AES_BLOCK_SIZE) {
+		memcpy(next, data, AES_BLOCK_SIZE);
+		crypto_cipher_decrypt_one(tfm, data, data);
+		crypto_xor(data, iv, AES_BLOCK_SIZE);
+		memcpy(iv, next, AES_BLOCK_SIZE);
+	}
+}
+
+static int authenc_sha1_aes_crypt(struct aead_request *req, const u8 *iv,
+				  int enc)
+{
+	struct crypto_aead *authenc = crypto_aead_reqtfm(req);
+	struct authenc_sha1_aes_ctx *ctx = crypto_aead_ctx(authenc);
+	struct authenc_sha1_aes_reqctx *rctx = aead_request_ctx(req);
+	unsigned int authsize = crypto_aead_authsize(authenc);
+	unsigned int cryptlen = req->cryptlen;
+	struct scatter_walk in, out;
+	unsigned int n, len;
+
+	if (!enc) {
+		if (cryptlen < authsize)
+			return -EINVAL;
+		cryptlen -= authsize;
+		scatterwalk_map_and_copy(rctx->ricv, req->src, cryptlen,
+					 authsize, 0);
+	}
+
+	if (cryptlen % AES_BLOCK_SIZE)
+		return -EINVAL;
+
+	memcpy(rctx->iv, iv, AES_BLOCK_SIZE);
+	authenc_sha1_resume(&rctx->sha, ctx->ipad);
+
+	/* The ICV covers assoc || iv || ciphertext. */
+	if (req->assoclen) {
+		scatterwalk_start(&in, req->assoc);
+		for (n = req->assoclen; n; n -= len) {
+			len = min_t(unsigned int, n, SHA1_BLOCK_SIZE);
+			scatterwalk_copychunks(rctx->buf, &in, len, 0);
+			authenc_sha1_update(&rctx->sha, rctx->W, rctx->buf, len);
+		}
+		scatterwalk_done(&in, 0, 0);
+	}
+
+	authenc_sha1_update(&rctx->sha, rctx->W, iv, AES_BLOCK_SIZE);
+
+	if (cryptlen) {
+		scatterwalk_start(&in, req->src);
+		scatterwalk_start(&out, req->dst);
+
+		for (n = cryptlen; n; n -= len) {
+			len = min_t(unsigned int, n, SHA1_BLOCK_SIZE);
+			scatterwalk_copychunks(rctx->buf, &in, len, 0);
+
+			if (enc) {
+				authenc_cbc_encrypt(ctx->aes, rctx->iv,
+						    rctx->buf, len);
+				authenc_sha1_update(&rctx->sha, rctx->W,
+						    rctx->buf, len);
+			} else {
+				authenc_sha1_update(&rctx->sha, rctx->W,
+						    rctx->buf, len);
+				authenc_cbc_decrypt(ctx->aes, rctx->iv,
+						    rctx->buf, len);
+			}
+
+			scatterwalk_copychunks(rctx->buf, &out, len, 1);
+		}
+
+		scatterwalk_done(&in, 0, 0);
+		scatterwalk_done(&out, 1, 0);
+	}
+
+	authenc_sha1_final(&rctx->sha, rctx->W, rctx->icv);
+	authenc_sha1_resume(&rctx->sha, ctx->opad);
+	authenc_sha1_update(&rctx->sha, rctx->W, rctx->icv, SHA1_DIGEST_SIZE);
+	authenc_sha1_final(&rctx->sha, rctx->W, rctx->icv);
+
+	if (enc) {
+		scatterwalk_map_and_copy(rctx->icv, req->dst, cryptlen,
+					 authsize, 1);
+		return 0;
+	}
+
+	return memcmp(rctx->icv, rctx->ricv, authsize) ? -EBADMSG : 0;
+}
+
+static int authenc_sha1_aes_encrypt(struct aead_request *req)
+{
+	return authenc_sha1_aes_crypt(req, req->iv, 1);
+}
+
+static int authenc_sha1_aes_decrypt(struct aead_request *req)
+{
+	return authenc_sha1_aes_crypt(req, req->iv, 0);
+}
+
+/*
+ * Generate the IV by encrypting the salted sequence number, as eseqiv
+ * does for plain cbc(aes).  This costs one extra block cipher operation
+ * and needs no chaining state between requests.
+ */
+static int authenc_sha1_aes_givencrypt(struct aead_givcrypt_request *req)
+{
+	struct crypto_aead *authenc = aead_givcrypt_reqtfm(req);
+	struct authenc_sha1_aes_ctx *ctx = crypto_aead_ctx(authenc);
+	__be64 seq = cpu_to_be64(req->seq);
+	u8 *iv = req->giv;
+
+	memcpy(iv, ctx->salt, AES_BLOCK_SIZE);
+	crypto_xor(iv + AES_BLOCK_SIZE - sizeof(seq), (u8 *)&seq, sizeof(seq));
+	crypto_cipher_encrypt_one(ctx->aes, iv, iv);
+
+	return authenc_sha1_aes_crypt(&req->areq, iv, 1);
+}
+
+static int authenc_sha1_aes_init_tfm(struct crypto_tfm *tfm)
+{
+	struct authenc_sha1_aes_ctx *ctx = crypto_tfm_ctx(tfm);
+	struct crypto_cipher *aes;
+	int err;
+
+	aes = crypto_alloc_cipher("aes", 0, 0);
+	if (IS_ERR(aes))
+		return PTR_ERR(aes);
+
+	err = crypto_get_default_rng();
+	if (err)
+		goto err_free_aes;
+
+	err = crypto_rng_get_bytes(crypto_default_rng, ctx->salt,
+				   AES_BLOCK_SIZE);
+	crypto_put_default_rng();
+	if (err < 0)
+		goto err_free_aes;
+
+	ctx->aes = aes;
+	tfm->crt_aead.reqsize = sizeof(struct authenc_sha1_aes_reqctx);
+
+	return 0;
+
+err_free_aes:
+	crypto_free_cipher(aes);
+	return err;
+}
+
+static void authenc_sha1_aes_exit_tfm(struct crypto_tfm *tfm)
+{
+	struct authenc_sha1_aes_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	crypto_free_cipher(ctx->aes);
+}
+
+static struct crypto_alg authenc_sha1_aes_alg = {
+	.cra_name		= "authenc(hmac(sha1),cbc(aes))",
+	.cra_driver_name	= "authenc-hmac-sha1-cbc-aes",
+	.cra_priority		= 300,
+	.cra_flags		= CRYPTO_ALG_TYPE_AEAD,
+	.cra_blocksize		= AES_BLOCK_SIZE,
+	.cra_ctxsize		= sizeof(struct authenc_sha1_aes_ctx),
+	.cra_type		= &crypto_aead_type,
+	.cra_module		= THIS_MODULE,
+	.cra_list		= LIST_HEAD_INIT(authenc_sha1_aes_alg.cra_list),
+	.cra_init		= authenc_sha1_aes_init_tfm,
+	.cra_exit		= authenc_sha1_aes_exit_tfm,
+	.cra_u			= {
+		.aead = {
+			.ivsize		= AES_BLOCK_SIZE,
+			.maxauthsize	= SHA1_DIGEST_SIZE,
+			.setkey		= authenc_sha1_aes_setkey,
+			.encrypt	= authenc_sha1_aes_encrypt,
+			.decrypt	= authenc_sha1_aes_decrypt,
+			.givencrypt	= authenc_sha1_aes_givencrypt,
+		}
+	}
+};
+
+static int __init authenc_sha1_aes_module_init(void)
+{
+	return crypto_register_alg(&authenc_sha1_aes_alg);
+}
+
+static void __exit authenc_sha1_aes_module_exit(void)
+{
+	crypto_unregister_alg(&authenc_sha1_aes_alg);
+}
+
+module_init(authenc_sha1_aes_module_init);
+module_exit(authenc_sha1_aes_module_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Fused single-pass authenc(hmac(sha1),cbc(aes))");
+MODULE_ALIAS("authenc(hmac(sha1),cbc(aes))");
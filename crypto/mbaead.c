@@ -0,0 +1,488 @@
+/*
+ * mb - Multi-buffer AEAD batching engine.
+ *
+ * Collects independent AEAD requests (typically IPsec ESP packets coming
+ * from xfrm in softirq context) into per-CPU batches and runs each batch
+ * from a kcrypto_wq worker.  A batch is flushed as soon as it holds
+ * 'batch_size' requests, or when the flush timer started by the first
+ * request of the batch expires.
+ *
+ * The instances keep the cra_name of the algorithm they wrap and get a
+ * higher priority, so once "mb(authenc(hmac(sha1),cbc(aes)))" exists,
+ * every new "authenc(hmac(sha1),cbc(aes))" user (xfrm included) picks it
+ * up without any API change.
+ *
+ * Running the batch from process context lets the wrapped algorithm use
+ * NEON, which is not usable from softirq.  All cipher and hash passes of
+ * a batch run back to back, and the completions (which re-enter the
+ * network stack) are then delivered together with bottom halves disabled
+ * once per batch, so the crypto and network code each stay cache hot.
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ */
+
+#include <crypto/algapi.h>
+#include <crypto/internal/aead.h>
+#include <crypto/crypto_wq.h>
+#include <linux/err.h>
+#include <linux/hrtimer.h>
+#include <linux/init.h>
+#include <linux/kernel.h>
+#include <linux/module.h>
+#include <linux/moduleparam.h>
+#include <linux/percpu.h>
+#include <linux/slab.h>
+#include <linux/spinlock.h>
+#include <linux/string.h>
+
+#define MB_MAX_CPU_QLEN		256
+#define MB_MAX_BATCH		32
+
+static unsigned int batch_size = 16;
+module_param(batch_size, uint, 0644);
+MODULE_PARM_DESC(batch_size, "Requests per batch (1-32, default 16)");
+
+static unsigned int flush_usecs = 100;
+module_param(flush_usecs, uint, 0644);
+MODULE_PARM_DESC(flush_usecs, "Flush a partial batch after this many "
+		 "microseconds (default 100)");
+
+static char *algs = "authenc(hmac(sha1),cbc(aes))";
+module_param(algs, charp, 0444);
+MODULE_PARM_DESC(algs, "';' separated list of AEAD algorithms to wrap "
+		 "at load time");
+
+enum {
+	MB_OP_ENCRYPT,
+	MB_OP_DECRYPT,
+	MB_OP_GIVENCRYPT,
+};
+
+struct mb_cpu_queue {
+	spinlock_t lock;
+	struct crypto_queue queue;
+	struct work_struct work;
+	struct hrtimer timer;
+	int cpu;
+};
+
+struct mb_instance_ctx {
+	struct crypto_aead_spawn spawn;
+};
+
+struct mb_aead_ctx {
+	struct crypto_aead *child;
+};
+
+struct mb_aead_request_ctx {
+	int op;
+	int err;
+	/* Must be last, the child's request context follows it. */
+	struct aead_givcrypt_request creq;
+};
+
+static struct mb_cpu_queue __percpu *mb_queues;
+
+static unsigned int mb_batch_size(void)
+{
+	return clamp_t(unsigned int, batch_size, 1, MB_MAX_BATCH);
+}
+
+static enum hrtimer_restart mb_flush_timer(struct hrtimer *timer)
+{
+	struct mb_cpu_queue *cq = container_of(timer, struct mb_cpu_queue,
+					       timer);
+
+	queue_work_on(cq->cpu, kcrypto_wq, &cq->work);
+	return HRTIMER_NORESTART;
+}
+
+static int mb_enqueue_request(struct crypto_async_request *req)
+{
+	struct mb_cpu_queue *cq;
+	unsigned int qlen;
+	int cpu, err;
+
+	cpu = get_cpu();
+	cq = per_cpu_ptr(mb_queues, cpu);
+
+	spin_lock_bh(&cq->lock);
+	err = crypto_enqueue_request(&cq->queue, req);
+	qlen = cq->queue.qlen;
+	if (qlen >= mb_batch_size() || !flush_usecs)
+		queue_work_on(cpu, kcrypto_wq, &cq->work);
+	else if (qlen == 1)
+		hrtimer_start(&cq->timer,
+			      ns_to_ktime((u64)flush_usecs * NSEC_PER_USEC),
+			      HRTIMER_MODE_REL_PINNED);
+	spin_unlock_bh(&cq->lock);
+
+	put_cpu();
+
+	return err;
+}
+
+static void mb_aead_run(struct aead_request *req)
+{
+	struct mb_aead_request_ctx *rctx = aead_request_ctx(req);
+	struct aead_givcrypt_request *creq = &rctx->creq;
+
+	switch (rctx->op) {
+	case MB_OP_ENCRYPT:
+		rctx->err = crypto_aead_encrypt(&creq->areq);
+		break;
+	case MB_OP_DECRYPT:
+		rctx->err = crypto_aead_decrypt(&creq->areq);
+		break;
+	default:
+		rctx->err = crypto_aead_givencrypt(creq);
+		break;
+	}
+}
+
+/*
+ * Called in workqueue context.  Takes up to one batch off this CPU's
+ * queue, runs all of it and then completes all of it.
+ */
+static void mb_queue_worker(struct work_struct *work)
+{
+	struct mb_cpu_queue *cq = container_of(work, struct mb_cpu_queue, work);
+	struct crypto_async_request *batch[MB_MAX_BATCH];
+	struct crypto_async_request *backlog[MB_MAX_BATCH];
+	struct crypto_async_request *areq;
+	unsigned int max = mb_batch_size();
+	unsigned int n = 0, nb = 0, i;
+	bool more;
+
+	spin_lock_bh(&cq->lock);
+	while (n < max) {
+		struct crypto_async_request *bl = crypto_get_backlog(&cq->queue);
+
+		areq = crypto_dequeue_request(&cq->queue);
+		if (!areq)
+			break;
+		if (bl)
+			backlog[nb++] = bl;
+		batch[n++] = areq;
+	}
+	more = cq->queue.qlen != 0;
+	if (!more)
+		hrtimer_try_to_cancel(&cq->timer);
+	spin_unlock_bh(&cq->lock);
+
+	for (i = 0; i < n; i++)
+		mb_aead_run(container_of(batch[i], struct aead_request, base));
+
+	local_bh_disable();
+	for (i = 0; i < nb; i++)
+		backlog[i]->complete(backlog[i], -EINPROGRESS);
+	for (i = 0; i < n; i++) {
+		struct aead_request *req;
+		struct mb_aead_request_ctx *rctx;
+
+		req = container_of(batch[i], struct aead_request, base);
+		rctx = aead_request_ctx(req);
+		if (rctx->err != -EINPROGRESS && rctx->err != -EBUSY)
+			aead_request_complete(req, rctx->err);
+	}
+	local_bh_enable();
+
+	if (more)
+		queue_work_on(cq->cpu, kcrypto_wq, &cq->work);
+}
+
+/* Only reached if the child went asynchronous after all. */
+static void mb_aead_done(struct crypto_async_request *areq, int err)
+{
+	struct aead_request *req = areq->data;
+
+	if (err == -EINPROGRESS)
+		return;
+
+	aead_request_complete(req, err);
+}
+
+static int mb_aead_enqueue(struct aead_request *req, int op,
+			   struct aead_givcrypt_request *greq)
+{
+	struct mb_aead_request_ctx *rctx = aead_request_ctx(req);
+	struct aead_givcrypt_request *creq = &rctx->creq;
+	struct crypto_aead *aead = crypto_aead_reqtfm(req);
+	struct mb_aead_ctx *ctx = crypto_aead_ctx(aead);
+
+	rctx->op = op;
+
+	aead_givcrypt_set_tfm(creq, ctx->child);
+	aead_givcrypt_set_callback(creq, aead_request_flags(req) |
+					 CRYPTO_TFM_REQ_MAY_SLEEP,
+				   mb_aead_done, req);
+	aead_givcrypt_set_crypt(creq, req->src, req->dst, req->cryptlen,
+				req->iv);
+	aead_givcrypt_set_assoc(creq, req->assoc, req->assoclen);
+	if (greq)
+		aead_givcrypt_set_giv(creq, greq->giv, greq->seq);
+
+	return mb_enqueue_request(&req->base);
+}
+
+static int mb_aead_encrypt(struct aead_request *req)
+{
+	return mb_aead_enqueue(req, MB_OP_ENCRYPT, NULL);
+}
+
+static int mb_aead_decrypt(struct aead_request *req)
+{
+	return mb_aead_enqueue(req, MB_OP_DECRYPT, NULL);
+}
+
+static int mb_aead_givencrypt(struct aead_givcrypt_request *req)
+{
+	return mb_aead_enqueue(&req->areq, MB_OP_GIVENCRYPT, req);
+}
+
+static int mb_aead_setkey(struct crypto_aead *parent, const u8 *key,
+			  unsigned int keylen)
+{
+	struct mb_aead_ctx *ctx = crypto_aead_ctx(parent);
+	struct crypto_aead *child = ctx->child;
+	int err;
+
+	crypto_aead_clear_flags(child, CRYPTO_TFM_REQ_MASK);
+	crypto_aead_set_flags(child, crypto_aead_get_flags(parent) &
+				     CRYPTO_TFM_REQ_MASK);
+	err = crypto_aead_setkey(child, key, keylen);
+	crypto_aead_set_flags(parent, crypto_aead_get_flags(child) &
+				      CRYPTO_TFM_RES_MASK);
+	return err;
+}
+
+static int mb_aead_setauthsize(struct crypto_aead *parent,
+			       unsigned int authsize)
+{
+	struct mb_aead_ctx *ctx = crypto_aead_ctx(parent);
+
+	return crypto_aead_setauthsize(ctx->child, authsize);
+}
+
+static int mb_aead_init_tfm(struct crypto_tfm *tfm)
+{
+	struct crypto_instance *inst = crypto_tfm_alg_instance(tfm);
+	struct mb_instance_ctx *ictx = crypto_instance_ctx(inst);
+	struct mb_aead_ctx *ctx = crypto_tfm_ctx(tfm);
+	struct crypto_aead *child;
+
+	child = crypto_spawn_aead(&ictx->spawn);
+	if (IS_ERR(child))
+		return PTR_ERR(child);
+
+	ctx->child = child;
+	tfm->crt_aead.reqsize = sizeof(struct mb_aead_request_ctx) +
+				crypto_aead_reqsize(child);
+	return 0;
+}
+
+static void mb_aead_exit_tfm(struct crypto_tfm *tfm)
+{
+	struct mb_aead_ctx *ctx = crypto_tfm_ctx(tfm);
+
+	crypto_free_aead(ctx->child);
+}
+
+static struct crypto_instance *mb_alloc_aead(struct rtattr **tb,
+					     u32 type, u32 mask)
+{
+	struct mb_instance_ctx *ctx;
+	struct crypto_instance *inst;
+	struct crypto_alg *alg;
+	const char *name;
+	int err;
+
+	name = crypto_attr_alg_name(tb[1]);
+	if (IS_ERR(name))
+		return ERR_CAST(name);
+
+	inst = kzalloc(sizeof(*inst) + sizeof(*ctx), GFP_KERNEL);
+	if (!inst)
+		return ERR_PTR(-ENOMEM);
+
+	ctx = crypto_instance_ctx(inst);
+	crypto_set_aead_spawn(&ctx->spawn, inst);
+
+	/*
+	 * Only wrap synchronous algorithms; this also keeps us from
+	 * finding our own instances, which share the cra_name.
+	 */
+	err = crypto_grab_aead(&ctx->spawn, name, type & ~CRYPTO_ALG_ASYNC,
+			       mask | CRYPTO_ALG_ASYNC);
+	if (err)
+		goto out_free_inst;
+
+	alg = crypto_aead_spawn_alg(&ctx->spawn);
+
+	/*
+	 * Name the instance after the requested algorithm rather than the
+	 * spawn's driver name, so that the larval waiting on "mb(name)"
+	 * is satisfied once the instance passes its self-test.
+	 */
+	err = -ENAMETOOLONG;
+	if (snprintf(inst->alg.cra_driver_name, CRYPTO_MAX_ALG_NAME,
+		     "mb(%s)", name) >= CRYPTO_MAX_ALG_NAME)
+		goto out_drop_aead;
+
+	memcpy(inst->alg.cra_name, alg->cra_name, CRYPTO_MAX_ALG_NAME);
+
+	inst->alg.cra_flags = CRYPTO_ALG_TYPE_AEAD | CRYPTO_ALG_ASYNC;
+	inst->alg.cra_type = &crypto_aead_type;
+	inst->alg.cra_priority = alg->cra_priority + 100;
+	inst->alg.cra_blocksize = alg->cra_blocksize;
+	inst->alg.cra_alignmask = alg->cra_alignmask;
+
+	inst->alg.cra_aead.ivsize = alg->cra_aead.ivsize;
+	inst->alg.cra_aead.geniv = alg->cra_aead.geniv;
+	inst->alg.cra_aead.maxauthsize = alg->cra_aead.maxauthsize;
+
+	inst->alg.cra_ctxsize = sizeof(struct mb_aead_ctx);
+
+	inst->alg.cra_init = mb_aead_init_tfm;
+	inst->alg.cra_exit = mb_aead_exit_tfm;
+
+	inst->alg.cra_aead.setkey = mb_aead_setkey;
+	inst->alg.cra_aead.setauthsize = mb_aead_setauthsize;
+	inst->alg.cra_aead.encrypt = mb_aead_encrypt;
+	inst->alg.cra_aead.decrypt = mb_aead_decrypt;
+	inst->alg.cra_aead.givencrypt = mb_aead_givencrypt;
+
+	return inst;
+
+out_drop_aead:
+	crypto_drop_aead(&ctx->spawn);
+out_free_inst:
+	kfree(inst);
+	return ERR_PTR(err);
+}
+
+static struct crypto_instance *mb_alloc(struct rtattr **tb)
+{
+	struct crypto_attr_type *algt;
+
+	algt = crypto_get_attr_type(tb);
+	if (IS_ERR(algt))
+		return ERR_CAST(algt);
+
+	switch (algt->type & algt->mask & CRYPTO_ALG_TYPE_MASK) {
+	case CRYPTO_ALG_TYPE_AEAD:
+		return mb_alloc_aead(tb, algt->type, algt->mask);
+	}
+
+	return ERR_PTR(-EINVAL);
+}
+
+static void mb_free(struct crypto_instance *inst)
+{
+	struct mb_instance_ctx *ctx = crypto_instance_ctx(inst);
+
+	crypto_drop_aead(&ctx->spawn);
+	kfree(inst);
+}
+
+static struct crypto_template mb_tmpl = {
+	.name = "mb",
+	.alloc = mb_alloc,
+	.free = mb_free,
+	.module = THIS_MODULE,
+};
+
+/*
+ * Instantiate mb() around each algorithm listed in the 'algs' parameter.
+ * Once registered, the instance outranks the wrapped algorithm, so later
+ * allocations by cra_name (e.g. from xfrm) pick up the batching engine.
+ */
+static void __init mb_wrap_one(const char *alg)
+{
+	char name[CRYPTO_MAX_ALG_NAME];
+
+	if (snprintf(name, sizeof(name), "mb(%s)", alg) >= sizeof(name))
+		return;
+
+	if (!crypto_has_alg(name, CRYPTO_ALG_TYPE_AEAD, CRYPTO_ALG_TYPE_MASK))
+		pr_info("mb: could not instantiate %s\n", name);
+}
+
+static void __init mb_wrap_algs(void)
+{
+	char alg[CRYPTO_MAX_ALG_NAME];
+	const char *p = algs;
+
+	while (p && *p) {
+		size_t len = strcspn(p, ";");
+
+		if (len && len < sizeof(alg)) {
+			memcpy(alg, p, len);
+			alg[len] = 0;
+			mb_wrap_one(alg);
+		}
+
+		p += len;
+		if (*p)
+			p++;
+	}
+}
+
+static int __init mb_init(void)
+{
+	struct mb_cpu_queue *cq;
+	int cpu, err;
+
+	mb_queues = alloc_percpu(struct mb_cpu_queue);
+	if (!mb_queues)
+		return -ENOMEM;
+
+	for_each_possible_cpu(cpu) {
+		cq = per_cpu_ptr(mb_queues, cpu);
+		spin_lock_init(&cq->lock);
+		crypto_init_queue(&cq->queue, MB_MAX_CPU_QLEN);
+		INIT_WORK(&cq->work, mb_queue_worker);
+		hrtimer_init(&cq->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		cq->timer.function = mb_flush_timer;
+		cq->cpu = cpu;
+	}
+
+	err = crypto_register_template(&mb_tmpl);
+	if (err) {
+		free_percpu(mb_queues);
+		return err;
+	}
+
+	mb_wrap_algs();
+	return 0;
+}
+
+static void __exit mb_exit(void)
+{
+	struct mb_cpu_queue *cq;
+	int cpu;
+
+	crypto_unregister_template(&mb_tmpl);
+
+	for_each_possible_cpu(cpu) {
+		cq = per_cpu_ptr(mb_queues, cpu);
+		hrtimer_cancel(&cq->timer);
+		flush_work(&cq->work);
+		BUG_ON(cq->queue.qlen);
+	}
+	free_percpu(mb_queues);
+}
+
+/*
+ * Run late when built in, so that the algorithms named in 'algs' are
+ * registered by the time they are wrapped.
+ */
+late_initcall(mb_init);
+module_exit(mb_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Multi-buffer AEAD batching engine");
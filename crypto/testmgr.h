@@ -443,7 +443,7 @@ static struct hash_testvec rmd320_tv_template[] = {
 /*
  * SHA1 test vectors  from from FIPS PUB 180-1
  */
-#define SHA1_TEST_VECTORS	2
+#define SHA1_TEST_VECTORS	3
 
 static struct hash_testvec sha1_tv_template[] = {
 	{
@@ -458,6 +458,14 @@ static struct hash_testvec sha1_tv_template[] = {
 			  "\x4a\xa1\xf9\x51\x29\xe5\xe5\x46\x70\xf1",
 		.np	= 2,
 		.tap	= { 28, 28 }
+	}, {
+		.plaintext = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+			     "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+			     "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+			     "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+		.psize	= 224,
+		.digest	= "\x06\xce\x30\xb6\x32\x66\x1c\x42\x50\x92"
+			  "\x83\xfa\xb8\xe3\x99\x99\xe9\x8c\x07\x4c",
 	}
 };
 
@@ -465,7 +473,7 @@ static struct hash_testvec sha1_tv_template[] = {
 /*
  * SHA224 test vectors from from FIPS PUB 180-2
  */
-#define SHA224_TEST_VECTORS     2
+#define SHA224_TEST_VECTORS     3
 
 static struct hash_testvec sha224_tv_template[] = {
 	{
@@ -485,13 +493,23 @@ static struct hash_testvec sha224_tv_template[] = {
 			  "\x52\x52\x25\x25",
 		.np     = 2,
 		.tap    = { 28, 28 }
+	}, {
+		.plaintext = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+			     "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+			     "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+			     "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+		.psize  = 224,
+		.digest = "\x27\xb4\x6a\xba\x8c\xfe\x0f\x86"
+			  "\x7d\x8d\xb2\xe7\x9d\xc6\x1c\xc5"
+			  "\xf5\x0f\xf2\xd9\xa5\x7b\xc9\xa7"
+			  "\xb8\xb8\xbc\x95",
 	}
 };
 
 /*
  * SHA256 test vectors from from NIST
  */
-#define SHA256_TEST_VECTORS	2
+#define SHA256_TEST_VECTORS	3
 
 static struct hash_testvec sha256_tv_template[] = {
 	{
@@ -510,6 +528,16 @@ static struct hash_testvec sha256_tv_template[] = {
 			  "\xf6\xec\xed\xd4\x19\xdb\x06\xc1",
 		.np	= 2,
 		.tap	= { 28, 28 }
+	}, {
+		.plaintext = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+			     "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+			     "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq"
+			     "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+		.psize	= 224,
+		.digest	= "\xc7\xf1\xc8\xa2\x06\x73\xc7\xb6"
+			  "\x32\x15\xbe\x59\x41\x6f\x71\x2f"
+			  "\x9e\x4a\x3d\xbd\x1f\x43\xf6\x9d"
+			  "\xb1\xee\x27\xa1\x63\x3d\x35\x5c",
 	},
 };
 
@@ -6455,6 +6483,277 @@ static struct aead_testvec aes_ccm_rfc4309_dec_tv_template[] = {
 	},
 };
 
+/*
+ * authenc(hmac(sha1),cbc(aes)) test vectors.  The cipher parts of the
+ * first two are the RFC 3602 test cases; the ICV covers assoc || IV ||
+ * ciphertext as for ESP.
+ */
+#define HMAC_SHA1_AES_CBC_ENC_TEST_VECTORS	3
+#define HMAC_SHA1_AES_CBC_DEC_TEST_VECTORS	4
+
+static struct aead_testvec hmac_sha1_aes_cbc_enc_tv_template[] = {
+	{ /* RFC 3602 Case 1 cipher, HMAC-SHA1 ICV */
+#ifdef __LITTLE_ENDIAN
+		.key	= "\x08\x00"		/* rta length */
+			  "\x01\x00"		/* rta type */
+#else
+		.key	= "\x00\x08"		/* rta length */
+			  "\x00\x01"		/* rta type */
+#endif
+			  "\x00\x00\x00\x10"	/* enc key length */
+			  "\x11\x12\x13\x14\x15\x16\x17\x18"
+			  "\x19\x1a\x1b\x1c\x1d\x1e\x1f\x20"
+			  "\x21\x22\x23\x24\x06\xa9\x21\x40"
+			  "\x36\xb8\xa1\x5b\x51\x2e\x03\xd5"
+			  "\x34\x12\x00\x06",
+		.klen	= 44,
+		.iv	= "\x3d\xaf\xba\x42\x9d\x9e\xb4\x30"
+			  "\xb4\x22\xda\x80\x2c\x9f\xac\x41",
+		.assoc	= "\x00\x00\x43\x21\x00\x00\x00\x01",
+		.alen	= 8,
+		.input	= "\x53\x69\x6e\x67\x6c\x65\x20\x62"
+			  "\x6c\x6f\x63\x6b\x20\x6d\x73\x67",
+		.ilen	= 16,
+		.result	= "\xe3\x53\x77\x9c\x10\x79\xae\xb8"
+			  "\x27\x08\x94\x2d\xbe\x77\x18\x1a"
+			  "\xf8\x5a\xca\x54\x12\x93\x36\xfc"
+			  "\xe0\x89\x49\x6b\xf3\xec\xe4\xdc"
+			  "\x22\x74\x27\xfb",
+		.rlen	= 36,
+	}, { /* RFC 3602 Case 2 cipher, HMAC-SHA1-96 ICV */
+#ifdef __LITTLE_ENDIAN
+		.key	= "\x08\x00"		/* rta length */
+			  "\x01\x00"		/* rta type */
+#else
+		.key	= "\x00\x08"		/* rta length */
+			  "\x00\x01"		/* rta type */
+#endif
+			  "\x00\x00\x00\x10"	/* enc key length */
+			  "\x5a\x5a\x5a\x5a\x5a\x5a\x5a\x5a"
+			  "\x5a\x5a\x5a\x5a\x5a\x5a\x5a\x5a"
+			  "\x5a\x5a\x5a\x5a\xc2\x86\x69\x6d"
+			  "\x88\x7c\x9a\xa0\x61\x1b\xbb\x3e"
+			  "\x20\x25\xa4\x5a",
+		.klen	= 44,
+		.iv	= "\x56\x2e\x17\x99\x6d\x09\x3d\x28"
+			  "\xdd\xb3\xba\x69\x5a\x2e\x6f\x58",
+		.assoc	= "\x00\x00\x43\x21\x00\x00\x00\x02",
+		.alen	= 8,
+		.input	= "\x00\x01\x02\x03\x04\x05\x06\x07"
+			  "\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+			  "\x10\x11\x12\x13\x14\x15\x16\x17"
+			  "\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f",
+		.ilen	= 32,
+		.result	= "\xd2\x96\xcd\x94\xc2\xcc\xcf\x8a"
+			  "\x3a\x86\x30\x28\xb5\xe1\xdc\x0a"
+			  "\x75\x86\x60\x2d\x25\x3c\xff\xf9"
+			  "\x1b\x82\x66\xbe\xa6\xd6\x1a\xb1"
+			  "\xdc\x6d\x8e\x7b\x20\xad\x0c\x9e"
+			  "\xa0\xca\xe0\xff",
+		.rlen	= 44,
+	}, {
+#ifdef __LITTLE_ENDIAN
+		.key	= "\x08\x00"		/* rta length */
+			  "\x01\x00"		/* rta type */
+#else
+		.key	= "\x00\x08"		/* rta length */
+			  "\x00\x01"		/* rta type */
+#endif
+			  "\x00\x00\x00\x20"	/* enc key length */
+			  "\x07\x14\x21\x2e\x3b\x48\x55\x62"
+			  "\x6f\x7c\x89\x96\xa3\xb0\xbd\xca"
+			  "\xd7\xe4\xf1\xfe\x0b\x18\x25\x32"
+			  "\x3f\x4c\x59\x66\x73\x80\x8d\x9a"
+			  "\xa7\xb4\xc1\xce\xdb\xe8\xf5\x02"
+			  "\x0f\x1c\x29\x36\x43\x50\x5d\x6a"
+			  "\x77\x84\x91\x9e\xab\xb8\xc5\xd2"
+			  "\xdf\xec\xf9\x06\x13\x20\x2d\x3a"
+			  "\x47\x54\x61\x6e\x7b\x88\x95\xa2"
+			  "\xaf\xbc\xc9\xd6\xe3\xf0\xfd\x0a"
+			  "\x03\x20\x3d\x5a\x77\x94\xb1\xce"
+			  "\xeb\x08\x25\x42\x5f\x7c\x99\xb6"
+			  "\xd3\xf0\x0d\x2a\x47\x64\x81\x9e"
+			  "\xbb\xd8\xf5\x12\x2f\x4c\x69\x86",
+		.klen	= 120,
+		.iv	= "\x01\x06\x0b\x10\x15\x1a\x1f\x24"
+			  "\x29\x2e\x33\x38\x3d\x42\x47\x4c",
+		.assoc	= "\xa0\xa1\xa2\xa3\xa4\xa5\xa6\xa7"
+			  "\xa8\xa9\xaa\xab",
+		.alen	= 12,
+		.input	= "\x30\x37\x3e\x45\x4c\x53\x5a\x61"
+			  "\x68\x6f\x76\x7d\x84\x8b\x92\x99"
+			  "\xa0\xa7\xae\xb5\xbc\xc3\xca\xd1"
+			  "\xd8\xdf\xe6\xed\xf4\xfb\x02\x09"
+			  "\x10\x17\x1e\x25\x2c\x33\x3a\x41"
+			  "\x48\x4f\x56\x5d\x64\x6b\x72\x79"
+			  "\x80\x87\x8e\x95\x9c\xa3\xaa\xb1"
+			  "\xb8\xbf\xc6\xcd\xd4\xdb\xe2\xe9",
+		.ilen	= 64,
+		.result	= "\x51\x1f\x48\x6d\x8c\xbc\x30\x84"
+			  "\x76\x02\x69\x88\x40\xa8\xdb\xe7"
+			  "\xeb\x5f\xbc\x7e\xd4\xbc\x3a\xcd"
+			  "\x9a\x05\xcb\xd8\x59\xd6\x6a\xeb"
+			  "\x7b\x30\x79\x6c\x12\x2b\x43\xdd"
+			  "\x71\x26\x8b\x5d\x68\xe6\x31\x7e"
+			  "\xf8\x05\xe2\x5e\x4b\x1a\x9f\x5b"
+			  "\xea\xcd\xb3\xd0\x60\x75\x72\x4d"
+			  "\xb5\x9a\xa1\x24\x38\x6e\x0b\xed"
+			  "\x59\x7b\xf2\xb0\xaf\x63\x09\x02"
+			  "\x4e\x86\x9f\x3c",
+		.rlen	= 84,
+		.np	= 3,
+		.tap	= { 20, 36, 8 },
+		.anp	= 2,
+		.atap	= { 5, 7 },
+	}
+};
+
+static struct aead_testvec hmac_sha1_aes_cbc_dec_tv_template[] = {
+	{ /* RFC 3602 Case 1 cipher, HMAC-SHA1 ICV */
+#ifdef __LITTLE_ENDIAN
+		.key	= "\x08\x00"		/* rta length */
+			  "\x01\x00"		/* rta type */
+#else
+		.key	= "\x00\x08"		/* rta length */
+			  "\x00\x01"		/* rta type */
+#endif
+			  "\x00\x00\x00\x10"	/* enc key length */
+			  "\x11\x12\x13\x14\x15\x16\x17\x18"
+			  "\x19\x1a\x1b\x1c\x1d\x1e\x1f\x20"
+			  "\x21\x22\x23\x24\x06\xa9\x21\x40"
+			  "\x36\xb8\xa1\x5b\x51\x2e\x03\xd5"
+			  "\x34\x12\x00\x06",
+		.klen	= 44,
+		.iv	= "\x3d\xaf\xba\x42\x9d\x9e\xb4\x30"
+			  "\xb4\x22\xda\x80\x2c\x9f\xac\x41",
+		.assoc	= "\x00\x00\x43\x21\x00\x00\x00\x01",
+		.alen	= 8,
+		.input	= "\xe3\x53\x77\x9c\x10\x79\xae\xb8"
+			  "\x27\x08\x94\x2d\xbe\x77\x18\x1a"
+			  "\xf8\x5a\xca\x54\x12\x93\x36\xfc"
+			  "\xe0\x89\x49\x6b\xf3\xec\xe4\xdc"
+			  "\x22\x74\x27\xfb",
+		.ilen	= 36,
+		.result	= "\x53\x69\x6e\x67\x6c\x65\x20\x62"
+			  "\x6c\x6f\x63\x6b\x20\x6d\x73\x67",
+		.rlen	= 16,
+	}, { /* RFC 3602 Case 2 cipher, HMAC-SHA1-96 ICV */
+#ifdef __LITTLE_ENDIAN
+		.key	= "\x08\x00"		/* rta length */
+			  "\x01\x00"		/* rta type */
+#else
+		.key	= "\x00\x08"		/* rta length */
+			  "\x00\x01"		/* rta type */
+#endif
+			  "\x00\x00\x00\x10"	/* enc key length */
+			  "\x5a\x5a\x5a\x5a\x5a\x5a\x5a\x5a"
+			  "\x5a\x5a\x5a\x5a\x5a\x5a\x5a\x5a"
+			  "\x5a\x5a\x5a\x5a\xc2\x86\x69\x6d"
+			  "\x88\x7c\x9a\xa0\x61\x1b\xbb\x3e"
+			  "\x20\x25\xa4\x5a",
+		.klen	= 44,
+		.iv	= "\x56\x2e\x17\x99\x6d\x09\x3d\x28"
+			  "\xdd\xb3\xba\x69\x5a\x2e\x6f\x58",
+		.assoc	= "\x00\x00\x43\x21\x00\x00\x00\x02",
+		.alen	= 8,
+		.input	= "\xd2\x96\xcd\x94\xc2\xcc\xcf\x8a"
+			  "\x3a\x86\x30\x28\xb5\xe1\xdc\x0a"
+			  "\x75\x86\x60\x2d\x25\x3c\xff\xf9"
+			  "\x1b\x82\x66\xbe\xa6\xd6\x1a\xb1"
+			  "\xdc\x6d\x8e\x7b\x20\xad\x0c\x9e"
+			  "\xa0\xca\xe0\xff",
+		.ilen	= 44,
+		.result	= "\x00\x01\x02\x03\x04\x05\x06\x07"
+			  "\x08\x09\x0a\x0b\x0c\x0d\x0e\x0f"
+			  "\x10\x11\x12\x13\x14\x15\x16\x17"
+			  "\x18\x19\x1a\x1b\x1c\x1d\x1e\x1f",
+		.rlen	= 32,
+	}, {
+#ifdef __LITTLE_ENDIAN
+		.key	= "\x08\x00"		/* rta length */
+			  "\x01\x00"		/* rta type */
+#else
+		.key	= "\x00\x08"		/* rta length */
+			  "\x00\x01"		/* rta type */
+#endif
+			  "\x00\x00\x00\x20"	/* enc key length */
+			  "\x07\x14\x21\x2e\x3b\x48\x55\x62"
+			  "\x6f\x7c\x89\x96\xa3\xb0\xbd\xca"
+			  "\xd7\xe4\xf1\xfe\x0b\x18\x25\x32"
+			  "\x3f\x4c\x59\x66\x73\x80\x8d\x9a"
+			  "\xa7\xb4\xc1\xce\xdb\xe8\xf5\x02"
+			  "\x0f\x1c\x29\x36\x43\x50\x5d\x6a"
+			  "\x77\x84\x91\x9e\xab\xb8\xc5\xd2"
+			  "\xdf\xec\xf9\x06\x13\x20\x2d\x3a"
+			  "\x47\x54\x61\x6e\x7b\x88\x95\xa2"
+			  "\xaf\xbc\xc9\xd6\xe3\xf0\xfd\x0a"
+			  "\x03\x20\x3d\x5a\x77\x94\xb1\xce"
+			  "\xeb\x08\x25\x42\x5f\x7c\x99\xb6"
+			  "\xd3\xf0\x0d\x2a\x47\x64\x81\x9e"
+			  "\xbb\xd8\xf5\x12\x2f\x4c\x69\x86",
+		.klen	= 120,
+		.iv	= "\x01\x06\x0b\x10\x15\x1a\x1f\x24"
+			  "\x29\x2e\x33\x38\x3d\x42\x47\x4c",
+		.assoc	= "\xa0\xa1\xa2\xa3\xa4\xa5\xa6\xa7"
+			  "\xa8\xa9\xaa\xab",
+		.alen	= 12,
+		.input	= "\x51\x1f\x48\x6d\x8c\xbc\x30\x84"
+			  "\x76\x02\x69\x88\x40\xa8\xdb\xe7"
+			  "\xeb\x5f\xbc\x7e\xd4\xbc\x3a\xcd"
+			  "\x9a\x05\xcb\xd8\x59\xd6\x6a\xeb"
+			  "\x7b\x30\x79\x6c\x12\x2b\x43\xdd"
+			  "\x71\x26\x8b\x5d\x68\xe6\x31\x7e"
+			  "\xf8\x05\xe2\x5e\x4b\x1a\x9f\x5b"
+			  "\xea\xcd\xb3\xd0\x60\x75\x72\x4d"
+			  "\xb5\x9a\xa1\x24\x38\x6e\x0b\xed"
+			  "\x59\x7b\xf2\xb0\xaf\x63\x09\x02"
+			  "\x4e\x86\x9f\x3c",
+		.ilen	= 84,
+		.result	= "\x30\x37\x3e\x45\x4c\x53\x5a\x61"
+			  "\x68\x6f\x76\x7d\x84\x8b\x92\x99"
+			  "\xa0\xa7\xae\xb5\xbc\xc3\xca\xd1"
+			  "\xd8\xdf\xe6\xed\xf4\xfb\x02\x09"
+			  "\x10\x17\x1e\x25\x2c\x33\x3a\x41"
+			  "\x48\x4f\x56\x5d\x64\x6b\x72\x79"
+			  "\x80\x87\x8e\x95\x9c\xa3\xaa\xb1"
+			  "\xb8\xbf\xc6\xcd\xd4\xdb\xe2\xe9",
+		.rlen	= 64,
+		.np	= 3,
+		.tap	= { 20, 40, 24 },
+		.anp	= 2,
+		.atap	= { 5, 7 },
+	}, { /* Corrupted ICV */
+#ifdef __LITTLE_ENDIAN
+		.key	= "\x08\x00"		/* rta length */
+			  "\x01\x00"		/* rta type */
+#else
+		.key	= "\x00\x08"		/* rta length */
+			  "\x00\x01"		/* rta type */
+#endif
+			  "\x00\x00\x00\x10"	/* enc key length */
+			  "\x11\x12\x13\x14\x15\x16\x17\x18"
+			  "\x19\x1a\x1b\x1c\x1d\x1e\x1f\x20"
+			  "\x21\x22\x23\x24\x06\xa9\x21\x40"
+			  "\x36\xb8\xa1\x5b\x51\x2e\x03\xd5"
+			  "\x34\x12\x00\x06",
+		.klen	= 44,
+		.iv	= "\x3d\xaf\xba\x42\x9d\x9e\xb4\x30"
+			  "\xb4\x22\xda\x80\x2c\x9f\xac\x41",
+		.assoc	= "\x00\x00\x43\x21\x00\x00\x00\x01",
+		.alen	= 8,
+		.input	= "\xe3\x53\x77\x9c\x10\x79\xae\xb8"
+			  "\x27\x08\x94\x2d\xbe\x77\x18\x1a"
+			  "\xf8\x5a\xca\x54\x12\x93\x36\xfc"
+			  "\xe0\x89\x49\x6b\xf3\xec\xe4\xdc"
+			  "\x22\x74\x27\xfa",
+		.ilen	= 36,
+		.result	= "\x53\x69\x6e\x67\x6c\x65\x20\x62"
+			  "\x6c\x6f\x63\x6b\x20\x6d\x73\x67",
+		.rlen	= 16,
+		.novrfy	= 1,
+	}
+};
+
 /*
  * ANSI X9.31 Continuous Pseudo-Random Number Generator (AES mode)
  * test vectors, taken from Appendix B.2.9 and B.2.10:
@@ -21,6 +21,7 @@
  */
 
 #include <linux/fs.h>
+#include <linux/genhd.h>
 #include <linux/init.h>
 #include <linux/kernel.h>
 #include <linux/module.h>
@@ -28,32 +29,64 @@
 #include <linux/slab.h>
 #include <linux/types.h>
 #include <linux/vmalloc.h>
+#include <linux/workqueue.h>
 
 #include <linux/mtd/mtd.h>
 #include <linux/mtd/blktrans.h>
 #include <linux/mutex.h>
 
 
+/*
+ * One cached eraseblock.  Only the first 'valid' bytes of 'data' are up
+ * to date: a block that is written sequentially from its start is never
+ * read from flash, the rest is only read in when it is needed.
+ */
+struct mtdblk_cache {
+	struct list_head list;
+	unsigned char *data;
+	unsigned long offset;
+	unsigned int valid;
+	unsigned long dirtied;
+	enum { STATE_EMPTY, STATE_CLEAN, STATE_DIRTY } state;
+};
+
 struct mtdblk_dev {
 	struct mtd_blktrans_dev mbd;
 	int count;
 	struct mutex cache_mutex;
-	unsigned char *cache_data;
-	unsigned long cache_offset;
+	struct list_head cache_lru;	/* most recently used first */
+	unsigned int cache_nr;
 	unsigned int cache_size;
-	enum { STATE_EMPTY, STATE_CLEAN, STATE_DIRTY } cache_state;
+	struct delayed_work writeback_work;
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long erases;
 };
 
 static struct mutex mtdblks_lock;
 
+static unsigned int cache_blocks = 4;
+module_param(cache_blocks, uint, S_IRUGO);
+MODULE_PARM_DESC(cache_blocks,
+	"Number of eraseblocks cached per device (4 default)");
+
+static unsigned int writeback_delay = 5000;
+module_param(writeback_delay, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(writeback_delay,
+	"Time (in ms) a dirty eraseblock is kept before it is written back, "
+	"0 to only write it back when the cache needs it or on sync "
+	"(5000 ms default)");
+
 /*
  * Cache stuff...
  *
  * Since typical flash erasable sectors are much larger than what Linux's
  * buffer cache can handle, we must implement read-modify-write on flash
  * sectors for each block write requests.  To avoid over-erasing flash sectors
- * and to speed things up, we locally cache a whole flash sector while it is
- * being written to until a different sector is required.
+ * and to speed things up, we locally cache a few whole flash sectors while
+ * they are being written to, and only write one back when it has been dirty
+ * for writeback_delay, when its slot is needed for another sector (least
+ * recently used first), or on sync and close.
  */
 
 static void erase_callback(struct erase_info *done)
@@ -62,9 +95,10 @@ static void erase_callback(struct erase_info *done)
 	wake_up(wait_q);
 }
 
-static int erase_write (struct mtd_info *mtd, unsigned long pos,
+static int erase_write (struct mtdblk_dev *mtdblk, unsigned long pos,
 			int len, const char *buf)
 {
+	struct mtd_info *mtd = mtdblk->mbd.mtd;
 	struct erase_info erase;
 	DECLARE_WAITQUEUE(wait, current);
 	wait_queue_head_t wait_q;
@@ -97,6 +131,7 @@ static int erase_write (struct mtd_info *mtd, unsigned long pos,
 
 	schedule();  /* Wait for erase to finish. */
 	remove_wait_queue(&wait_q, &wait);
+	mtdblk->erases++;
 
 	/*
 	 * Next, write the data to flash.
@@ -111,20 +146,46 @@ static int erase_write (struct mtd_info *mtd, unsigned long pos,
 }
 
 
-static int write_cached_data (struct mtdblk_dev *mtdblk)
+/* read in the part of the sector that is not in the cache yet */
+static int fill_cache_entry (struct mtdblk_dev *mtdblk, struct mtdblk_cache *c)
 {
 	struct mtd_info *mtd = mtdblk->mbd.mtd;
+	unsigned int size = mtdblk->cache_size - c->valid;
+	size_t retlen;
 	int ret;
 
-	if (mtdblk->cache_state != STATE_DIRTY)
+	if (!size)
+		return 0;
+
+	ret = mtd->read(mtd, c->offset + c->valid, size, &retlen,
+			c->data + c->valid);
+	if (ret)
+		return ret;
+	if (retlen != size)
+		return -EIO;
+
+	c->valid = mtdblk->cache_size;
+	return 0;
+}
+
+
+static int write_cache_entry (struct mtdblk_dev *mtdblk, struct mtdblk_cache *c)
+{
+	struct mtd_info *mtd = mtdblk->mbd.mtd;
+	int ret;
+
+	if (c->state != STATE_DIRTY)
 		return 0;
 
 	DEBUG(MTD_DEBUG_LEVEL2, "mtdblock: writing cached data for \"%s\" "
 			"at 0x%lx, size 0x%x\n", mtd->name,
-			mtdblk->cache_offset, mtdblk->cache_size);
+			c->offset, mtdblk->cache_size);
+
+	ret = fill_cache_entry(mtdblk, c);
+	if (ret)
+		return ret;
 
-	ret = erase_write (mtd, mtdblk->cache_offset,
-			   mtdblk->cache_size, mtdblk->cache_data);
+	ret = erase_write (mtdblk, c->offset, mtdblk->cache_size, c->data);
 	if (ret)
 		return ret;
 
@@ -135,16 +196,152 @@ static int write_cached_data (struct mtdblk_dev *mtdblk)
 	 * means.  Let's declare it empty and leave buffering tasks to
 	 * the buffer cache instead.
 	 */
-	mtdblk->cache_state = STATE_EMPTY;
+	c->state = STATE_EMPTY;
+	c->valid = 0;
 	return 0;
 }
 
 
+static int write_cached_data (struct mtdblk_dev *mtdblk)
+{
+	struct mtdblk_cache *c;
+	int ret, err = 0;
+
+	list_for_each_entry(c, &mtdblk->cache_lru, list) {
+		ret = write_cache_entry(mtdblk, c);
+		if (ret && !err)
+			err = ret;
+	}
+
+	return err;
+}
+
+
+static void mtdblock_writeback_work(struct work_struct *work)
+{
+	struct mtdblk_dev *mtdblk = container_of(work, struct mtdblk_dev,
+						 writeback_work.work);
+	unsigned long delay = msecs_to_jiffies(writeback_delay);
+	unsigned long next = 0;
+	struct mtdblk_cache *c;
+	int ret;
+
+	mutex_lock(&mtdblk->cache_mutex);
+	list_for_each_entry(c, &mtdblk->cache_lru, list) {
+		if (c->state != STATE_DIRTY)
+			continue;
+
+		if (time_before(jiffies, c->dirtied + delay)) {
+			if (!next || time_before(c->dirtied + delay, next))
+				next = c->dirtied + delay;
+			continue;
+		}
+
+		/*
+		 * On failure the sector stays dirty, and is written back
+		 * again when its slot is needed or on sync.
+		 */
+		ret = write_cache_entry(mtdblk, c);
+		if (ret)
+			printk(KERN_WARNING "mtdblock: write back of 0x%lx on "
+			       "\"%s\" failed: %d\n", c->offset,
+			       mtdblk->mbd.mtd->name, ret);
+	}
+
+	if (next && writeback_delay)
+		schedule_delayed_work(&mtdblk->writeback_work,
+				      max_t(long, next - jiffies, 1));
+	mutex_unlock(&mtdblk->cache_mutex);
+}
+
+
+static struct mtdblk_cache *find_cache_entry (struct mtdblk_dev *mtdblk,
+					      unsigned long sect_start)
+{
+	struct mtdblk_cache *c;
+
+	list_for_each_entry(c, &mtdblk->cache_lru, list) {
+		if (c->state != STATE_EMPTY && c->offset == sect_start) {
+			list_move(&c->list, &mtdblk->cache_lru);
+			mtdblk->hits++;
+			return c;
+		}
+	}
+
+	mtdblk->misses++;
+	return NULL;
+}
+
+
+/*
+ * Find a slot for a sector that is not cached: an empty one if there is
+ * one, a new one while there are fewer than cache_blocks, or else the
+ * least recently used one, which is written back first if it is dirty.
+ */
+static struct mtdblk_cache *get_cache_entry (struct mtdblk_dev *mtdblk,
+					     unsigned long sect_start)
+{
+	struct mtdblk_cache *c;
+	int ret;
+
+	list_for_each_entry_reverse(c, &mtdblk->cache_lru, list)
+		if (c->state == STATE_EMPTY)
+			goto found;
+
+	c = NULL;
+	if (mtdblk->cache_nr < max(cache_blocks, 1U)) {
+		c = kzalloc(sizeof(*c), GFP_KERNEL);
+		if (c)
+			c->data = vmalloc(mtdblk->cache_size);
+		if (c && c->data) {
+			list_add(&c->list, &mtdblk->cache_lru);
+			mtdblk->cache_nr++;
+			goto found;
+		}
+		kfree(c);
+		c = NULL;
+	}
+
+	if (list_empty(&mtdblk->cache_lru))
+		/* -EINTR is not really correct, but it is the best match
+		 * documented in man 2 write for all cases.  We could also
+		 * return -EAGAIN sometimes, but why bother?
+		 */
+		return ERR_PTR(-EINTR);
+
+	c = list_entry(mtdblk->cache_lru.prev, struct mtdblk_cache, list);
+	ret = write_cache_entry(mtdblk, c);
+	if (ret)
+		return ERR_PTR(ret);
+
+found:
+	list_move(&c->list, &mtdblk->cache_lru);
+	c->offset = sect_start;
+	c->valid = 0;
+	c->state = STATE_CLEAN;
+	return c;
+}
+
+
+static void free_cache (struct mtdblk_dev *mtdblk)
+{
+	struct mtdblk_cache *c, *next;
+
+	list_for_each_entry_safe(c, next, &mtdblk->cache_lru, list) {
+		list_del(&c->list);
+		vfree(c->data);
+		kfree(c);
+	}
+	mtdblk->cache_nr = 0;
+}
+
+
 static int do_cached_write (struct mtdblk_dev *mtdblk, unsigned long pos,
 			    int len, const char *buf)
 {
 	struct mtd_info *mtd = mtdblk->mbd.mtd;
 	unsigned int sect_size = mtdblk->cache_size;
+	struct mtdblk_cache *c;
 	size_t retlen;
 	int ret;
 
@@ -161,44 +358,56 @@ static int do_cached_write (struct mtdblk_dev *mtdblk, unsigned long pos,
 		if( size > len )
 			size = len;
 
+		c = find_cache_entry(mtdblk, sect_start);
+
 		if (size == sect_size) {
 			/*
 			 * We are covering a whole sector.  Thus there is no
 			 * need to bother with the cache while it may still be
 			 * useful for other partial writes.
 			 */
-			ret = erase_write (mtd, pos, size, buf);
+			if (c) {
+				c->state = STATE_EMPTY;
+				c->valid = 0;
+			}
+			ret = erase_write (mtdblk, pos, size, buf);
 			if (ret)
 				return ret;
 		} else {
 			/* Partial sector: need to use the cache */
 
-			if (mtdblk->cache_state == STATE_DIRTY &&
-			    mtdblk->cache_offset != sect_start) {
-				ret = write_cached_data(mtdblk);
-				if (ret)
-					return ret;
+			if (!c) {
+				c = get_cache_entry(mtdblk, sect_start);
+				if (IS_ERR(c))
+					return PTR_ERR(c);
 			}
 
-			if (mtdblk->cache_state == STATE_EMPTY ||
-			    mtdblk->cache_offset != sect_start) {
-				/* fill the cache with the current sector */
-				mtdblk->cache_state = STATE_EMPTY;
-				ret = mtd->read(mtd, sect_start, sect_size,
-						&retlen, mtdblk->cache_data);
-				if (ret)
+			/*
+			 * Writes that carry on where the up to date part of
+			 * the sector ends just extend it, anything else needs
+			 * the whole sector.
+			 */
+			if (offset > c->valid) {
+				ret = fill_cache_entry(mtdblk, c);
+				if (ret) {
+					if (c->state == STATE_CLEAN)
+						c->state = STATE_EMPTY;
 					return ret;
-				if (retlen != sect_size)
-					return -EIO;
-
-				mtdblk->cache_offset = sect_start;
-				mtdblk->cache_size = sect_size;
-				mtdblk->cache_state = STATE_CLEAN;
+				}
 			}
 
 			/* write data to our local cache */
-			memcpy (mtdblk->cache_data + offset, buf, size);
-			mtdblk->cache_state = STATE_DIRTY;
+			memcpy (c->data + offset, buf, size);
+			if (offset + size > c->valid)
+				c->valid = offset + size;
+
+			if (c->state != STATE_DIRTY) {
+				c->state = STATE_DIRTY;
+				c->dirtied = jiffies;
+				if (writeback_delay)
+					schedule_delayed_work(&mtdblk->writeback_work,
+						msecs_to_jiffies(writeback_delay));
+			}
 		}
 
 		buf += size;
@@ -215,6 +424,7 @@ static int do_cached_read (struct mtdblk_dev *mtdblk, unsigned long pos,
 {
 	struct mtd_info *mtd = mtdblk->mbd.mtd;
 	unsigned int sect_size = mtdblk->cache_size;
+	struct mtdblk_cache *c;
 	size_t retlen;
 	int ret;
 
@@ -237,9 +447,14 @@ static int do_cached_read (struct mtdblk_dev *mtdblk, unsigned long pos,
 		 * contains what we want, otherwise we read the data directly
 		 * from flash.
 		 */
-		if (mtdblk->cache_state != STATE_EMPTY &&
-		    mtdblk->cache_offset == sect_start) {
-			memcpy (buf, mtdblk->cache_data + offset, size);
+		c = find_cache_entry(mtdblk, sect_start);
+		if (c && offset + size <= c->valid) {
+			memcpy (buf, c->data + offset, size);
+		} else if (c) {
+			ret = fill_cache_entry(mtdblk, c);
+			if (ret)
+				return ret;
+			memcpy (buf, c->data + offset, size);
 		} else {
 			ret = mtd->read(mtd, pos, size, &retlen, buf);
 			if (ret)
@@ -260,23 +475,24 @@ static int mtdblock_readsect(struct mtd_blktrans_dev *dev,
 			      unsigned long block, char *buf)
 {
 	struct mtdblk_dev *mtdblk = container_of(dev, struct mtdblk_dev, mbd);
-	return do_cached_read(mtdblk, block<<9, 512, buf);
+	int ret;
+
+	mutex_lock(&mtdblk->cache_mutex);
+	ret = do_cached_read(mtdblk, block<<9, 512, buf);
+	mutex_unlock(&mtdblk->cache_mutex);
+	return ret;
 }
 
 static int mtdblock_writesect(struct mtd_blktrans_dev *dev,
 			      unsigned long block, char *buf)
 {
 	struct mtdblk_dev *mtdblk = container_of(dev, struct mtdblk_dev, mbd);
-	if (unlikely(!mtdblk->cache_data && mtdblk->cache_size)) {
-		mtdblk->cache_data = vmalloc(mtdblk->mbd.mtd->erasesize);
-		if (!mtdblk->cache_data)
-			return -EINTR;
-		/* -EINTR is not really correct, but it is the best match
-		 * documented in man 2 write for all cases.  We could also
-		 * return -EAGAIN sometimes, but why bother?
-		 */
-	}
-	return do_cached_write(mtdblk, block<<9, 512, buf);
+	int ret;
+
+	mutex_lock(&mtdblk->cache_mutex);
+	ret = do_cached_write(mtdblk, block<<9, 512, buf);
+	mutex_unlock(&mtdblk->cache_mutex);
+	return ret;
 }
 
 static int mtdblock_open(struct mtd_blktrans_dev *mbd)
@@ -295,11 +511,11 @@ static int mtdblock_open(struct mtd_blktrans_dev *mbd)
 	/* OK, it's not open. Create cache info for it */
 	mtdblk->count = 1;
 	mutex_init(&mtdblk->cache_mutex);
-	mtdblk->cache_state = STATE_EMPTY;
-	if (!(mbd->mtd->flags & MTD_NO_ERASE) && mbd->mtd->erasesize) {
+	INIT_LIST_HEAD(&mtdblk->cache_lru);
+	INIT_DELAYED_WORK(&mtdblk->writeback_work, mtdblock_writeback_work);
+	mtdblk->cache_nr = 0;
+	if (!(mbd->mtd->flags & MTD_NO_ERASE) && mbd->mtd->erasesize)
 		mtdblk->cache_size = mbd->mtd->erasesize;
-		mtdblk->cache_data = NULL;
-	}
 
 	mutex_unlock(&mtdblks_lock);
 
@@ -322,9 +538,10 @@ static int mtdblock_release(struct mtd_blktrans_dev *mbd)
 
 	if (!--mtdblk->count) {
 		/* It was the last usage. Free the cache */
+		cancel_delayed_work_sync(&mtdblk->writeback_work);
 		if (mbd->mtd->sync)
 			mbd->mtd->sync(mbd->mtd);
-		vfree(mtdblk->cache_data);
+		free_cache(mtdblk);
 	}
 
 	mutex_unlock(&mtdblks_lock);
@@ -347,6 +564,38 @@ static int mtdblock_flush(struct mtd_blktrans_dev *dev)
 	return 0;
 }
 
+static ssize_t mtdblock_stat_show(struct device *dev,
+				  struct device_attribute *attr, char *buf)
+{
+	struct mtd_blktrans_dev *mbd = dev_to_disk(dev)->private_data;
+	struct mtdblk_dev *mtdblk = container_of(mbd, struct mtdblk_dev, mbd);
+	unsigned long val;
+
+	if (!strcmp(attr->attr.name, "cache_hits"))
+		val = mtdblk->hits;
+	else if (!strcmp(attr->attr.name, "cache_misses"))
+		val = mtdblk->misses;
+	else
+		val = mtdblk->erases;
+
+	return sprintf(buf, "%lu\n", val);
+}
+
+static DEVICE_ATTR(cache_hits, S_IRUGO, mtdblock_stat_show, NULL);
+static DEVICE_ATTR(cache_misses, S_IRUGO, mtdblock_stat_show, NULL);
+static DEVICE_ATTR(erases, S_IRUGO, mtdblock_stat_show, NULL);
+
+static struct attribute *mtdblock_attrs[] = {
+	&dev_attr_cache_hits.attr,
+	&dev_attr_cache_misses.attr,
+	&dev_attr_erases.attr,
+	NULL,
+};
+
+static struct attribute_group mtdblock_attr_group = {
+	.attrs = mtdblock_attrs,
+};
+
 static void mtdblock_add_mtd(struct mtd_blktrans_ops *tr, struct mtd_info *mtd)
 {
 	struct mtdblk_dev *dev = kzalloc(sizeof(*dev), GFP_KERNEL);
@@ -359,6 +608,7 @@ static void mtdblock_add_mtd(struct mtd_blktrans_ops *tr, struct mtd_info *mtd)
 
 	dev->mbd.size = mtd->size >> 9;
 	dev->mbd.tr = tr;
+	dev->mbd.disk_attributes = &mtdblock_attr_group;
 
 	if (!(mtd->flags & MTD_WRITEABLE))
 		dev->mbd.readonly = 1;
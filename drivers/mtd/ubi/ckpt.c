@@ -0,0 +1,525 @@
+/*
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See
+ * the GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
+ */
+
+/*
+ * UBI checkpoints.
+ *
+ * Attaching an UBI device normally means reading the EC and VID headers of all
+ * physical eraseblocks, which takes long on large flashes. A checkpoint is a
+ * snapshot of what scanning would find: for each PEB it records whether it is
+ * free or which LEB it contains, along with the sequence number and the erase
+ * counter. The checkpoint is written to the checkpoint volume
+ * (%UBI_CKPT_VOLUME_ID) when the device is attached, whenever the PEBs which
+ * may be used between two checkpoints run out, and when the device is
+ * detached. The next time the device is attached, only the PEBs the checkpoint
+ * does not describe have to be scanned (see 'scan_ckpt()' in scan.c).
+ *
+ * The checkpoint has to stay true until the next one is written. So the WL
+ * sub-system keeps the free PEBs the checkpoint describes away from users, and
+ * defers the erasure of the used PEBs it describes (see wl.c). Only a pool of
+ * free PEBs, which the checkpoint marks for scanning, may be written to. When
+ * the pool is exhausted, or when somebody needs the deferred erasures to
+ * happen, a new checkpoint is written.
+ *
+ * LEB 0 of the checkpoint contains the header and is written last. It is
+ * always stored in one of the first %UBI_CKPT_MAX_START PEBs, so it is found
+ * by reading just their VID headers. Before a new checkpoint is written, LEB 0
+ * of the old one is erased synchronously, so the flash never contains an out
+ * of date checkpoint. The scanning code erases LEB 0 of the checkpoints it
+ * finds as well, so a checkpoint is used only once.
+ *
+ * Note, a LEB which was un-mapped after the checkpoint was taken keeps its
+ * contents until the next checkpoint is written, just like after an unclean
+ * reboot. 'ubi_wl_flush()' writes a new checkpoint if there are deferred
+ * erasures, so 'ubi_leb_erase()' is not affected.
+ */
+
+#include <linux/crc32.h>
+#include <linux/err.h>
+#include <linux/bitmap.h>
+#include "ubi.h"
+
+/* Limits for the number of PEBs which may be used between two checkpoints */
+#define CKPT_MIN_POOL 8
+#define CKPT_MAX_POOL 256
+
+/**
+ * ckpt_check_leb - check the VID header of a checkpoint LEB.
+ * @ubi: UBI device description object
+ * @vid_hdr: VID header buffer to use
+ * @pnum: the physical eraseblock to check
+ * @lnum: the checkpoint LEB @pnum has to contain
+ *
+ * This function returns the sequence number of the LEB in case of success and
+ * %-EINVAL if @pnum does not contain the expected LEB.
+ */
+static long long ckpt_check_leb(struct ubi_device *ubi,
+				struct ubi_vid_hdr *vid_hdr, int pnum, int lnum)
+{
+	int err;
+
+	err = ubi_io_read_vid_hdr(ubi, pnum, vid_hdr, 0);
+	if (err && err != UBI_IO_BITFLIPS)
+		return -EINVAL;
+
+	if (be32_to_cpu(vid_hdr->vol_id) != UBI_CKPT_VOLUME_ID ||
+	    be32_to_cpu(vid_hdr->lnum) != lnum)
+		return -EINVAL;
+
+	return be64_to_cpu(vid_hdr->sqnum);
+}
+
+/**
+ * ckpt_check_hdr - check the checkpoint header.
+ * @ubi: UBI device description object
+ * @hdr: the checkpoint header to check
+ *
+ * This function returns zero if @hdr is a valid header of a checkpoint of this
+ * device and %-EINVAL if not.
+ */
+static int ckpt_check_hdr(const struct ubi_device *ubi,
+			  const struct ubi_ckpt_hdr *hdr)
+{
+	int size, leb_count, i;
+	uint32_t crc;
+
+	if (be32_to_cpu(hdr->magic) != UBI_CKPT_HDR_MAGIC) {
+		dbg_bld("bad checkpoint magic %#08x", be32_to_cpu(hdr->magic));
+		return -EINVAL;
+	}
+
+	crc = crc32(UBI_CRC32_INIT, hdr, UBI_CKPT_HDR_SIZE_CRC);
+	if (be32_to_cpu(hdr->hdr_crc) != crc) {
+		dbg_bld("bad checkpoint header CRC %#08x, must be %#08x",
+			crc, be32_to_cpu(hdr->hdr_crc));
+		return -EINVAL;
+	}
+
+	if (hdr->version != UBI_CKPT_VERSION) {
+		dbg_bld("unsupported checkpoint version %d", hdr->version);
+		return -EINVAL;
+	}
+
+	size = UBI_CKPT_HDR_SIZE +
+	       ubi->peb_count * sizeof(struct ubi_ckpt_peb);
+	leb_count = DIV_ROUND_UP(size, ubi->leb_size);
+	if (be32_to_cpu(hdr->peb_count) != ubi->peb_count ||
+	    be32_to_cpu(hdr->size) != size ||
+	    be32_to_cpu(hdr->leb_count) != leb_count ||
+	    leb_count > UBI_CKPT_MAX_LEBS) {
+		dbg_bld("checkpoint of another device");
+		return -EINVAL;
+	}
+
+	for (i = 0; i < leb_count; i++)
+		if (be32_to_cpu(hdr->pebs[i]) >= ubi->peb_count) {
+			dbg_bld("bad checkpoint PEB %d",
+				be32_to_cpu(hdr->pebs[i]));
+			return -EINVAL;
+		}
+
+	return 0;
+}
+
+/**
+ * ubi_ckpt_read - find and read the checkpoint.
+ * @ubi: UBI device description object
+ *
+ * This function looks for LEB 0 of the checkpoint in the first
+ * %UBI_CKPT_MAX_START physical eraseblocks, and reads and checks the whole
+ * checkpoint. Returns a vmalloc'ed buffer containing the checkpoint header and
+ * the PEB records, or %NULL if there is no valid checkpoint.
+ */
+struct ubi_ckpt_hdr *ubi_ckpt_read(struct ubi_device *ubi)
+{
+	int err, pnum, i, n, size, anchor = -1;
+	unsigned long long max_sqnum = 0;
+	long long sqnum;
+	struct ubi_vid_hdr *vid_hdr;
+	struct ubi_ckpt_hdr *hdr;
+	void *buf = NULL;
+	uint32_t crc;
+
+	vid_hdr = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+	if (!vid_hdr)
+		return NULL;
+
+	hdr = kmalloc(UBI_CKPT_HDR_SIZE, GFP_KERNEL);
+	if (!hdr)
+		goto out_free;
+
+	for (pnum = 0; pnum < min(ubi->peb_count, UBI_CKPT_MAX_START); pnum++) {
+		if (ubi_io_is_bad(ubi, pnum))
+			continue;
+
+		sqnum = ckpt_check_leb(ubi, vid_hdr, pnum, 0);
+		if (sqnum < 0)
+			continue;
+
+		if (anchor == -1 || sqnum > max_sqnum) {
+			anchor = pnum;
+			max_sqnum = sqnum;
+		}
+	}
+
+	if (anchor == -1) {
+		dbg_bld("no checkpoint found");
+		goto out_free;
+	}
+
+	dbg_bld("checkpoint found in PEB %d, sqnum %llu", anchor, max_sqnum);
+
+	err = ubi_io_read_data(ubi, hdr, anchor, 0, UBI_CKPT_HDR_SIZE);
+	if (err && err != UBI_IO_BITFLIPS)
+		goto out_bad;
+
+	if (ckpt_check_hdr(ubi, hdr) || be32_to_cpu(hdr->pebs[0]) != anchor)
+		goto out_bad;
+
+	size = be32_to_cpu(hdr->size);
+	n = be32_to_cpu(hdr->leb_count);
+	buf = vmalloc(n * ubi->leb_size);
+	if (!buf)
+		goto out_free;
+
+	for (i = 0; i < n; i++) {
+		int len = min(size - i * ubi->leb_size, ubi->leb_size);
+
+		pnum = be32_to_cpu(hdr->pebs[i]);
+		if (i > 0) {
+			/* The other LEBs are written before LEB 0 */
+			sqnum = ckpt_check_leb(ubi, vid_hdr, pnum, i);
+			if (sqnum < 0 || sqnum >= max_sqnum) {
+				dbg_bld("bad checkpoint LEB %d in PEB %d",
+					i, pnum);
+				goto out_bad;
+			}
+		}
+
+		err = ubi_io_read_data(ubi, buf + i * ubi->leb_size, pnum, 0,
+				       len);
+		if (err && err != UBI_IO_BITFLIPS)
+			goto out_bad;
+	}
+
+	crc = crc32(UBI_CRC32_INIT, buf + UBI_CKPT_HDR_SIZE,
+		    size - UBI_CKPT_HDR_SIZE);
+	if (be32_to_cpu(hdr->data_crc) != crc) {
+		dbg_bld("bad checkpoint data CRC %#08x, must be %#08x",
+			crc, be32_to_cpu(hdr->data_crc));
+		goto out_bad;
+	}
+
+	kfree(hdr);
+	ubi_free_vid_hdr(ubi, vid_hdr);
+	return buf;
+
+out_bad:
+	ubi_warn("checkpoint in PEB %d is corrupted", anchor);
+out_free:
+	vfree(buf);
+	kfree(hdr);
+	ubi_free_vid_hdr(ubi, vid_hdr);
+	return NULL;
+}
+
+/**
+ * ckpt_invalidate - get rid of the checkpoint on the flash.
+ * @ubi: UBI device description object
+ *
+ * This function erases LEB 0 of the current checkpoint, lifts the
+ * restrictions it imposes on the WL sub-system, and returns the other
+ * checkpoint PEBs. Returns zero in case of success and a negative error code
+ * in case of failure.
+ */
+static int ckpt_invalidate(struct ubi_device *ubi)
+{
+	int err, i;
+
+	if (ubi->ckpt_pebs[0] < 0)
+		return 0;
+
+	err = ubi_wl_erase_ckpt_anchor(ubi, ubi->ckpt_pebs[0]);
+	if (err)
+		return err;
+	ubi->ckpt_pebs[0] = -1;
+
+	ubi_wl_ckpt_release(ubi);
+
+	for (i = 1; i < ubi->ckpt_leb_count; i++) {
+		err = ubi_wl_put_ckpt_peb(ubi, ubi->ckpt_pebs[i]);
+		if (err)
+			return err;
+		ubi->ckpt_pebs[i] = -1;
+	}
+
+	return 0;
+}
+
+/**
+ * ckpt_fill - record the used physical eraseblocks.
+ * @ubi: UBI device description object
+ * @recs: the PEB records to fill
+ *
+ * This function walks the EBA tables and sets the volume ID and LEB number of
+ * the records of mapped PEBs. All the other PEBs are marked for scanning.
+ */
+static void ckpt_fill(struct ubi_device *ubi, struct ubi_ckpt_peb *recs)
+{
+	int i, lnum, pnum;
+	struct ubi_volume *vol;
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		recs[pnum].sqnum = 0;
+		recs[pnum].vol_id = cpu_to_be32(UBI_CKPT_PEB_SCAN);
+		recs[pnum].lnum = 0;
+		recs[pnum].ec = 0;
+	}
+
+	spin_lock(&ubi->volumes_lock);
+	for (i = 0; i < ubi->vtbl_slots + UBI_INT_VOL_COUNT; i++) {
+		vol = ubi->volumes[i];
+		if (!vol)
+			continue;
+
+		for (lnum = 0; lnum < vol->reserved_pebs; lnum++) {
+			pnum = vol->eba_tbl[lnum];
+			if (pnum < 0)
+				continue;
+
+			recs[pnum].vol_id = cpu_to_be32(vol->vol_id);
+			recs[pnum].lnum = cpu_to_be32(lnum);
+		}
+	}
+	spin_unlock(&ubi->volumes_lock);
+}
+
+/**
+ * ckpt_write_leb - write a checkpoint LEB.
+ * @ubi: UBI device description object
+ * @vid_hdr: VID header to use
+ * @lnum: the checkpoint LEB to write
+ * @pnum: the physical eraseblock to write it to
+ *
+ * This function returns zero in case of success and a negative error code in
+ * case of failure.
+ */
+static int ckpt_write_leb(struct ubi_device *ubi, struct ubi_vid_hdr *vid_hdr,
+			  int lnum, int pnum)
+{
+	int err, offs = lnum * ubi->leb_size;
+	int len = min(ubi->ckpt_size - offs, ubi->leb_size);
+
+	dbg_gen("write checkpoint LEB %d to PEB %d", lnum, pnum);
+
+	vid_hdr->lnum = cpu_to_be32(lnum);
+	vid_hdr->sqnum = cpu_to_be64(ubi_next_sqnum(ubi));
+	err = ubi_io_write_vid_hdr(ubi, pnum, vid_hdr);
+	if (err)
+		return err;
+
+	return ubi_io_write_data(ubi, ubi->ckpt_buf + offs, pnum, 0,
+				 ALIGN(len, ubi->min_io_size));
+}
+
+/**
+ * ubi_ckpt_write - write a new checkpoint.
+ * @ubi: UBI device description object
+ * @final: non-zero if nothing is going to be written to the device any more
+ *
+ * This function invalidates the current checkpoint and writes a new one. If
+ * @final is not set, a pool of free PEBs is left for use until the next
+ * checkpoint. Returns zero in case of success and a negative error code in
+ * case of failure, in which case there is no checkpoint on the flash and the
+ * WL sub-system is not restricted any more.
+ */
+int ubi_ckpt_write(struct ubi_device *ubi, int final)
+{
+	int err, i, n = ubi->ckpt_leb_count, pebs[UBI_CKPT_MAX_LEBS];
+	struct ubi_ckpt_hdr *hdr = ubi->ckpt_buf;
+	struct ubi_ckpt_peb *recs = ubi->ckpt_buf + UBI_CKPT_HDR_SIZE;
+	struct ubi_vid_hdr *vid_hdr;
+	unsigned long long sqnum;
+	uint32_t crc;
+
+	if (!n)
+		return 0;
+	if (ubi->ro_mode)
+		return -EROFS;
+
+	vid_hdr = ubi_zalloc_vid_hdr(ubi, GFP_NOFS);
+	if (!vid_hdr)
+		return -ENOMEM;
+
+	mutex_lock(&ubi->ckpt_mutex);
+	err = ckpt_invalidate(ubi);
+	if (err)
+		goto out_unlock;
+
+	for (i = 0; i < n; i++) {
+		pebs[i] = ubi_wl_get_ckpt_peb(ubi, i == 0);
+		if (pebs[i] < 0) {
+			err = pebs[i];
+			goto out_put;
+		}
+	}
+
+	ubi_wl_ckpt_begin(ubi);
+	ckpt_fill(ubi, recs);
+	ubi_wl_ckpt_snapshot(ubi, recs, final ? 0 : ubi->ckpt_pool_size);
+
+	spin_lock(&ubi->ltree_lock);
+	sqnum = ubi->global_sqnum;
+	spin_unlock(&ubi->ltree_lock);
+
+	memset(hdr, 0, UBI_CKPT_HDR_SIZE);
+	hdr->magic = cpu_to_be32(UBI_CKPT_HDR_MAGIC);
+	hdr->version = UBI_CKPT_VERSION;
+	hdr->image_seq = cpu_to_be32(ubi->image_seq);
+	hdr->peb_count = cpu_to_be32(ubi->peb_count);
+	hdr->leb_count = cpu_to_be32(n);
+	hdr->size = cpu_to_be32(ubi->ckpt_size);
+	hdr->sqnum = cpu_to_be64(sqnum);
+	for (i = 0; i < n; i++)
+		hdr->pebs[i] = cpu_to_be32(pebs[i]);
+	crc = crc32(UBI_CRC32_INIT, recs, ubi->ckpt_size - UBI_CKPT_HDR_SIZE);
+	hdr->data_crc = cpu_to_be32(crc);
+	crc = crc32(UBI_CRC32_INIT, hdr, UBI_CKPT_HDR_SIZE_CRC);
+	hdr->hdr_crc = cpu_to_be32(crc);
+
+	vid_hdr->vol_type = UBI_CKPT_VOLUME_TYPE;
+	vid_hdr->vol_id = cpu_to_be32(UBI_CKPT_VOLUME_ID);
+	vid_hdr->compat = UBI_CKPT_VOLUME_COMPAT;
+
+	/* The checkpoint becomes valid when LEB 0 is written, so do it last */
+	for (i = n - 1; i >= 0; i--) {
+		err = ckpt_write_leb(ubi, vid_hdr, i, pebs[i]);
+		if (err)
+			goto out_release;
+	}
+
+	ubi_wl_ckpt_commit(ubi);
+	memcpy(ubi->ckpt_pebs, pebs, n * sizeof(int));
+	mutex_unlock(&ubi->ckpt_mutex);
+	ubi_free_vid_hdr(ubi, vid_hdr);
+
+	dbg_gen("checkpoint written, LEB 0 in PEB %d", pebs[0]);
+	return 0;
+
+out_release:
+	ubi_err("cannot write checkpoint LEB %d to PEB %d, error %d",
+		i, pebs[i], err);
+	if (i == 0) {
+		/* LEB 0 may have made it to the flash */
+		if (ubi_wl_erase_ckpt_anchor(ubi, pebs[0])) {
+			/* R/O mode, keep everything as it is */
+			memcpy(ubi->ckpt_pebs, pebs, n * sizeof(int));
+			goto out_unlock;
+		}
+		pebs[0] = -1;
+	}
+	ubi_wl_ckpt_release(ubi);
+	i = n;
+out_put:
+	while (i--)
+		if (pebs[i] >= 0)
+			ubi_wl_put_ckpt_peb(ubi, pebs[i]);
+out_unlock:
+	mutex_unlock(&ubi->ckpt_mutex);
+	ubi_free_vid_hdr(ubi, vid_hdr);
+	ubi_err("cannot write checkpoint, error %d", err);
+	return err;
+}
+
+/**
+ * ubi_ckpt_init - initialize checkpoints for an UBI device.
+ * @ubi: UBI device description object
+ *
+ * This function reserves PEBs for the checkpoint and writes the first one.
+ * The device is attached without checkpoints if it is too small or too large
+ * for them, if there are not enough available PEBs, or if the checkpoint
+ * cannot be written. Returns zero in case of success and a negative error
+ * code in case of failure.
+ */
+int ubi_ckpt_init(struct ubi_device *ubi)
+{
+	int i, n, size;
+
+	size = UBI_CKPT_HDR_SIZE + ubi->peb_count * sizeof(struct ubi_ckpt_peb);
+	n = DIV_ROUND_UP(size, ubi->leb_size);
+	if (n > UBI_CKPT_MAX_LEBS || ubi->peb_count < 2 * UBI_CKPT_MAX_START) {
+		ubi_warn("checkpoints are not supported for %d PEBs of %d bytes",
+			 ubi->peb_count, ubi->peb_size);
+		return 0;
+	}
+
+	spin_lock(&ubi->volumes_lock);
+	if (ubi->avail_pebs < n) {
+		spin_unlock(&ubi->volumes_lock);
+		ubi_warn("no PEBs for checkpoints (%d, need %d)",
+			 ubi->avail_pebs, n);
+		return 0;
+	}
+	ubi->avail_pebs -= n;
+	ubi->rsvd_pebs += n;
+	spin_unlock(&ubi->volumes_lock);
+
+	ubi->ckpt_buf = vmalloc(n * ubi->leb_size);
+	ubi->ckpt_erasable = kzalloc(BITS_TO_LONGS(ubi->peb_count) *
+				     sizeof(long), GFP_KERNEL);
+	ubi->ckpt_next = kzalloc(BITS_TO_LONGS(ubi->peb_count) *
+				 sizeof(long), GFP_KERNEL);
+	if (!ubi->ckpt_buf || !ubi->ckpt_erasable || !ubi->ckpt_next) {
+		ubi_ckpt_close(ubi);
+		spin_lock(&ubi->volumes_lock);
+		ubi->avail_pebs += n;
+		ubi->rsvd_pebs -= n;
+		spin_unlock(&ubi->volumes_lock);
+		return -ENOMEM;
+	}
+
+	/* The end of the last LEB is written as padding */
+	memset(ubi->ckpt_buf, 0xFF, n * ubi->leb_size);
+
+	mutex_init(&ubi->ckpt_mutex);
+	for (i = 0; i < UBI_CKPT_MAX_LEBS; i++)
+		ubi->ckpt_pebs[i] = -1;
+	ubi->ckpt_size = size;
+	ubi->ckpt_pool_size = clamp(ubi->peb_count / 20, CKPT_MIN_POOL,
+				    CKPT_MAX_POOL);
+	ubi->ckpt_leb_count = n;
+
+	if (!ubi->ro_mode)
+		ubi_ckpt_write(ubi, 0);
+
+	return 0;
+}
+
+/**
+ * ubi_ckpt_close - close checkpoints for an UBI device.
+ * @ubi: UBI device description object
+ *
+ * Note, the checkpoint PEBs are freed by the WL sub-system.
+ */
+void ubi_ckpt_close(struct ubi_device *ubi)
+{
+	vfree(ubi->ckpt_buf);
+	kfree(ubi->ckpt_erasable);
+	kfree(ubi->ckpt_next);
+	ubi->ckpt_buf = NULL;
+	ubi->ckpt_erasable = NULL;
+	ubi->ckpt_next = NULL;
+}
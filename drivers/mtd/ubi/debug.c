@@ -26,6 +26,8 @@
 
 #ifdef CONFIG_MTD_UBI_DEBUG
 
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
 #include "ubi.h"
 
 /**
@@ -228,4 +230,125 @@ out:
 	return;
 }
 
+static struct dentry *dfs_rootdir;
+
+/**
+ * ubi_dbg_alloc_done - account a PEB allocation in the latency histogram.
+ * @ubi: UBI device description object
+ * @start: when the allocation started
+ */
+void ubi_dbg_alloc_done(struct ubi_device *ubi, ktime_t start)
+{
+	s64 us = ktime_us_delta(ktime_get(), start);
+	int i = 0;
+
+	while (i < UBI_DBG_ALLOC_BUCKETS - 1 && us >= (16 << i))
+		i += 1;
+
+	spin_lock(&ubi->wl_lock);
+	ubi->dbg_alloc_hist[i] += 1;
+	spin_unlock(&ubi->wl_lock);
+}
+
+static int alloc_latency_show(struct seq_file *m, void *v)
+{
+	struct ubi_device *ubi = m->private;
+	unsigned long hist[UBI_DBG_ALLOC_BUCKETS];
+	int i;
+
+	spin_lock(&ubi->wl_lock);
+	memcpy(hist, ubi->dbg_alloc_hist, sizeof(hist));
+	spin_unlock(&ubi->wl_lock);
+
+	seq_printf(m, "%10s  %s\n", "usec", "allocations");
+	for (i = 0; i < UBI_DBG_ALLOC_BUCKETS - 1; i++)
+		seq_printf(m, "< %8d  %lu\n", 16 << i, hist[i]);
+	seq_printf(m, ">=%8d  %lu\n", 16 << (i - 1), hist[i]);
+	return 0;
+}
+
+static int alloc_latency_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, alloc_latency_show, inode->i_private);
+}
+
+static const struct file_operations alloc_latency_fops = {
+	.owner   = THIS_MODULE,
+	.open    = alloc_latency_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+/**
+ * ubi_debugfs_init - create the UBI debugfs directory.
+ *
+ * Returns zero in case of success and a negative error code in case of
+ * failure.
+ */
+int ubi_debugfs_init(void)
+{
+	dfs_rootdir = debugfs_create_dir(UBI_NAME_STR, NULL);
+	if (IS_ERR_OR_NULL(dfs_rootdir)) {
+		int err = dfs_rootdir ? PTR_ERR(dfs_rootdir) : -ENOMEM;
+
+		ubi_err("cannot create \"%s\" debugfs directory, error %d",
+			UBI_NAME_STR, err);
+		return err;
+	}
+
+	return 0;
+}
+
+/**
+ * ubi_debugfs_exit - remove the UBI debugfs directory.
+ */
+void ubi_debugfs_exit(void)
+{
+	debugfs_remove(dfs_rootdir);
+}
+
+/**
+ * ubi_debugfs_init_dev - create the debugfs files of an UBI device.
+ * @ubi: UBI device description object
+ *
+ * This function creates the "ubiX" debugfs directory with the
+ * "alloc_latency" file, which shows the histogram of the time
+ * 'ubi_wl_get_peb()' took. Returns zero in case of success and a negative
+ * error code in case of failure.
+ */
+int ubi_debugfs_init_dev(struct ubi_device *ubi)
+{
+	struct dentry *dent;
+	char name[sizeof(UBI_NAME_STR) + 5];
+
+	sprintf(name, UBI_NAME_STR "%d", ubi->ubi_num);
+	dent = debugfs_create_dir(name, dfs_rootdir);
+	if (IS_ERR_OR_NULL(dent))
+		goto out;
+	ubi->dbg_dfs_dir = dent;
+
+	dent = debugfs_create_file("alloc_latency", S_IRUSR, ubi->dbg_dfs_dir,
+				   ubi, &alloc_latency_fops);
+	if (IS_ERR_OR_NULL(dent))
+		goto out_remove;
+
+	return 0;
+
+out_remove:
+	debugfs_remove_recursive(ubi->dbg_dfs_dir);
+out:
+	ubi_err("cannot create debugfs files for ubi%d", ubi->ubi_num);
+	return dent ? PTR_ERR(dent) : -ENOMEM;
+}
+
+/**
+ * ubi_debugfs_exit_dev - remove the debugfs files of an UBI device.
+ * @ubi: UBI device description object
+ */
+void ubi_debugfs_exit_dev(struct ubi_device *ubi)
+{
+	debugfs_remove_recursive(ubi->dbg_dfs_dir);
+}
+
 #endif /* CONFIG_MTD_UBI_DEBUG */
@@ -23,6 +23,7 @@
 
 #ifdef CONFIG_MTD_UBI_DEBUG
 #include <linux/random.h>
+#include <linux/ktime.h>
 
 #define dbg_err(fmt, ...) ubi_err(fmt, ##__VA_ARGS__)
 
@@ -60,6 +61,20 @@ void ubi_dbg_dump_flash(struct ubi_device *ubi, int pnum, int offset, int len);
 #define ubi_dbg_print_hex_dump(l, ps, pt, r, g, b, len, a)  \
 		print_hex_dump(l, ps, pt, r, g, b, len, a)
 
+/*
+ * Number of buckets of the PEB allocation latency histogram: bucket 0 counts
+ * allocations which took less than 16 microseconds, bucket @i those which
+ * took less than 16 << @i microseconds, and the last one all slower ones.
+ */
+#define UBI_DBG_ALLOC_BUCKETS 18
+
+int ubi_debugfs_init(void);
+void ubi_debugfs_exit(void);
+int ubi_debugfs_init_dev(struct ubi_device *ubi);
+void ubi_debugfs_exit_dev(struct ubi_device *ubi);
+void ubi_dbg_alloc_done(struct ubi_device *ubi, ktime_t start);
+#define ubi_dbg_alloc_start() ktime_get()
+
 #ifdef CONFIG_MTD_UBI_DEBUG_MSG
 /* General debugging messages */
 #define dbg_gen(fmt, ...) dbg_msg(fmt, ##__VA_ARGS__)
@@ -177,6 +192,13 @@ static inline int ubi_dbg_is_erase_failure(void)
 #define ubi_dbg_dump_flash(ubi, pnum, offset, len) ({})
 #define ubi_dbg_print_hex_dump(l, ps, pt, r, g, b, len, a)  ({})
 
+#define ubi_debugfs_init()               0
+#define ubi_debugfs_exit()               ({})
+#define ubi_debugfs_init_dev(ubi)        0
+#define ubi_debugfs_exit_dev(ubi)        ({})
+#define ubi_dbg_alloc_start()            ktime_set(0, 0)
+#define ubi_dbg_alloc_done(ubi, start)   ((void)(start))
+
 #define UBI_IO_DEBUG               0
 #define DBG_DISABLE_BGT            0
 #define ubi_dbg_is_bitflip()       0
@@ -72,6 +72,7 @@
 #include <linux/crc32.h>
 #include <linux/math64.h>
 #include <linux/random.h>
+#include <linux/kthread.h>
 #include "ubi.h"
 
 #ifdef CONFIG_MTD_UBI_DEBUG_PARANOID
@@ -812,25 +813,113 @@ out_unlock:
 	return err;
 }
 
+#ifdef CONFIG_MTD_UBI_CHECKPOINT
 /**
- * process_eb - read, check UBI headers, and add them to scanning information.
+ * process_ckpt_eb - handle a physical eraseblock of the checkpoint volume.
  * @ubi: UBI device description object
  * @si: scanning information
  * @pnum: the physical eraseblock number
+ * @ec: erase counter of the physical eraseblock
+ * @ec_err: non-zero if the EC header of @pnum is corrupted
+ * @vid_hdr: the VID header of @pnum
+ *
+ * A checkpoint is used only once: LEB 0, which makes it valid, is erased right
+ * away, so that a checkpoint which was not rewritten before an unclean reboot
+ * is not used again. In R/O mode nothing on the flash changes, so the
+ * checkpoint stays valid and may be kept. The other LEBs of the checkpoint are
+ * just scheduled for erasure. Returns zero in case of success and a negative
+ * error code in case of failure.
+ */
+static int process_ckpt_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
+			   int pnum, int ec, int ec_err,
+			   const struct ubi_vid_hdr *vid_hdr)
+{
+	unsigned long long sqnum = be64_to_cpu(vid_hdr->sqnum);
+	int err;
+
+	dbg_bld("checkpoint LEB %d in PEB %d", be32_to_cpu(vid_hdr->lnum), pnum);
+
+	if (si->max_sqnum < sqnum)
+		si->max_sqnum = sqnum;
+
+	if (be32_to_cpu(vid_hdr->lnum) != 0 || ubi->ro_mode)
+		return add_to_list(si, pnum, ec, 1, &si->erase);
+
+	if (ec_err)
+		ec = 0;
+	err = ubi_scan_erase_peb(ubi, si, pnum, ec + 1);
+	if (err)
+		return err;
+
+	return add_to_list(si, pnum, ec + 1, 0, &si->free);
+}
+#endif
+
+/**
+ * struct scan_peb - headers of a physical eraseblock.
+ * @pnum: the physical eraseblock number
+ * @bad: what 'ubi_io_is_bad()' returned
+ * @ec_err: what 'ubi_io_read_ec_hdr()' returned
+ * @vid_err: what 'ubi_io_read_vid_hdr()' returned
+ * @ech: the EC header
+ * @vidh: the VID header
+ * @ready: non-zero if the headers have been read (parallel scanning only)
+ */
+struct scan_peb {
+	int pnum;
+	int bad;
+	int ec_err;
+	int vid_err;
+	struct ubi_ec_hdr *ech;
+	struct ubi_vid_hdr *vidh;
+	int ready;
+};
+
+/**
+ * read_peb - read the headers of a physical eraseblock.
+ * @ubi: UBI device description object
+ * @sp: the physical eraseblock to read (@sp->pnum) and where to store the
+ *      headers
+ *
+ * The I/O sub-system checks the headers while reading them. This function
+ * does not touch the scanning information, so it may run in several threads
+ * at once.
+ */
+static void read_peb(struct ubi_device *ubi, struct scan_peb *sp)
+{
+	sp->ec_err = sp->vid_err = 0;
+
+	sp->bad = ubi_io_is_bad(ubi, sp->pnum);
+	if (sp->bad)
+		return;
+
+	sp->ec_err = ubi_io_read_ec_hdr(ubi, sp->pnum, sp->ech, 0);
+	if (sp->ec_err < 0 || sp->ec_err == UBI_IO_FF ||
+	    sp->ec_err == UBI_IO_FF_BITFLIPS)
+		return;
+
+	sp->vid_err = ubi_io_read_vid_hdr(ubi, sp->pnum, sp->vidh, 0);
+}
+
+/**
+ * add_peb - check UBI headers and add them to scanning information.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ * @sp: the headers of the physical eraseblock, see 'read_peb()'
  *
  * This function returns a zero if the physical eraseblock was successfully
  * handled and a negative error code in case of failure.
  */
-static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
-		      int pnum)
+static int add_peb(struct ubi_device *ubi, struct ubi_scan_info *si,
+		   const struct scan_peb *sp)
 {
 	long long uninitialized_var(ec);
-	int err, bitflips = 0, vol_id, ec_err = 0;
+	int err, bitflips = 0, vol_id, ec_err = 0, pnum = sp->pnum;
 
 	dbg_bld("scan PEB %d", pnum);
 
 	/* Skip bad physical eraseblocks */
-	err = ubi_io_is_bad(ubi, pnum);
+	err = sp->bad;
 	if (err < 0)
 		return err;
 	else if (err) {
@@ -843,7 +932,7 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 		return 0;
 	}
 
-	err = ubi_io_read_ec_hdr(ubi, pnum, ech, 0);
+	err = sp->ec_err;
 	if (err < 0)
 		return err;
 	switch (err) {
@@ -880,13 +969,13 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 		int image_seq;
 
 		/* Make sure UBI version is OK */
-		if (ech->version != UBI_VERSION) {
+		if (sp->ech->version != UBI_VERSION) {
 			ubi_err("this UBI version is %d, image version is %d",
-				UBI_VERSION, (int)ech->version);
+				UBI_VERSION, (int)sp->ech->version);
 			return -EINVAL;
 		}
 
-		ec = be64_to_cpu(ech->ec);
+		ec = be64_to_cpu(sp->ech->ec);
 		if (ec > UBI_MAX_ERASECOUNTER) {
 			/*
 			 * Erase counter overflow. The EC headers have 64 bits
@@ -897,7 +986,7 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 			 */
 			ubi_err("erase counter overflow, max is %d",
 				UBI_MAX_ERASECOUNTER);
-			ubi_dbg_dump_ec_hdr(ech);
+			ubi_dbg_dump_ec_hdr(sp->ech);
 			return -EINVAL;
 		}
 
@@ -912,21 +1001,21 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 		 * sequence number, while other PEBs have non-zero sequence
 		 * number.
 		 */
-		image_seq = be32_to_cpu(ech->image_seq);
+		image_seq = be32_to_cpu(sp->ech->image_seq);
 		if (!ubi->image_seq && image_seq)
 			ubi->image_seq = image_seq;
 		if (ubi->image_seq && image_seq &&
 		    ubi->image_seq != image_seq) {
 			ubi_err("bad image sequence number %d in PEB %d, "
 				"expected %d", image_seq, pnum, ubi->image_seq);
-			ubi_dbg_dump_ec_hdr(ech);
+			ubi_dbg_dump_ec_hdr(sp->ech);
 			return -EINVAL;
 		}
 	}
 
 	/* OK, we've done with the EC header, let's look at the VID header */
 
-	err = ubi_io_read_vid_hdr(ubi, pnum, vidh, 0);
+	err = sp->vid_err;
 	if (err < 0)
 		return err;
 	switch (err) {
@@ -964,7 +1053,7 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 			 * The EC was OK, but the VID header is corrupted. We
 			 * have to check what is in the data area.
 			 */
-			err = check_corruption(ubi, vidh, pnum);
+			err = check_corruption(ubi, sp->vidh, pnum);
 
 		if (err < 0)
 			return err;
@@ -996,12 +1085,20 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 		return -EINVAL;
 	}
 
-	vol_id = be32_to_cpu(vidh->vol_id);
+	vol_id = be32_to_cpu(sp->vidh->vol_id);
+#ifdef CONFIG_MTD_UBI_CHECKPOINT
+	if (vol_id == UBI_CKPT_VOLUME_ID) {
+		err = process_ckpt_eb(ubi, si, pnum, ec, ec_err, sp->vidh);
+		if (err)
+			return err;
+		goto adjust_mean_ec;
+	}
+#endif
 	if (vol_id > UBI_MAX_VOLUMES && vol_id != UBI_LAYOUT_VOLUME_ID) {
-		int lnum = be32_to_cpu(vidh->lnum);
+		int lnum = be32_to_cpu(sp->vidh->lnum);
 
 		/* Unsupported internal volume */
-		switch (vidh->compat) {
+		switch (sp->vidh->compat) {
 		case UBI_COMPAT_DELETE:
 			ubi_msg("\"delete\" compatible internal volume %d:%d"
 				" found, will remove it", vol_id, lnum);
@@ -1035,7 +1132,7 @@ static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
 	if (ec_err)
 		ubi_warn("valid VID header but corrupted EC header at PEB %d",
 			 pnum);
-	err = ubi_scan_add_used(ubi, si, pnum, ec, vidh, bitflips);
+	err = ubi_scan_add_used(ubi, si, pnum, ec, sp->vidh, bitflips);
 	if (err)
 		return err;
 
@@ -1052,6 +1149,241 @@ adjust_mean_ec:
 	return 0;
 }
 
+/**
+ * process_eb - read, check UBI headers, and add them to scanning information.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ * @pnum: the physical eraseblock number
+ *
+ * This function returns a zero if the physical eraseblock was successfully
+ * handled and a negative error code in case of failure.
+ */
+static int process_eb(struct ubi_device *ubi, struct ubi_scan_info *si,
+		      int pnum)
+{
+	struct scan_peb sp = { .pnum = pnum, .ech = ech, .vidh = vidh };
+
+	read_peb(ubi, &sp);
+	return add_peb(ubi, si, &sp);
+}
+
+/* How many physical eraseblocks parallel scanning may read ahead */
+#define SCAN_WINDOW 64
+
+/* Maximum number of reader threads used by parallel scanning */
+#define SCAN_MAX_READERS 8
+
+/**
+ * struct scan_ctx - parallel scanning context.
+ * @ubi: UBI device description object
+ * @lock: protects @next, @done, @stop and the @ready flags of @slots
+ * @wait: the reader threads and the scanning thread wait here
+ * @next: the next physical eraseblock to read
+ * @done: how many physical eraseblocks were added to the scanning information
+ * @stop: non-zero if the reader threads have to exit
+ * @readers: number of reader threads plus one for the scanning thread
+ * @exited: completed when the last reader thread exits
+ * @slots: the headers of physical eraseblock @pnum are read to slot
+ *         @pnum % %SCAN_WINDOW
+ */
+struct scan_ctx {
+	struct ubi_device *ubi;
+	spinlock_t lock;
+	wait_queue_head_t wait;
+	int next;
+	int done;
+	int stop;
+	atomic_t readers;
+	struct completion exited;
+	struct scan_peb slots[SCAN_WINDOW];
+};
+
+/**
+ * claim_peb - pick the next physical eraseblock to read.
+ * @ctx: parallel scanning context
+ *
+ * This function returns the physical eraseblock number, %-1 if the reader
+ * thread has to exit, and %-EAGAIN if the reader threads are too far ahead of
+ * the scanning thread.
+ */
+static int claim_peb(struct scan_ctx *ctx)
+{
+	int pnum = -EAGAIN;
+
+	spin_lock(&ctx->lock);
+	if (ctx->stop || ctx->next >= ctx->ubi->peb_count)
+		pnum = -1;
+	else if (ctx->next < ctx->done + SCAN_WINDOW)
+		pnum = ctx->next++;
+	spin_unlock(&ctx->lock);
+	return pnum;
+}
+
+/**
+ * peb_ready - check whether the headers of a physical eraseblock were read.
+ * @ctx: parallel scanning context
+ * @sp: the slot of the physical eraseblock
+ */
+static int peb_ready(struct scan_ctx *ctx, const struct scan_peb *sp)
+{
+	int ready;
+
+	spin_lock(&ctx->lock);
+	ready = sp->ready;
+	spin_unlock(&ctx->lock);
+	return ready;
+}
+
+/**
+ * scan_reader - reader thread function.
+ * @data: parallel scanning context
+ */
+static int scan_reader(void *data)
+{
+	struct scan_ctx *ctx = data;
+	struct scan_peb *sp;
+	int pnum;
+
+	while (1) {
+		wait_event(ctx->wait, (pnum = claim_peb(ctx)) != -EAGAIN);
+		if (pnum < 0)
+			break;
+
+		sp = &ctx->slots[pnum % SCAN_WINDOW];
+		sp->pnum = pnum;
+		read_peb(ctx->ubi, sp);
+
+		spin_lock(&ctx->lock);
+		sp->ready = 1;
+		spin_unlock(&ctx->lock);
+		wake_up_all(&ctx->wait);
+	}
+
+	if (atomic_dec_and_test(&ctx->readers))
+		complete(&ctx->exited);
+	return 0;
+}
+
+/**
+ * free_scan_ctx - free parallel scanning context.
+ * @ubi: UBI device description object
+ * @ctx: the context to free
+ */
+static void free_scan_ctx(struct ubi_device *ubi, struct scan_ctx *ctx)
+{
+	int i;
+
+	for (i = 0; i < SCAN_WINDOW; i++) {
+		kfree(ctx->slots[i].ech);
+		ubi_free_vid_hdr(ubi, ctx->slots[i].vidh);
+	}
+	kfree(ctx);
+}
+
+/**
+ * scan_seq - scan all physical eraseblocks one by one.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ *
+ * This function returns zero in case of success and a negative error code in
+ * case of failure.
+ */
+static int scan_seq(struct ubi_device *ubi, struct ubi_scan_info *si)
+{
+	int err, pnum;
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		cond_resched();
+
+		dbg_gen("process PEB %d", pnum);
+		err = process_eb(ubi, si, pnum);
+		if (err < 0)
+			return err;
+	}
+
+	return 0;
+}
+
+/**
+ * scan_all - scan all physical eraseblocks.
+ * @ubi: UBI device description object
+ * @si: scanning information
+ *
+ * Most of the scanning time is spent waiting for the flash, so this function
+ * lets reader threads read and check the headers of up to %SCAN_WINDOW
+ * physical eraseblocks ahead, while it adds the headers which were already
+ * read to the scanning information. The physical eraseblocks are still added
+ * in order, so the result is the same as with sequential scanning, which is
+ * used if the reader threads cannot be started. Returns zero in case of
+ * success and a negative error code in case of failure.
+ */
+static int scan_all(struct ubi_device *ubi, struct ubi_scan_info *si)
+{
+	int err = 0, i, pnum, readers;
+	struct task_struct *thread;
+	struct scan_ctx *ctx;
+	struct scan_peb *sp;
+
+	ctx = kzalloc(sizeof(struct scan_ctx), GFP_KERNEL);
+	if (!ctx)
+		return scan_seq(ubi, si);
+
+	ctx->ubi = ubi;
+	spin_lock_init(&ctx->lock);
+	init_waitqueue_head(&ctx->wait);
+	init_completion(&ctx->exited);
+	atomic_set(&ctx->readers, 1);
+	for (i = 0; i < SCAN_WINDOW; i++) {
+		sp = &ctx->slots[i];
+		sp->ech = kzalloc(ubi->ec_hdr_alsize, GFP_KERNEL);
+		sp->vidh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
+		if (!sp->ech || !sp->vidh)
+			goto out_seq;
+	}
+
+	readers = min_t(int, num_online_cpus() + 1, SCAN_MAX_READERS);
+	for (i = 0; i < readers; i++) {
+		atomic_inc(&ctx->readers);
+		thread = kthread_run(scan_reader, ctx, "ubi_scan%d_%d",
+				     ubi->ubi_num, i);
+		if (IS_ERR(thread)) {
+			atomic_dec(&ctx->readers);
+			break;
+		}
+	}
+	if (i == 0)
+		goto out_seq;
+	dbg_bld("scan with %d reader threads", i);
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		sp = &ctx->slots[pnum % SCAN_WINDOW];
+		wait_event(ctx->wait, peb_ready(ctx, sp));
+
+		dbg_gen("process PEB %d", pnum);
+		err = add_peb(ubi, si, sp);
+
+		spin_lock(&ctx->lock);
+		sp->ready = 0;
+		ctx->done += 1;
+		if (err)
+			ctx->stop = 1;
+		spin_unlock(&ctx->lock);
+		wake_up_all(&ctx->wait);
+		if (err)
+			break;
+	}
+
+	/* The reader threads use @ctx until they exit */
+	if (!atomic_dec_and_test(&ctx->readers))
+		wait_for_completion(&ctx->exited);
+	free_scan_ctx(ubi, ctx);
+	return err;
+
+out_seq:
+	free_scan_ctx(ubi, ctx);
+	return scan_seq(ubi, si);
+}
+
 /**
  * check_what_we_have - check what PEB were found by scanning.
  * @ubi: UBI device description object
@@ -1127,46 +1459,222 @@ static int check_what_we_have(struct ubi_device *ubi, struct ubi_scan_info *si)
 }
 
 /**
- * ubi_scan - scan an MTD device.
- * @ubi: UBI device description object
+ * alloc_si - allocate scanning information.
  *
- * This function does full scanning of an MTD device and returns complete
- * information about it. In case of failure, an error code is returned.
+ * This function returns a pointer to the empty scanning information or %NULL
+ * if there is not enough memory.
  */
-struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
+static struct ubi_scan_info *alloc_si(void)
 {
-	int err, pnum;
-	struct rb_node *rb1, *rb2;
-	struct ubi_scan_volume *sv;
-	struct ubi_scan_leb *seb;
 	struct ubi_scan_info *si;
 
 	si = kzalloc(sizeof(struct ubi_scan_info), GFP_KERNEL);
 	if (!si)
-		return ERR_PTR(-ENOMEM);
+		return NULL;
 
 	INIT_LIST_HEAD(&si->corr);
 	INIT_LIST_HEAD(&si->free);
 	INIT_LIST_HEAD(&si->erase);
 	INIT_LIST_HEAD(&si->alien);
 	si->volumes = RB_ROOT;
+	return si;
+}
+
+#ifdef CONFIG_MTD_UBI_CHECKPOINT
+
+/* The layout volume goes after all the possible user volumes */
+#define CKPT_VOL_COUNT (UBI_MAX_VOLUMES + 1)
+
+/**
+ * ckpt_vol_idx - get the index of a volume in the VID header templates.
+ * @vol_id: volume ID
+ *
+ * The number of volume table slots is not known yet, so this function does
+ * not use 'vol_id2idx()'. Returns %-1 if a checkpoint may not contain LEBs of
+ * volume @vol_id.
+ */
+static int ckpt_vol_idx(uint32_t vol_id)
+{
+	if (vol_id < UBI_MAX_VOLUMES)
+		return vol_id;
+	if (vol_id == UBI_LAYOUT_VOLUME_ID)
+		return UBI_MAX_VOLUMES;
+	return -1;
+}
+
+/**
+ * scan_ckpt - build scanning information from the checkpoint.
+ * @ubi: UBI device description object
+ *
+ * This function reads the checkpoint and scans only the physical eraseblocks
+ * it does not describe. The VID headers of the used PEBs the checkpoint
+ * describes are not read. They are re-created from the checkpoint records and
+ * from the VID header of the last LEB of the volume, which contains the same
+ * volume information. Returns the scanning information, or %NULL if there is no
+ * usable checkpoint and the whole flash has to be scanned.
+ */
+static struct ubi_scan_info *scan_ckpt(struct ubi_device *ubi)
+{
+	int err, pnum, idx, ec, scanned = 0, *last;
+	unsigned long long max_sqnum;
+	struct ubi_scan_info *si = NULL;
+	struct ubi_ckpt_hdr *hdr;
+	struct ubi_ckpt_peb *recs;
+	struct ubi_vid_hdr *tmpl;
+	uint32_t vol_id;
+
+	hdr = ubi_ckpt_read(ubi);
+	if (!hdr)
+		return NULL;
+	recs = (void *)hdr + UBI_CKPT_HDR_SIZE;
+	max_sqnum = be64_to_cpu(hdr->sqnum);
+
+	tmpl = kcalloc(CKPT_VOL_COUNT, sizeof(struct ubi_vid_hdr), GFP_KERNEL);
+	last = kmalloc(CKPT_VOL_COUNT * sizeof(int), GFP_KERNEL);
+	if (!tmpl || !last)
+		goto out_free;
+
+	/* Check the records and find the last LEB of each volume */
+	for (idx = 0; idx < CKPT_VOL_COUNT; idx++)
+		last[idx] = -1;
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		vol_id = be32_to_cpu(recs[pnum].vol_id);
+		if (vol_id == UBI_CKPT_PEB_SCAN)
+			continue;
+		if (be32_to_cpu(recs[pnum].ec) > UBI_MAX_ERASECOUNTER)
+			goto out_bad;
+		if (vol_id == UBI_CKPT_PEB_FREE)
+			continue;
+
+		idx = ckpt_vol_idx(vol_id);
+		if (idx < 0 || (int)be32_to_cpu(recs[pnum].lnum) < 0 ||
+		    be64_to_cpu(recs[pnum].sqnum) > max_sqnum)
+			goto out_bad;
+
+		if (last[idx] < 0 || be32_to_cpu(recs[pnum].lnum) >
+				     be32_to_cpu(recs[last[idx]].lnum))
+			last[idx] = pnum;
+	}
+
+	for (idx = 0; idx < CKPT_VOL_COUNT; idx++) {
+		pnum = last[idx];
+		if (pnum < 0)
+			continue;
+
+		err = ubi_io_read_vid_hdr(ubi, pnum, vidh, 0);
+		if ((err && err != UBI_IO_BITFLIPS) ||
+		    vidh->vol_id != recs[pnum].vol_id ||
+		    vidh->lnum != recs[pnum].lnum ||
+		    vidh->sqnum != recs[pnum].sqnum)
+			goto out_bad;
+
+		memcpy(&tmpl[idx], vidh, sizeof(struct ubi_vid_hdr));
+		tmpl[idx].copy_flag = 0;
+	}
+
+	si = alloc_si();
+	if (!si)
+		goto out_free;
+
+	ubi->image_seq = be32_to_cpu(hdr->image_seq);
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		cond_resched();
+
+		vol_id = be32_to_cpu(recs[pnum].vol_id);
+		if (vol_id == UBI_CKPT_PEB_SCAN) {
+			dbg_gen("process PEB %d", pnum);
+			err = process_eb(ubi, si, pnum);
+			if (err < 0)
+				goto out_si;
+			scanned += 1;
+			continue;
+		}
+
+		ec = be32_to_cpu(recs[pnum].ec);
+		if (vol_id == UBI_CKPT_PEB_FREE)
+			err = add_to_list(si, pnum, ec, 0, &si->free);
+		else {
+			struct ubi_vid_hdr *vid_hdr = &tmpl[ckpt_vol_idx(vol_id)];
+
+			vid_hdr->lnum = recs[pnum].lnum;
+			vid_hdr->sqnum = recs[pnum].sqnum;
+			err = ubi_scan_add_used(ubi, si, pnum, ec, vid_hdr, 0);
+		}
+		if (err)
+			goto out_si;
+
+		si->ec_sum += ec;
+		si->ec_count += 1;
+		if (ec > si->max_ec)
+			si->max_ec = ec;
+		if (ec < si->min_ec)
+			si->min_ec = ec;
+	}
+
+	if (si->max_sqnum < max_sqnum)
+		si->max_sqnum = max_sqnum;
+
+	ubi_msg("attached using the checkpoint, scanned %d of %d PEBs",
+		scanned, ubi->peb_count);
+	kfree(last);
+	kfree(tmpl);
+	vfree(hdr);
+	return si;
+
+out_bad:
+	ubi_warn("bad checkpoint record for PEB %d", pnum);
+	goto out_free;
+out_si:
+	ubi_warn("cannot use the checkpoint, error %d", err);
+	ubi_scan_destroy_si(si);
+	ubi->image_seq = 0;
+out_free:
+	kfree(last);
+	kfree(tmpl);
+	vfree(hdr);
+	return NULL;
+}
+#else
+#define scan_ckpt(ubi) NULL
+#endif
+
+/**
+ * ubi_scan - scan an MTD device.
+ * @ubi: UBI device description object
+ *
+ * This function does full scanning of an MTD device and returns complete
+ * information about it. If there is a checkpoint, only the physical
+ * eraseblocks it does not describe are scanned. In case of failure, an error
+ * code is returned.
+ */
+struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
+{
+	int err;
+	struct rb_node *rb1, *rb2;
+	struct ubi_scan_volume *sv;
+	struct ubi_scan_leb *seb;
+	struct ubi_scan_info *si;
 
-	err = -ENOMEM;
 	ech = kzalloc(ubi->ec_hdr_alsize, GFP_KERNEL);
 	if (!ech)
-		goto out_si;
+		return ERR_PTR(-ENOMEM);
 
+	err = -ENOMEM;
 	vidh = ubi_zalloc_vid_hdr(ubi, GFP_KERNEL);
 	if (!vidh)
 		goto out_ech;
 
-	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
-		cond_resched();
-
-		dbg_gen("process PEB %d", pnum);
-		err = process_eb(ubi, si, pnum);
-		if (err < 0)
+	si = scan_ckpt(ubi);
+	if (!si) {
+		si = alloc_si();
+		if (!si)
 			goto out_vidh;
+
+		err = scan_all(ubi, si);
+		if (err)
+			goto out_si;
 	}
 
 	dbg_msg("scanning is finished");
@@ -1177,7 +1685,7 @@ struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 
 	err = check_what_we_have(ubi, si);
 	if (err)
-		goto out_vidh;
+		goto out_si;
 
 	/*
 	 * In case of unknown erase counter we use the mean erase counter
@@ -1204,19 +1712,19 @@ struct ubi_scan_info *ubi_scan(struct ubi_device *ubi)
 
 	err = paranoid_check_si(ubi, si);
 	if (err)
-		goto out_vidh;
+		goto out_si;
 
 	ubi_free_vid_hdr(ubi, vidh);
 	kfree(ech);
 
 	return si;
 
+out_si:
+	ubi_scan_destroy_si(si);
 out_vidh:
 	ubi_free_vid_hdr(ubi, vidh);
 out_ech:
 	kfree(ech);
-out_si:
-	ubi_scan_destroy_si(si);
 	return ERR_PTR(err);
 }
 
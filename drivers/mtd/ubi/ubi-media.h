@@ -112,13 +112,29 @@ enum {
 	UBI_COMPAT_REJECT   = 5
 };
 
+/* Checkpoint header magic number (ASCII "UBIC") */
+#define UBI_CKPT_HDR_MAGIC 0x55424943
+/* Checkpoint format version */
+#define UBI_CKPT_VERSION 1
+
+/*
+ * Special volume IDs used in checkpoint PEB records.
+ *
+ * @UBI_CKPT_PEB_FREE: the PEB is free and contains only an EC header
+ * @UBI_CKPT_PEB_SCAN: nothing is known about the PEB, it has to be scanned
+ */
+#define UBI_CKPT_PEB_FREE 0xFFFFFFFF
+#define UBI_CKPT_PEB_SCAN 0xFFFFFFFE
+
 /* Sizes of UBI headers */
 #define UBI_EC_HDR_SIZE  sizeof(struct ubi_ec_hdr)
 #define UBI_VID_HDR_SIZE sizeof(struct ubi_vid_hdr)
+#define UBI_CKPT_HDR_SIZE sizeof(struct ubi_ckpt_hdr)
 
 /* Sizes of UBI headers without the ending CRC */
 #define UBI_EC_HDR_SIZE_CRC  (UBI_EC_HDR_SIZE  - sizeof(__be32))
 #define UBI_VID_HDR_SIZE_CRC (UBI_VID_HDR_SIZE - sizeof(__be32))
+#define UBI_CKPT_HDR_SIZE_CRC (UBI_CKPT_HDR_SIZE - sizeof(__be32))
 
 /**
  * struct ubi_ec_hdr - UBI erase counter header.
@@ -312,6 +328,23 @@ struct ubi_vid_hdr {
 #define UBI_LAYOUT_VOLUME_NAME   "layout volume"
 #define UBI_LAYOUT_VOLUME_COMPAT UBI_COMPAT_REJECT
 
+/*
+ * The checkpoint volume contains a snapshot of the scanning information, see
+ * &struct ubi_ckpt_hdr. It is not a real volume: it has no volume table
+ * record, and its LEBs are not in the EBA table. UBI implementations which do
+ * not support checkpoints just delete it.
+ */
+
+#define UBI_CKPT_VOLUME_ID     (UBI_LAYOUT_VOLUME_ID + 1)
+#define UBI_CKPT_VOLUME_TYPE   UBI_VID_DYNAMIC
+#define UBI_CKPT_VOLUME_COMPAT UBI_COMPAT_DELETE
+
+/* LEB 0 of the checkpoint volume has to be in one of the first 64 PEBs */
+#define UBI_CKPT_MAX_START 64
+
+/* The maximum number of LEBs a checkpoint may take */
+#define UBI_CKPT_MAX_LEBS 32
+
 /* The maximum number of volumes per one UBI device */
 #define UBI_MAX_VOLUMES 128
 
@@ -375,4 +408,64 @@ struct ubi_vtbl_record {
 	__be32  crc;
 } __attribute__ ((packed));
 
+/**
+ * struct ubi_ckpt_hdr - checkpoint header.
+ * @magic: checkpoint header magic number (%UBI_CKPT_HDR_MAGIC)
+ * @version: checkpoint format version (%UBI_CKPT_VERSION)
+ * @padding1: reserved for future, zeroes
+ * @image_seq: image sequence number
+ * @peb_count: number of PEB records following the header
+ * @leb_count: number of LEBs the checkpoint takes
+ * @size: size of the checkpoint in bytes, including this header
+ * @data_crc: CRC checksum of the PEB records
+ * @sqnum: the global sequence number at the time the checkpoint was taken
+ * @pebs: the PEBs LEBs 0 to @leb_count - 1 of the checkpoint are stored in
+ * @padding2: reserved for future, zeroes
+ * @hdr_crc: checkpoint header CRC checksum
+ *
+ * A checkpoint is a snapshot of the scanning information: it is this header
+ * followed by a &struct ubi_ckpt_peb record for each PEB of the device, and it
+ * is stored in the LEBs of the checkpoint volume (%UBI_CKPT_VOLUME_ID). The
+ * header is at the start of LEB 0, which is written last and has to be in one
+ * of the first %UBI_CKPT_MAX_START PEBs, so that it can be found without
+ * scanning the whole device.
+ *
+ * The PEB record of a used PEB contains the volume ID, LEB number and sequence
+ * number from its VID header, the record of a free PEB contains
+ * %UBI_CKPT_PEB_FREE, and all the other PEBs, which may have been written to
+ * after the checkpoint was taken, are marked with %UBI_CKPT_PEB_SCAN.
+ * Attaching the device only has to scan these.
+ */
+struct ubi_ckpt_hdr {
+	__be32  magic;
+	__u8    version;
+	__u8    padding1[3];
+	__be32  image_seq;
+	__be32  peb_count;
+	__be32  leb_count;
+	__be32  size;
+	__be32  data_crc;
+	__be64  sqnum;
+	__be32  pebs[UBI_CKPT_MAX_LEBS];
+	__u8    padding2[24];
+	__be32  hdr_crc;
+} __attribute__ ((packed));
+
+/**
+ * struct ubi_ckpt_peb - a PEB record in the checkpoint.
+ * @sqnum: sequence number of the LEB stored in the PEB
+ * @vol_id: volume ID, %UBI_CKPT_PEB_FREE or %UBI_CKPT_PEB_SCAN
+ * @lnum: logical eraseblock number
+ * @ec: the erase counter
+ *
+ * The @sqnum and @lnum fields are only meaningful for used PEBs, and the @ec
+ * field only for used and free PEBs.
+ */
+struct ubi_ckpt_peb {
+	__be64  sqnum;
+	__be32  vol_id;
+	__be32  lnum;
+	__be32  ec;
+} __attribute__ ((packed));
+
 #endif /* !__UBI_MEDIA_H__ */
@@ -135,6 +135,8 @@ enum {
  * @u.list: link in the protection queue
  * @ec: erase counter
  * @pnum: physical eraseblock number
+ * @sqnum: sequence number of the LEB last written to this physical
+ *         eraseblock (only present if checkpoints are enabled)
  *
  * This data structure is used in the WL sub-system. Each physical eraseblock
  * has a corresponding &struct wl_entry object which may be kept in different
@@ -147,6 +149,9 @@ struct ubi_wl_entry {
 	} u;
 	int ec;
 	int pnum;
+#ifdef CONFIG_MTD_UBI_CHECKPOINT
+	unsigned long long sqnum;
+#endif
 };
 
 /**
@@ -389,6 +394,28 @@ struct ubi_wl_entry;
  * @ckvol_mutex: serializes static volume checking when opening
  * @dbg_peb_buf: buffer of PEB size used for debugging
  * @dbg_buf_mutex: protects @dbg_peb_buf
+ * @dbg_dfs_dir: debugfs directory of this device
+ * @dbg_alloc_hist: histogram of 'ubi_wl_get_peb()' latencies, protected by
+ *                  @wl_lock
+ *
+ * @ckpt_mutex: serializes checkpoint writes
+ * @ckpt_leb_count: how many LEBs a checkpoint takes (%0 if checkpoints are
+ *                  disabled for this device)
+ * @ckpt_size: checkpoint size in bytes
+ * @ckpt_pool_size: how many free PEBs may be used between two checkpoints
+ * @ckpt_pebs: the PEBs the current checkpoint is stored in (%-1 if there is
+ *             no checkpoint on the flash)
+ * @ckpt_buf: buffer of @ckpt_leb_count LEBs to build the checkpoint in
+ * @ckpt_active: non-zero if the checkpoint on the flash restricts erasures
+ * @ckpt_defer_all: defer all erasures while a checkpoint is being taken
+ * @ckpt_erasable: bitmap of PEBs which may be erased while @ckpt_active is set
+ * @ckpt_next: @ckpt_erasable for the checkpoint being written
+ * @ckpt_held: RB-tree of free PEBs which may not be used until the next
+ *             checkpoint
+ * @ckpt_deferred: list of deferred erase works
+ *
+ * @wl_lock also protects the @ckpt_active, @ckpt_defer_all,
+ * @ckpt_erasable, @ckpt_held and @ckpt_deferred fields.
  */
 struct ubi_device {
 	struct cdev cdev;
@@ -474,6 +501,25 @@ struct ubi_device {
 	void *dbg_peb_buf;
 	struct mutex dbg_buf_mutex;
 #endif
+#ifdef CONFIG_MTD_UBI_DEBUG
+	struct dentry *dbg_dfs_dir;
+	unsigned long dbg_alloc_hist[UBI_DBG_ALLOC_BUCKETS];
+#endif
+
+#ifdef CONFIG_MTD_UBI_CHECKPOINT
+	struct mutex ckpt_mutex;
+	int ckpt_leb_count;
+	int ckpt_size;
+	int ckpt_pool_size;
+	int ckpt_pebs[UBI_CKPT_MAX_LEBS];
+	void *ckpt_buf;
+	int ckpt_active;
+	int ckpt_defer_all;
+	unsigned long *ckpt_erasable;
+	unsigned long *ckpt_next;
+	struct rb_root ckpt_held;
+	struct list_head ckpt_deferred;
+#endif
 };
 
 extern struct kmem_cache *ubi_wl_entry_slab;
@@ -517,6 +563,7 @@ void ubi_calculate_reserved(struct ubi_device *ubi);
 int ubi_check_pattern(const void *buf, uint8_t patt, int size);
 
 /* eba.c */
+unsigned long long ubi_next_sqnum(struct ubi_device *ubi);
 int ubi_eba_unmap_leb(struct ubi_device *ubi, struct ubi_volume *vol,
 		      int lnum);
 int ubi_eba_read_leb(struct ubi_device *ubi, struct ubi_volume *vol, int lnum,
@@ -540,6 +587,39 @@ int ubi_wl_scrub_peb(struct ubi_device *ubi, int pnum);
 int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si);
 void ubi_wl_close(struct ubi_device *ubi);
 int ubi_thread(void *u);
+#ifdef CONFIG_MTD_UBI_CHECKPOINT
+void ubi_wl_set_sqnum(struct ubi_device *ubi, int pnum,
+		      unsigned long long sqnum);
+int ubi_wl_get_ckpt_peb(struct ubi_device *ubi, int anchor);
+int ubi_wl_put_ckpt_peb(struct ubi_device *ubi, int pnum);
+int ubi_wl_erase_ckpt_anchor(struct ubi_device *ubi, int pnum);
+void ubi_wl_ckpt_begin(struct ubi_device *ubi);
+void ubi_wl_ckpt_snapshot(struct ubi_device *ubi, struct ubi_ckpt_peb *recs,
+			  int pool);
+void ubi_wl_ckpt_commit(struct ubi_device *ubi);
+void ubi_wl_ckpt_release(struct ubi_device *ubi);
+#else
+static inline void ubi_wl_set_sqnum(struct ubi_device *ubi, int pnum,
+				    unsigned long long sqnum) {}
+#endif
+
+/* ckpt.c */
+#ifdef CONFIG_MTD_UBI_CHECKPOINT
+struct ubi_ckpt_hdr *ubi_ckpt_read(struct ubi_device *ubi);
+int ubi_ckpt_write(struct ubi_device *ubi, int final);
+int ubi_ckpt_init(struct ubi_device *ubi);
+void ubi_ckpt_close(struct ubi_device *ubi);
+#else
+static inline int ubi_ckpt_write(struct ubi_device *ubi, int final)
+{
+	return 0;
+}
+static inline int ubi_ckpt_init(struct ubi_device *ubi)
+{
+	return 0;
+}
+static inline void ubi_ckpt_close(struct ubi_device *ubi) {}
+#endif
 
 /* io.c */
 int ubi_io_read(const struct ubi_device *ubi, void *buf, int pnum, int offset,
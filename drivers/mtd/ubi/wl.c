@@ -103,6 +103,14 @@
  * target PEB, we pick a PEB with the highest EC if our PEB is "old" and we
  * pick target PEB with an average EC if our PEB is not very "old". This is a
  * room for future re-works of the WL sub-system.
+ *
+ * If checkpoints are enabled (see ckpt.c), the checkpoint on the flash
+ * describes the contents of most PEBs, and the WL sub-system has to keep it
+ * true until the next checkpoint is written. So the PEBs the checkpoint marks
+ * as free are kept in the @wl->ckpt_held tree, where nobody can get them, and
+ * the erasure of PEBs the checkpoint describes as used is deferred. Only the
+ * PEBs the checkpoint marks for scanning may be erased and written to. When
+ * they run out, a new checkpoint is written.
  */
 
 #include <linux/slab.h>
@@ -141,6 +149,13 @@
  */
 #define WL_MAX_FAILURES 32
 
+/*
+ * While there are fewer free physical eraseblocks than this, pending erasures
+ * are done before any other work, so that 'ubi_wl_get_peb()' rarely has to
+ * wait for an erasure or a wear-leveling move.
+ */
+#define WL_ERASE_WATERMARK CONFIG_MTD_UBI_ERASE_WATERMARK
+
 /**
  * struct ubi_work - UBI work description data structure.
  * @list: a link in the list of pending works
@@ -172,6 +187,18 @@ static int paranoid_check_in_pq(struct ubi_device *ubi, struct ubi_wl_entry *e);
 #define paranoid_check_in_pq(ubi, e) 0
 #endif
 
+#ifdef CONFIG_MTD_UBI_CHECKPOINT
+static int ckpt_holds_pebs(struct ubi_device *ubi);
+static int ckpt_erasures_deferred(struct ubi_device *ubi);
+static int ckpt_defer_erase(struct ubi_device *ubi, struct ubi_work *wrk);
+static void ckpt_cancel(struct ubi_device *ubi);
+#else
+#define ckpt_holds_pebs(ubi) 0
+#define ckpt_erasures_deferred(ubi) 0
+#define ckpt_defer_erase(ubi, wrk) 0
+#define ckpt_cancel(ubi)
+#endif
+
 /**
  * wl_tree_add - add a wear-leveling entry to a WL RB-tree.
  * @e: the wear-leveling entry to add
@@ -208,17 +235,41 @@ static void wl_tree_add(struct ubi_wl_entry *e, struct rb_root *root)
 	rb_insert_color(&e->u.rb, root);
 }
 
+static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
+			int cancel);
+
+/**
+ * free_below_watermark - check if more free PEBs should be erased ahead.
+ * @ubi: UBI device description object
+ *
+ * This function returns non-zero if there are less than %WL_ERASE_WATERMARK
+ * free physical eraseblocks. Note, @ubi->wl_lock has to be locked.
+ */
+static int free_below_watermark(struct ubi_device *ubi)
+{
+	struct rb_node *rb = rb_first(&ubi->free);
+	int count = 0;
+
+	while (rb && count < WL_ERASE_WATERMARK) {
+		count += 1;
+		rb = rb_next(rb);
+	}
+
+	return count < WL_ERASE_WATERMARK;
+}
+
 /**
  * do_work - do one pending work.
  * @ubi: UBI device description object
  *
- * This function returns zero in case of success and a negative error code in
- * case of failure.
+ * Works are done in the order they were scheduled, except that erasures go
+ * first while free physical eraseblocks are short. This function returns zero
+ * in case of success and a negative error code in case of failure.
  */
 static int do_work(struct ubi_device *ubi)
 {
 	int err;
-	struct ubi_work *wrk;
+	struct ubi_work *wrk, *tmp;
 
 	cond_resched();
 
@@ -237,6 +288,12 @@ static int do_work(struct ubi_device *ubi)
 	}
 
 	wrk = list_entry(ubi->works.next, struct ubi_work, list);
+	if (wrk->func != &erase_worker && free_below_watermark(ubi))
+		list_for_each_entry(tmp, &ubi->works, list)
+			if (tmp->func == &erase_worker) {
+				wrk = tmp;
+				break;
+			}
 	list_del(&wrk->list);
 	ubi->works_count -= 1;
 	ubi_assert(ubi->works_count >= 0);
@@ -260,8 +317,10 @@ static int do_work(struct ubi_device *ubi)
  * @ubi: UBI device description object
  *
  * This function tries to make a free PEB by means of synchronous execution of
- * pending works. This may be needed if, for example the background thread is
- * disabled. Returns zero in case of success and a negative error code in case
+ * pending works, erasures first. This may be needed if, for example the
+ * background thread is disabled or cannot keep up. Note, there may still be
+ * no free PEBs when the works run out, e.g. if the checkpoint deferred the
+ * erasures. Returns zero in case of success and a negative error code in case
  * of failure.
  */
 static int produce_free_peb(struct ubi_device *ubi)
@@ -269,7 +328,7 @@ static int produce_free_peb(struct ubi_device *ubi)
 	int err;
 
 	spin_lock(&ubi->wl_lock);
-	while (!ubi->free.rb_node) {
+	while (!ubi->free.rb_node && ubi->works_count) {
 		spin_unlock(&ubi->wl_lock);
 
 		dbg_wl("do one work synchronously");
@@ -377,14 +436,13 @@ static struct ubi_wl_entry *find_wl_entry(struct rb_root *root, int max)
 }
 
 /**
- * ubi_wl_get_peb - get a physical eraseblock.
+ * get_peb - get a physical eraseblock.
  * @ubi: UBI device description object
  * @dtype: type of data which will be stored in this physical eraseblock
  *
- * This function returns a physical eraseblock in case of success and a
- * negative error code in case of failure. Might sleep.
+ * This is the body of 'ubi_wl_get_peb()'.
  */
-int ubi_wl_get_peb(struct ubi_device *ubi, int dtype)
+static int get_peb(struct ubi_device *ubi, int dtype)
 {
 	int err, medium_ec;
 	struct ubi_wl_entry *e, *first, *last;
@@ -397,6 +455,14 @@ retry:
 	if (!ubi->free.rb_node) {
 		if (ubi->works_count == 0) {
 			ubi_assert(list_empty(&ubi->works));
+			if (ckpt_holds_pebs(ubi)) {
+				/* A new checkpoint makes them available */
+				spin_unlock(&ubi->wl_lock);
+				err = ubi_ckpt_write(ubi, 0);
+				if (err)
+					return err;
+				goto retry;
+			}
 			ubi_err("no free eraseblocks");
 			spin_unlock(&ubi->wl_lock);
 			return -ENOSPC;
@@ -470,6 +536,24 @@ retry:
 	return e->pnum;
 }
 
+/**
+ * ubi_wl_get_peb - get a physical eraseblock.
+ * @ubi: UBI device description object
+ * @dtype: type of data which will be stored in this physical eraseblock
+ *
+ * This function returns a physical eraseblock in case of success and a
+ * negative error code in case of failure. Might sleep.
+ */
+int ubi_wl_get_peb(struct ubi_device *ubi, int dtype)
+{
+	ktime_t start = ubi_dbg_alloc_start();
+	int pnum;
+
+	pnum = get_peb(ubi, dtype);
+	ubi_dbg_alloc_done(ubi, start);
+	return pnum;
+}
+
 /**
  * prot_queue_del - remove a physical eraseblock from the protection queue.
  * @ubi: UBI device description object
@@ -618,9 +702,6 @@ static void schedule_ubi_work(struct ubi_device *ubi, struct ubi_work *wrk)
 	spin_unlock(&ubi->wl_lock);
 }
 
-static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
-			int cancel);
-
 /**
  * schedule_erase - schedule an erase work.
  * @ubi: UBI device description object
@@ -1022,6 +1103,9 @@ static int erase_worker(struct ubi_device *ubi, struct ubi_work *wl_wrk,
 		return 0;
 	}
 
+	if (ckpt_defer_erase(ubi, wl_wrk))
+		return 0;
+
 	dbg_wl("erase PEB %d EC %d", pnum, e->ec);
 
 	err = sync_erase(ubi, e, wl_wrk->torture);
@@ -1275,8 +1359,9 @@ retry:
  */
 int ubi_wl_flush(struct ubi_device *ubi)
 {
-	int err;
+	int err, ckpt_written = 0;
 
+again:
 	/*
 	 * Erase while the pending works queue is not empty, but not more than
 	 * the number of currently pending works.
@@ -1306,6 +1391,18 @@ int ubi_wl_flush(struct ubi_device *ubi)
 			return err;
 	}
 
+	/*
+	 * The checkpoint may have deferred some of the erasures, and the
+	 * callers rely on them being done.
+	 */
+	if (!ckpt_written && ckpt_erasures_deferred(ubi)) {
+		ckpt_written = 1;
+		err = ubi_ckpt_write(ubi, 0);
+		if (err)
+			return err;
+		goto again;
+	}
+
 	return 0;
 }
 
@@ -1431,6 +1528,10 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 	struct ubi_wl_entry *e;
 
 	ubi->used = ubi->erroneous = ubi->free = ubi->scrub = RB_ROOT;
+#ifdef CONFIG_MTD_UBI_CHECKPOINT
+	ubi->ckpt_held = RB_ROOT;
+	INIT_LIST_HEAD(&ubi->ckpt_deferred);
+#endif
 	spin_lock_init(&ubi->wl_lock);
 	mutex_init(&ubi->move_mutex);
 	init_rwsem(&ubi->work_sem);
@@ -1488,6 +1589,9 @@ int ubi_wl_init_scan(struct ubi_device *ubi, struct ubi_scan_info *si)
 
 			e->pnum = seb->pnum;
 			e->ec = seb->ec;
+#ifdef CONFIG_MTD_UBI_CHECKPOINT
+			e->sqnum = seb->sqnum;
+#endif
 			ubi->lookuptbl[e->pnum] = e;
 			if (!seb->scrub) {
 				dbg_wl("add PEB %d EC %d to the used tree",
@@ -1553,6 +1657,7 @@ void ubi_wl_close(struct ubi_device *ubi)
 {
 	dbg_wl("close the WL sub-system");
 	cancel_pending(ubi);
+	ckpt_cancel(ubi);
 	protection_queue_destroy(ubi);
 	tree_destroy(&ubi->used);
 	tree_destroy(&ubi->erroneous);
@@ -1561,6 +1666,330 @@ void ubi_wl_close(struct ubi_device *ubi)
 	kfree(ubi->lookuptbl);
 }
 
+#ifdef CONFIG_MTD_UBI_CHECKPOINT
+
+/**
+ * ubi_wl_set_sqnum - remember the sequence number of a physical eraseblock.
+ * @ubi: UBI device description object
+ * @pnum: the physical eraseblock
+ * @sqnum: sequence number of the VID header just written to @pnum
+ *
+ * The EBA sub-system calls this function before it maps a LEB to @pnum, so
+ * that the checkpoint can record the sequence number without reading the VID
+ * header back.
+ */
+void ubi_wl_set_sqnum(struct ubi_device *ubi, int pnum,
+		      unsigned long long sqnum)
+{
+	spin_lock(&ubi->wl_lock);
+	ubi->lookuptbl[pnum]->sqnum = sqnum;
+	spin_unlock(&ubi->wl_lock);
+}
+
+/**
+ * ckpt_holds_pebs - check if the checkpoint keeps PEBs from being used.
+ * @ubi: UBI device description object
+ *
+ * This function returns non-zero if free PEBs are held back or erasures are
+ * deferred because of the checkpoint, in which case writing a new checkpoint
+ * makes them available. Has to be called with @ubi->wl_lock locked.
+ */
+static int ckpt_holds_pebs(struct ubi_device *ubi)
+{
+	return ubi->ckpt_held.rb_node || ubi->ckpt_defer_all ||
+	       !list_empty(&ubi->ckpt_deferred);
+}
+
+/**
+ * ckpt_erasures_deferred - check if there are deferred erasures.
+ * @ubi: UBI device description object
+ */
+static int ckpt_erasures_deferred(struct ubi_device *ubi)
+{
+	int ret;
+
+	spin_lock(&ubi->wl_lock);
+	ret = !list_empty(&ubi->ckpt_deferred);
+	spin_unlock(&ubi->wl_lock);
+	return ret;
+}
+
+/**
+ * ckpt_defer_erase - defer an erasure the checkpoint does not allow.
+ * @ubi: UBI device description object
+ * @wrk: the erase work
+ *
+ * The checkpoint on the flash says what the PEBs it does not mark for scanning
+ * contain, so these may not be erased until a new checkpoint is written. The
+ * same goes for all PEBs while a checkpoint is being taken. This function
+ * returns non-zero if @wrk was put to the list of deferred works.
+ */
+static int ckpt_defer_erase(struct ubi_device *ubi, struct ubi_work *wrk)
+{
+	int pnum = wrk->e->pnum, defer;
+
+	spin_lock(&ubi->wl_lock);
+	defer = ubi->ckpt_defer_all ||
+		(ubi->ckpt_active && !test_bit(pnum, ubi->ckpt_erasable));
+	if (defer) {
+		dbg_wl("defer erasure of PEB %d", pnum);
+		list_add_tail(&wrk->list, &ubi->ckpt_deferred);
+	}
+	spin_unlock(&ubi->wl_lock);
+
+	return defer;
+}
+
+/**
+ * ckpt_requeue - move deferred works back to the queue of pending works.
+ * @ubi: UBI device description object
+ * @all: requeue all works, not only those the checkpoint allows
+ *
+ * Has to be called with @ubi->wl_lock locked.
+ */
+static void ckpt_requeue(struct ubi_device *ubi, int all)
+{
+	struct ubi_work *wrk, *tmp;
+
+	list_for_each_entry_safe(wrk, tmp, &ubi->ckpt_deferred, list) {
+		if (!all && !test_bit(wrk->e->pnum, ubi->ckpt_erasable))
+			continue;
+		list_move_tail(&wrk->list, &ubi->works);
+		ubi->works_count += 1;
+	}
+
+	if (ubi->works_count && ubi->thread_enabled)
+		wake_up_process(ubi->bgt_thread);
+}
+
+/**
+ * ckpt_cancel - free the checkpoint-related WL objects.
+ * @ubi: UBI device description object
+ */
+static void ckpt_cancel(struct ubi_device *ubi)
+{
+	struct ubi_work *wrk, *tmp;
+	int i;
+
+	list_for_each_entry_safe(wrk, tmp, &ubi->ckpt_deferred, list) {
+		list_del(&wrk->list);
+		wrk->func(ubi, wrk, 1);
+	}
+
+	tree_destroy(&ubi->ckpt_held);
+
+	for (i = 0; i < ubi->ckpt_leb_count; i++)
+		if (ubi->ckpt_pebs[i] >= 0)
+			kmem_cache_free(ubi_wl_entry_slab,
+					ubi->lookuptbl[ubi->ckpt_pebs[i]]);
+}
+
+/**
+ * ubi_wl_get_ckpt_peb - get a physical eraseblock for the checkpoint.
+ * @ubi: UBI device description object
+ * @anchor: non-zero if the PEB is for LEB 0 of the checkpoint
+ *
+ * This function returns the free PEB with the lowest erase counter, which has
+ * to be one of the first %UBI_CKPT_MAX_START PEBs if @anchor is set. The PEB
+ * does not go to any tree, it is only returned by 'ubi_wl_put_ckpt_peb()' or
+ * 'ubi_wl_erase_ckpt_anchor()'. Returns the PEB number in case of success and
+ * a negative error code in case of failure.
+ */
+int ubi_wl_get_ckpt_peb(struct ubi_device *ubi, int anchor)
+{
+	int err;
+	struct rb_node *rb;
+	struct ubi_wl_entry *e = NULL;
+
+retry:
+	spin_lock(&ubi->wl_lock);
+	for (rb = rb_first(&ubi->free); rb; rb = rb_next(rb)) {
+		e = rb_entry(rb, struct ubi_wl_entry, u.rb);
+		if (!anchor || e->pnum < UBI_CKPT_MAX_START)
+			break;
+	}
+
+	if (!rb) {
+		spin_unlock(&ubi->wl_lock);
+		if (!ubi->works_count)
+			return -ENOSPC;
+
+		err = do_work(ubi);
+		if (err)
+			return err;
+		goto retry;
+	}
+
+	rb_erase(&e->u.rb, &ubi->free);
+	spin_unlock(&ubi->wl_lock);
+	dbg_wl("PEB %d EC %d", e->pnum, e->ec);
+
+	return e->pnum;
+}
+
+/**
+ * ubi_wl_put_ckpt_peb - return a checkpoint PEB.
+ * @ubi: UBI device description object
+ * @pnum: the physical eraseblock to return
+ *
+ * This function schedules PEB @pnum, which was got by
+ * 'ubi_wl_get_ckpt_peb()', for erasure. Returns zero in case of success and a
+ * negative error code in case of failure.
+ */
+int ubi_wl_put_ckpt_peb(struct ubi_device *ubi, int pnum)
+{
+	return schedule_erase(ubi, ubi->lookuptbl[pnum], 0);
+}
+
+/**
+ * ubi_wl_erase_ckpt_anchor - synchronously erase and return a checkpoint PEB.
+ * @ubi: UBI device description object
+ * @pnum: the physical eraseblock to erase
+ *
+ * This function is used for LEB 0 of the checkpoint, which has to be gone
+ * before anything the checkpoint describes may change. In case of failure,
+ * UBI switches to R/O mode and a negative error code is returned.
+ */
+int ubi_wl_erase_ckpt_anchor(struct ubi_device *ubi, int pnum)
+{
+	int err;
+	struct ubi_wl_entry *e = ubi->lookuptbl[pnum];
+
+	err = sync_erase(ubi, e, 0);
+	if (err) {
+		ubi_err("cannot erase checkpoint PEB %d, error %d", pnum, err);
+		ubi_ro_mode(ubi);
+		return err;
+	}
+
+	spin_lock(&ubi->wl_lock);
+	wl_tree_add(e, &ubi->free);
+	spin_unlock(&ubi->wl_lock);
+
+	return 0;
+}
+
+/**
+ * ubi_wl_ckpt_begin - start taking a checkpoint.
+ * @ubi: UBI device description object
+ *
+ * Defer all erasures until 'ubi_wl_ckpt_commit()' or
+ * 'ubi_wl_ckpt_release()' is called, so that the used PEBs found in the EBA
+ * tables stay what they are until 'ubi_wl_ckpt_snapshot()'.
+ */
+void ubi_wl_ckpt_begin(struct ubi_device *ubi)
+{
+	spin_lock(&ubi->wl_lock);
+	ubi->ckpt_defer_all = 1;
+	spin_unlock(&ubi->wl_lock);
+}
+
+/**
+ * ubi_wl_ckpt_snapshot - fill in the WL part of checkpoint PEB records.
+ * @ubi: UBI device description object
+ * @recs: PEB records, where used PEBs already have their volume ID and LEB
+ *        number, and all the others are marked for scanning
+ * @pool: how many free PEBs may be used until the next checkpoint
+ *
+ * This function sets the erase counters and sequence numbers of used PEBs,
+ * leaves @pool free PEBs in the free tree and moves the other free PEBs to the
+ * @ubi->ckpt_held tree. The PEBs left in the free tree are picked evenly from
+ * the range of erase counters, so that the WL sub-system still has a choice.
+ * Free PEBs which may hold LEB 0 of the next checkpoint are always held.
+ */
+void ubi_wl_ckpt_snapshot(struct ubi_device *ubi, struct ubi_ckpt_peb *recs,
+			  int pool)
+{
+	int pnum, count = 0, stride = 1, i = 0;
+	struct rb_node *rb, *next;
+	struct ubi_wl_entry *e;
+
+	spin_lock(&ubi->wl_lock);
+	bitmap_fill(ubi->ckpt_next, ubi->peb_count);
+
+	for (pnum = 0; pnum < ubi->peb_count; pnum++) {
+		if (recs[pnum].vol_id == cpu_to_be32(UBI_CKPT_PEB_SCAN))
+			continue;
+
+		e = ubi->lookuptbl[pnum];
+		recs[pnum].ec = cpu_to_be32(e->ec);
+		recs[pnum].sqnum = cpu_to_be64(e->sqnum);
+		__clear_bit(pnum, ubi->ckpt_next);
+	}
+
+	ubi_rb_for_each_entry(rb, e, &ubi->free, u.rb)
+		if (e->pnum >= UBI_CKPT_MAX_START)
+			count += 1;
+	if (pool && count > pool)
+		stride = count / pool;
+
+	for (rb = rb_first(&ubi->free); rb; rb = next) {
+		next = rb_next(rb);
+		e = rb_entry(rb, struct ubi_wl_entry, u.rb);
+		if (pool && e->pnum >= UBI_CKPT_MAX_START &&
+		    i++ % stride == 0) {
+			pool -= 1;
+			continue;
+		}
+
+		rb_erase(rb, &ubi->free);
+		wl_tree_add(e, &ubi->ckpt_held);
+		recs[e->pnum].vol_id = cpu_to_be32(UBI_CKPT_PEB_FREE);
+		recs[e->pnum].ec = cpu_to_be32(e->ec);
+		__clear_bit(e->pnum, ubi->ckpt_next);
+	}
+	spin_unlock(&ubi->wl_lock);
+}
+
+/**
+ * ubi_wl_ckpt_commit - start obeying a new checkpoint.
+ * @ubi: UBI device description object
+ *
+ * This function is called when the checkpoint of the last
+ * 'ubi_wl_ckpt_snapshot()' call is on the flash. Only the PEBs it marks for
+ * scanning may be erased from now on.
+ */
+void ubi_wl_ckpt_commit(struct ubi_device *ubi)
+{
+	unsigned long *tmp;
+
+	spin_lock(&ubi->wl_lock);
+	tmp = ubi->ckpt_erasable;
+	ubi->ckpt_erasable = ubi->ckpt_next;
+	ubi->ckpt_next = tmp;
+	ubi->ckpt_active = 1;
+	ubi->ckpt_defer_all = 0;
+	ckpt_requeue(ubi, 0);
+	spin_unlock(&ubi->wl_lock);
+}
+
+/**
+ * ubi_wl_ckpt_release - stop obeying the checkpoint.
+ * @ubi: UBI device description object
+ *
+ * This function is called when there is no valid checkpoint on the flash any
+ * more, or when taking one failed. It makes the held PEBs free again and lets
+ * the deferred erasures happen.
+ */
+void ubi_wl_ckpt_release(struct ubi_device *ubi)
+{
+	struct rb_node *rb;
+	struct ubi_wl_entry *e;
+
+	spin_lock(&ubi->wl_lock);
+	ubi->ckpt_active = 0;
+	ubi->ckpt_defer_all = 0;
+	while ((rb = rb_first(&ubi->ckpt_held))) {
+		e = rb_entry(rb, struct ubi_wl_entry, u.rb);
+		rb_erase(rb, &ubi->ckpt_held);
+		wl_tree_add(e, &ubi->free);
+	}
+	ckpt_requeue(ubi, 1);
+	spin_unlock(&ubi->wl_lock);
+}
+
+#endif /* CONFIG_MTD_UBI_CHECKPOINT */
+
 #ifdef CONFIG_MTD_UBI_DEBUG_PARANOID
 
 /**
@@ -24,10 +24,15 @@
 #include <linux/device.h>
 #include <linux/genhd.h>
 #include <linux/highmem.h>
+#include <linux/jhash.h>
+#include <linux/log2.h>
 #include <linux/slab.h>
 #include <linux/lzo.h>
+#include <linux/math64.h>
+#include <linux/percpu.h>
 #include <linux/string.h>
 #include <linux/vmalloc.h>
+#include <linux/bit_spinlock.h>
 
 #include "zram_drv.h"
 
@@ -38,14 +43,14 @@ struct zram *devices;
 /* Module params (documentation at end) */
 unsigned int num_devices;
 
-static void zram_stat_inc(u32 *v)
+static void zram_stat_inc(atomic_t *v)
 {
-	*v = *v + 1;
+	atomic_inc(v);
 }
 
-static void zram_stat_dec(u32 *v)
+static void zram_stat_dec(atomic_t *v)
 {
-	*v = *v - 1;
+	atomic_dec(v);
 }
 
 static void zram_stat64_add(struct zram *zram, u64 *v, u64 inc)
@@ -85,21 +90,136 @@ static void zram_clear_flag(struct zram *zram, u32 index,
 	zram->table[index].flags &= ~BIT(flag);
 }
 
-static int page_zero_filled(void *ptr)
+/*
+ * The table entry of a page, flags included, is protected by a bit lock
+ * in its flags: reads, writes and swap slot frees of a page may run
+ * concurrently with each other and with writeback.
+ */
+static void zram_slot_lock(struct zram *zram, u32 index)
+{
+	bit_spin_lock(ZRAM_LOCK, &zram->table[index].flags);
+}
+
+static void zram_slot_unlock(struct zram *zram, u32 index)
+{
+	bit_spin_unlock(ZRAM_LOCK, &zram->table[index].flags);
+}
+
+/* Seconds since boot, for table[].ac_time */
+static u32 zram_now(void)
+{
+	return div_u64(get_jiffies_64(), HZ);
+}
+
+/*
+ * Check whether the page is one word repeated, and return that word.
+ * Words are checked four at a time to keep the loop cheap for the
+ * common case of a page that is not same filled: it fails early.
+ */
+static int page_same_filled(void *ptr, unsigned long *element)
 {
 	unsigned int pos;
 	unsigned long *page;
+	unsigned long val;
 
 	page = (unsigned long *)ptr;
+	val = page[0];
 
-	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos++) {
-		if (page[pos])
+	for (pos = 0; pos != PAGE_SIZE / sizeof(*page); pos += 4) {
+		if ((page[pos] ^ val) | (page[pos + 1] ^ val) |
+		    (page[pos + 2] ^ val) | (page[pos + 3] ^ val))
 			return 0;
 	}
 
+	*element = val;
 	return 1;
 }
 
+static void zram_entry_put(struct zram *zram, struct zram_entry *entry)
+{
+	int last;
+
+	spin_lock(&zram->hash_lock);
+	last = !--entry->refcount;
+	if (last)
+		hlist_del(&entry->node);
+	spin_unlock(&zram->hash_lock);
+
+	if (!last)
+		return;
+
+	zram_stat64_sub(zram, &zram->stats.compr_size, entry->len);
+	zs_free(zram->mem_pool, entry->handle);
+	kfree(entry);
+}
+
+static int zram_dedup_match(struct zram *zram, struct zram_entry *entry,
+				void *mem)
+{
+	unsigned char *cmem;
+	int match;
+
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
+	match = !memcmp(cmem, mem, entry->len);
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	return match;
+}
+
+/*
+ * Find a stored object with the given data and take a reference on it.
+ *
+ * The data is compared without hash_lock held: each candidate is
+ * pinned with a reference first, which also keeps it on the hash chain
+ * so that the walk can go on from it if the data differs.
+ */
+static struct zram_entry *zram_dedup_get(struct zram *zram, void *mem,
+				u32 len, u32 checksum)
+{
+	struct hlist_node *pos;
+	struct zram_entry *entry, *prev = NULL;
+
+	spin_lock(&zram->hash_lock);
+	pos = zram->hash[checksum & (zram->hash_size - 1)].first;
+	while (pos) {
+		entry = hlist_entry(pos, struct zram_entry, node);
+		if (entry->checksum != checksum || entry->len != len ||
+				entry->refcount == UINT_MAX) {
+			pos = pos->next;
+			continue;
+		}
+
+		entry->refcount++;
+		spin_unlock(&zram->hash_lock);
+
+		if (prev)
+			zram_entry_put(zram, prev);
+		if (zram_dedup_match(zram, entry, mem))
+			return entry;
+		prev = entry;
+
+		spin_lock(&zram->hash_lock);
+		pos = entry->node.next;
+	}
+	spin_unlock(&zram->hash_lock);
+
+	if (prev)
+		zram_entry_put(zram, prev);
+
+	return NULL;
+}
+
+static void zram_dedup_insert(struct zram *zram, struct zram_entry *entry)
+{
+	struct hlist_head *head;
+
+	head = &zram->hash[entry->checksum & (zram->hash_size - 1)];
+
+	spin_lock(&zram->hash_lock);
+	hlist_add_head(&entry->node, head);
+	spin_unlock(&zram->hash_lock);
+}
+
 static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 {
 	if (!zram->disksize) {
@@ -129,75 +249,178 @@ static void zram_set_disksize(struct zram *zram, size_t totalram_bytes)
 	zram->disksize &= PAGE_MASK;
 }
 
+/* Called with the slot locked */
 static void zram_free_page(struct zram *zram, size_t index)
 {
-	u32 clen;
-	void *obj;
+	struct zram_entry *entry;
 
-	struct page *page = zram->table[index].page;
-	u32 offset = zram->table[index].offset;
+	/* Tells a writeback in progress that the page has gone */
+	zram_clear_flag(zram, index, ZRAM_UNDER_WB);
 
-	if (unlikely(!page)) {
-		/*
-		 * No memory is allocated for zero filled pages.
-		 * Simply clear zero page flag.
-		 */
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			zram_clear_flag(zram, index, ZRAM_ZERO);
-			zram_stat_dec(&zram->stats.pages_zero);
-		}
+	if (zram_test_flag(zram, index, ZRAM_WB)) {
+		zram_clear_flag(zram, index, ZRAM_WB);
+		clear_bit(zram->table[index].blk_idx, zram->bd_bitmap);
+		zram_stat_dec(&zram->stats.pages_wb);
+		zram->table[index].blk_idx = 0;
 		return;
 	}
 
-	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-		clen = PAGE_SIZE;
-		__free_page(page);
-		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
-		zram_stat_dec(&zram->stats.pages_expand);
-		goto out;
+	/*
+	 * No memory is allocated for same filled pages.
+	 * Simply clear the flag.
+	 */
+	if (zram_test_flag(zram, index, ZRAM_ZERO)) {
+		zram_clear_flag(zram, index, ZRAM_ZERO);
+		zram_stat_dec(&zram->stats.pages_zero);
+		return;
+	}
+
+	if (zram_test_flag(zram, index, ZRAM_SAME)) {
+		zram_clear_flag(zram, index, ZRAM_SAME);
+		zram_stat_dec(&zram->stats.pages_same);
+		zram->table[index].element = 0;
+		return;
 	}
 
-	obj = kmap_atomic(page, KM_USER0) + offset;
-	clen = xv_get_object_size(obj) - sizeof(struct zobj_header);
-	kunmap_atomic(obj, KM_USER0);
+	entry = zram->table[index].entry;
+	if (unlikely(!entry))
+		return;
 
-	xv_free(zram->mem_pool, page, offset);
-	if (clen <= PAGE_SIZE / 2)
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
+		zram_clear_flag(zram, index, ZRAM_UNCOMPRESSED);
+		zram_stat_dec(&zram->stats.pages_expand);
+	} else if (entry->len <= PAGE_SIZE / 2) {
 		zram_stat_dec(&zram->stats.good_compress);
+	}
 
-out:
-	zram_stat64_sub(zram, &zram->stats.compr_size, clen);
+	zram_entry_put(zram, entry);
 	zram_stat_dec(&zram->stats.pages_stored);
 
-	zram->table[index].page = NULL;
-	zram->table[index].offset = 0;
+	zram->table[index].entry = NULL;
 }
 
-static void handle_zero_page(struct page *page)
+static void handle_same_page(struct page *page, unsigned long element)
 {
-	void *user_mem;
+	unsigned long *user_mem;
+	unsigned int pos;
 
 	user_mem = kmap_atomic(page, KM_USER0);
-	memset(user_mem, 0, PAGE_SIZE);
+	if (!element) {
+		memset(user_mem, 0, PAGE_SIZE);
+	} else {
+		for (pos = 0; pos != PAGE_SIZE / sizeof(*user_mem); pos++)
+			user_mem[pos] = element;
+	}
 	kunmap_atomic(user_mem, KM_USER0);
 
 	flush_dcache_page(page);
 }
 
-static void handle_uncompressed_page(struct zram *zram,
-				struct page *page, u32 index)
+/* Decompress the page at index into mem. Called with the slot locked. */
+static int zram_decompress_page(struct zram *zram, u32 index, void *mem)
 {
-	unsigned char *user_mem, *cmem;
+	struct zram_entry *entry = zram->table[index].entry;
+	unsigned char *cmem;
+	size_t clen = PAGE_SIZE;
+	int ret = LZO_E_OK;
 
-	user_mem = kmap_atomic(page, KM_USER0);
-	cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-			zram->table[index].offset;
+	cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_RO);
 
-	memcpy(user_mem, cmem, PAGE_SIZE);
-	kunmap_atomic(user_mem, KM_USER0);
-	kunmap_atomic(cmem, KM_USER1);
+	/* Page is stored uncompressed since it's incompressible */
+	if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
+		memcpy(mem, cmem, PAGE_SIZE);
+	else
+		ret = lzo1x_decompress_safe(cmem, entry->len, mem, &clen);
 
-	flush_dcache_page(page);
+	zs_unmap_object(zram->mem_pool, entry->handle);
+
+	return ret;
+}
+
+/*
+ * Pages of a read that are on the backing device are read by bios of
+ * their own, which are only submitted once zram_make_request() returns.
+ * The original bio completes when the last of them does.
+ *
+ * Those bios come from bd_bio_set, whose reserve holds enough bios for
+ * the largest request. Requests take their bios under bd_read_lock, so
+ * each one can get all of them from the reserve once the bios of the
+ * previous one, already submitted, have completed.
+ */
+struct zram_bd_read {
+	struct bio *parent;
+	atomic_t pending;
+	int error;
+};
+
+static void zram_bd_read_put(struct zram_bd_read *rd)
+{
+	if (!atomic_dec_and_test(&rd->pending))
+		return;
+
+	bio_endio(rd->parent, rd->error);
+	kfree(rd);
+}
+
+static void zram_bd_read_end_io(struct bio *bio, int error)
+{
+	struct zram_bd_read *rd = bio->bi_private;
+
+	if (error)
+		rd->error = error;
+	else
+		flush_dcache_page(bio->bi_io_vec[0].bv_page);
+
+	bio_put(bio);
+	zram_bd_read_put(rd);
+}
+
+/* bd_bio_set keeps the struct zram * in front of each bio */
+static void zram_bd_bio_destructor(struct bio *bio)
+{
+	struct zram **zramp = (void *)bio;
+
+	bio_free(bio, zramp[-1]->bd_bio_set);
+}
+
+static int zram_bd_read(struct zram *zram, struct zram_bd_read **rdp,
+			struct bio *parent, struct page *page,
+			unsigned long blk_idx)
+{
+	struct zram_bd_read *rd = *rdp;
+	struct zram **zramp;
+	struct bio *bio;
+
+	if (!rd) {
+		rd = kmalloc(sizeof(*rd), GFP_NOIO);
+		if (!rd)
+			return -ENOMEM;
+
+		rd->parent = parent;
+		atomic_set(&rd->pending, 1);
+		rd->error = 0;
+		*rdp = rd;
+		mutex_lock(&zram->bd_read_lock);
+	}
+
+	bio = bio_alloc_bioset(GFP_NOIO, 1, zram->bd_bio_set);
+	zramp = (void *)bio;
+	zramp[-1] = zram;
+	bio->bi_destructor = zram_bd_bio_destructor;
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = blk_idx << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_end_io = zram_bd_read_end_io;
+	bio->bi_private = rd;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	atomic_inc(&rd->pending);
+	zram_stat64_inc(zram, &zram->stats.bd_reads);
+	submit_bio(READ, bio);
+
+	return 0;
 }
 
 static int zram_read(struct zram *zram, struct bio *bio)
@@ -206,6 +429,7 @@ static int zram_read(struct zram *zram, struct bio *bio)
 	int i;
 	u32 index;
 	struct bio_vec *bvec;
+	struct zram_bd_read *rd = NULL;
 
 	if (unlikely(!zram->init_done)) {
 		set_bit(BIO_UPTODATE, &bio->bi_flags);
@@ -218,48 +442,50 @@ static int zram_read(struct zram *zram, struct bio *bio)
 
 	bio_for_each_segment(bvec, bio, i) {
 		int ret;
-		size_t clen;
+		unsigned long element, blk_idx;
 		struct page *page;
-		struct zobj_header *zheader;
-		unsigned char *user_mem, *cmem;
+		unsigned char *user_mem;
 
 		page = bvec->bv_page;
 
-		if (zram_test_flag(zram, index, ZRAM_ZERO)) {
-			handle_zero_page(page);
+		zram_slot_lock(zram, index);
+
+		if (zram_test_flag(zram, index, ZRAM_ZERO) ||
+				zram_test_flag(zram, index, ZRAM_SAME)) {
+			element = zram->table[index].element;
+			zram_slot_unlock(zram, index);
+			handle_same_page(page, element);
 			index++;
 			continue;
 		}
 
-		/* Requested page is not present in compressed area */
-		if (unlikely(!zram->table[index].page)) {
-			pr_debug("Read before write: sector=%lu, size=%u",
-				(ulong)(bio->bi_sector), bio->bi_size);
-			/* Do nothing */
+		if (zram_test_flag(zram, index, ZRAM_WB)) {
+			blk_idx = zram->table[index].blk_idx;
+			zram_slot_unlock(zram, index);
+			if (zram_bd_read(zram, &rd, bio, page, blk_idx)) {
+				zram_stat64_inc(zram, &zram->stats.failed_reads);
+				goto out;
+			}
 			index++;
 			continue;
 		}
 
-		/* Page is stored uncompressed since it's incompressible */
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))) {
-			handle_uncompressed_page(zram, page, index);
+		/* Requested page is not present in compressed area */
+		if (unlikely(!zram->table[index].entry)) {
+			zram_slot_unlock(zram, index);
+			pr_debug("Read before write: sector=%lu, size=%u",
+				(ulong)(bio->bi_sector), bio->bi_size);
+			/* Do nothing */
 			index++;
 			continue;
 		}
 
 		user_mem = kmap_atomic(page, KM_USER0);
-		clen = PAGE_SIZE;
-
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
-
-		ret = lzo1x_decompress_safe(
-			cmem + sizeof(*zheader),
-			xv_get_object_size(cmem) - sizeof(*zheader),
-			user_mem, &clen);
-
+		ret = zram_decompress_page(zram, index, user_mem);
 		kunmap_atomic(user_mem, KM_USER0);
-		kunmap_atomic(cmem, KM_USER1);
+
+		zram->table[index].ac_time = zram_now();
+		zram_slot_unlock(zram, index);
 
 		/* Should NEVER happen. Return bio error if it does. */
 		if (unlikely(ret != LZO_E_OK)) {
@@ -274,14 +500,48 @@ static int zram_read(struct zram *zram, struct bio *bio)
 	}
 
 	set_bit(BIO_UPTODATE, &bio->bi_flags);
-	bio_endio(bio, 0);
+	if (rd) {
+		mutex_unlock(&zram->bd_read_lock);
+		zram_bd_read_put(rd);
+	} else {
+		bio_endio(bio, 0);
+	}
 	return 0;
 
 out:
-	bio_io_error(bio);
+	if (rd) {
+		mutex_unlock(&zram->bd_read_lock);
+		rd->error = -EIO;
+		zram_bd_read_put(rd);
+	} else {
+		bio_io_error(bio);
+	}
 	return 0;
 }
 
+/*
+ * Take the compression stream of the CPU we are running on. Writers that
+ * share a CPU serialize on its stream, which is still far less contention
+ * than a single per-device buffer.
+ */
+static struct zram_stream *zram_get_stream(struct zram *zram)
+{
+	struct zram_stream *zstrm;
+
+	zstrm = per_cpu_ptr(zram->streams, raw_smp_processor_id());
+	if (!mutex_trylock(&zstrm->lock)) {
+		zram_stat64_inc(zram, &zram->stats.stream_waits);
+		mutex_lock(&zstrm->lock);
+	}
+
+	return zstrm;
+}
+
+static void zram_put_stream(struct zram_stream *zstrm)
+{
+	mutex_unlock(&zstrm->lock);
+}
+
 static int zram_write(struct zram *zram, struct bio *bio)
 {
 	int i, ret;
@@ -298,110 +558,115 @@ static int zram_write(struct zram *zram, struct bio *bio)
 	index = bio->bi_sector >> SECTORS_PER_PAGE_SHIFT;
 
 	bio_for_each_segment(bvec, bio, i) {
-		u32 offset;
 		size_t clen;
-		struct zobj_header *zheader;
-		struct page *page, *page_store;
+		u32 checksum;
+		unsigned long element;
+		struct page *page;
+		struct zram_entry *entry;
+		struct zram_stream *zstrm;
 		unsigned char *user_mem, *cmem, *src;
 
 		page = bvec->bv_page;
-		src = zram->compress_buffer;
-
-		/*
-		 * System overwrites unused sectors. Free memory associated
-		 * with this sector now.
-		 */
-		if (zram->table[index].page ||
-				zram_test_flag(zram, index, ZRAM_ZERO))
-			zram_free_page(zram, index);
-
-		mutex_lock(&zram->lock);
 
 		user_mem = kmap_atomic(page, KM_USER0);
-		if (page_zero_filled(user_mem)) {
+		if (page_same_filled(user_mem, &element)) {
 			kunmap_atomic(user_mem, KM_USER0);
-			mutex_unlock(&zram->lock);
-			zram_stat_inc(&zram->stats.pages_zero);
-			zram_set_flag(zram, index, ZRAM_ZERO);
+
+			zram_slot_lock(zram, index);
+			zram_free_page(zram, index);
+			if (!element) {
+				zram_stat_inc(&zram->stats.pages_zero);
+				zram_set_flag(zram, index, ZRAM_ZERO);
+			} else {
+				zram_stat_inc(&zram->stats.pages_same);
+				zram_set_flag(zram, index, ZRAM_SAME);
+				zram->table[index].element = element;
+			}
+			zram_slot_unlock(zram, index);
+
 			index++;
 			continue;
 		}
+		kunmap_atomic(user_mem, KM_USER0);
+
+		zstrm = zram_get_stream(zram);
+		src = zstrm->buffer;
 
+		user_mem = kmap_atomic(page, KM_USER0);
 		ret = lzo1x_1_compress(user_mem, PAGE_SIZE, src, &clen,
-					zram->compress_workmem);
+					zstrm->workmem);
+
+		/*
+		 * Page is incompressible. Store it as-is (uncompressed)
+		 * since we do not want to return too many disk write
+		 * errors which has side effect of hanging the system.
+		 */
+		if (ret == LZO_E_OK && unlikely(clen > max_zpage_size)) {
+			clen = PAGE_SIZE;
+			memcpy(src, user_mem, PAGE_SIZE);
+		}
 
 		kunmap_atomic(user_mem, KM_USER0);
 
 		if (unlikely(ret != LZO_E_OK)) {
-			mutex_unlock(&zram->lock);
+			zram_put_stream(zstrm);
 			pr_err("Compression failed! err=%d\n", ret);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
 		}
 
-		/*
-		 * Page is incompressible. Store it as-is (uncompressed)
-		 * since we do not want to return too many disk write
-		 * errors which has side effect of hanging the system.
-		 */
-		if (unlikely(clen > max_zpage_size)) {
-			clen = PAGE_SIZE;
-			page_store = alloc_page(GFP_NOIO | __GFP_HIGHMEM);
-			if (unlikely(!page_store)) {
-				mutex_unlock(&zram->lock);
-				pr_info("Error allocating memory for "
-					"incompressible page: %u\n", index);
-				zram_stat64_inc(zram,
-					&zram->stats.failed_writes);
-				goto out;
-			}
-
-			offset = 0;
-			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
-			zram_stat_inc(&zram->stats.pages_expand);
-			zram->table[index].page = page_store;
-			src = kmap_atomic(page, KM_USER0);
-			goto memstore;
+		/* Share the object of an identical page if there is one */
+		checksum = jhash(src, clen, 0);
+		entry = zram_dedup_get(zram, src, clen, checksum);
+		if (entry) {
+			zram_stat64_inc(zram, &zram->stats.dedup_hits);
+			goto found;
 		}
 
-		if (xv_malloc(zram->mem_pool, clen + sizeof(*zheader),
-				&zram->table[index].page, &offset,
-				GFP_NOIO | __GFP_HIGHMEM)) {
-			mutex_unlock(&zram->lock);
+		entry = kmalloc(sizeof(*entry), GFP_NOIO);
+		if (likely(entry))
+			entry->handle = zs_malloc(zram->mem_pool, clen,
+						GFP_NOIO | __GFP_HIGHMEM);
+		if (unlikely(!entry || !entry->handle)) {
+			kfree(entry);
+			zram_put_stream(zstrm);
 			pr_info("Error allocating memory for compressed "
 				"page: %u, size=%zu\n", index, clen);
 			zram_stat64_inc(zram, &zram->stats.failed_writes);
 			goto out;
 		}
 
-memstore:
-		zram->table[index].offset = offset;
+		cmem = zs_map_object(zram->mem_pool, entry->handle, ZS_MM_WO);
+		memcpy(cmem, src, clen);
+		zs_unmap_object(zram->mem_pool, entry->handle);
 
-		cmem = kmap_atomic(zram->table[index].page, KM_USER1) +
-				zram->table[index].offset;
+		entry->checksum = checksum;
+		entry->len = clen;
+		entry->refcount = 1;
+		zram_dedup_insert(zram, entry);
+		zram_stat64_add(zram, &zram->stats.compr_size, clen);
 
-#if 0
-		/* Back-reference needed for memory defragmentation */
-		if (!zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)) {
-			zheader = (struct zobj_header *)cmem;
-			zheader->table_idx = index;
-			cmem += sizeof(*zheader);
+found:
+		/*
+		 * System overwrites unused sectors. Free memory associated
+		 * with this sector now.
+		 */
+		zram_slot_lock(zram, index);
+		zram_free_page(zram, index);
+		if (unlikely(clen == PAGE_SIZE)) {
+			zram_set_flag(zram, index, ZRAM_UNCOMPRESSED);
+			zram_stat_inc(&zram->stats.pages_expand);
 		}
-#endif
-
-		memcpy(cmem, src, clen);
-
-		kunmap_atomic(cmem, KM_USER1);
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			kunmap_atomic(src, KM_USER0);
+		zram->table[index].entry = entry;
+		zram->table[index].ac_time = zram_now();
+		zram_slot_unlock(zram, index);
 
 		/* Update stats */
-		zram_stat64_add(zram, &zram->stats.compr_size, clen);
 		zram_stat_inc(&zram->stats.pages_stored);
 		if (clen <= PAGE_SIZE / 2)
 			zram_stat_inc(&zram->stats.good_compress);
 
-		mutex_unlock(&zram->lock);
+		zram_put_stream(zstrm);
 		index++;
 	}
 
@@ -458,47 +723,97 @@ static int zram_make_request(struct request_queue *queue, struct bio *bio)
 	return ret;
 }
 
-void zram_reset_device(struct zram *zram)
+static void zram_free_streams(struct zram *zram)
 {
-	size_t index;
+	int cpu;
 
-	mutex_lock(&zram->init_lock);
-	zram->init_done = 0;
+	if (!zram->streams)
+		return;
 
-	/* Free various per-device buffers */
-	kfree(zram->compress_workmem);
-	free_pages((unsigned long)zram->compress_buffer, 1);
+	for_each_possible_cpu(cpu) {
+		struct zram_stream *zstrm = per_cpu_ptr(zram->streams, cpu);
+
+		kfree(zstrm->workmem);
+		free_pages((unsigned long)zstrm->buffer, 1);
+	}
 
-	zram->compress_workmem = NULL;
-	zram->compress_buffer = NULL;
+	free_percpu(zram->streams);
+	zram->streams = NULL;
+}
 
-	/* Free all pages that are still in this zram device */
-	for (index = 0; index < zram->disksize >> PAGE_SHIFT; index++) {
-		struct page *page;
-		u16 offset;
+static int zram_alloc_streams(struct zram *zram)
+{
+	int cpu;
 
-		page = zram->table[index].page;
-		offset = zram->table[index].offset;
+	zram->streams = alloc_percpu(struct zram_stream);
+	if (!zram->streams)
+		return -ENOMEM;
 
-		if (!page)
-			continue;
+	for_each_possible_cpu(cpu) {
+		struct zram_stream *zstrm = per_cpu_ptr(zram->streams, cpu);
+
+		mutex_init(&zstrm->lock);
+		zstrm->workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
+		zstrm->buffer = (void *)__get_free_pages(GFP_KERNEL |
+							 __GFP_ZERO, 1);
+		if (!zstrm->workmem || !zstrm->buffer)
+			return -ENOMEM;
+	}
+
+	return 0;
+}
+
+static void zram_free_hash(struct zram *zram)
+{
+	unsigned int i;
+
+	if (!zram->hash)
+		return;
+
+	/* The objects themselves go away with the pool */
+	for (i = 0; i < zram->hash_size; i++) {
+		struct zram_entry *entry;
+		struct hlist_node *pos, *n;
 
-		if (unlikely(zram_test_flag(zram, index, ZRAM_UNCOMPRESSED)))
-			__free_page(page);
-		else
-			xv_free(zram->mem_pool, page, offset);
+		hlist_for_each_entry_safe(entry, pos, n, &zram->hash[i], node)
+			kfree(entry);
 	}
 
+	vfree(zram->hash);
+	zram->hash = NULL;
+	zram->hash_size = 0;
+}
+
+void zram_reset_device(struct zram *zram)
+{
+	mutex_lock(&zram->init_lock);
+	zram->init_done = 0;
+
+	/* Wait for writeback, which stops once it sees init_done clear */
+	down_write(&zram->wb_sem);
+
+	/* Free various per-device buffers */
+	zram_free_streams(zram);
+
+	zram_free_hash(zram);
+
 	vfree(zram->table);
 	zram->table = NULL;
 
-	xv_destroy_pool(zram->mem_pool);
+	/* Frees all objects still stored in this zram device */
+	if (zram->mem_pool)
+		zs_destroy_pool(zram->mem_pool);
 	zram->mem_pool = NULL;
 
+	/* The backing device stays set, but none of its blocks are in use */
+	if (zram->bdev)
+		bitmap_zero(zram->bd_bitmap, zram->bd_nr_blocks);
+
 	/* Reset stats */
 	memset(&zram->stats, 0, sizeof(zram->stats));
 
 	zram->disksize = 0;
+	up_write(&zram->wb_sem);
 	mutex_unlock(&zram->init_lock);
 }
 
@@ -516,17 +831,9 @@ int zram_init_device(struct zram *zram)
 
 	zram_set_disksize(zram, totalram_pages << PAGE_SHIFT);
 
-	zram->compress_workmem = kzalloc(LZO1X_MEM_COMPRESS, GFP_KERNEL);
-	if (!zram->compress_workmem) {
-		pr_err("Error allocating compressor working memory!\n");
-		ret = -ENOMEM;
-		goto fail;
-	}
-
-	zram->compress_buffer = (void *)__get_free_pages(__GFP_ZERO, 1);
-	if (!zram->compress_buffer) {
-		pr_err("Error allocating compressor buffer space\n");
-		ret = -ENOMEM;
+	ret = zram_alloc_streams(zram);
+	if (ret) {
+		pr_err("Error allocating compression streams\n");
 		goto fail;
 	}
 
@@ -541,12 +848,22 @@ int zram_init_device(struct zram *zram)
 	}
 	memset(zram->table, 0, num_pages * sizeof(*zram->table));
 
+	/* About one hash bucket for every four disk pages */
+	zram->hash_size = roundup_pow_of_two(max_t(size_t, num_pages / 4, 1));
+	zram->hash = vmalloc(zram->hash_size * sizeof(*zram->hash));
+	if (!zram->hash) {
+		pr_err("Error allocating dedup hash table\n");
+		ret = -ENOMEM;
+		goto fail;
+	}
+	memset(zram->hash, 0, zram->hash_size * sizeof(*zram->hash));
+
 	set_capacity(zram->disk, zram->disksize >> SECTOR_SHIFT);
 
 	/* zram devices sort of resembles non-rotational disks */
 	queue_flag_set_unlocked(QUEUE_FLAG_NONROT, zram->disk->queue);
 
-	zram->mem_pool = xv_create_pool();
+	zram->mem_pool = zs_create_pool(zram->disk->disk_name);
 	if (!zram->mem_pool) {
 		pr_err("Error creating memory pool\n");
 		ret = -ENOMEM;
@@ -567,12 +884,254 @@ fail:
 	return ret;
 }
 
+/* Called with init_lock held, or on module exit */
+void zram_close_backing_dev(struct zram *zram)
+{
+	if (!zram->bdev)
+		return;
+
+	close_bdev_exclusive(zram->bdev, FMODE_READ | FMODE_WRITE);
+	bioset_free(zram->bd_bio_set);
+	vfree(zram->bd_bitmap);
+	kfree(zram->backing_dev);
+
+	zram->bdev = NULL;
+	zram->bd_bio_set = NULL;
+	zram->bd_bitmap = NULL;
+	zram->bd_nr_blocks = 0;
+	zram->backing_dev = NULL;
+}
+
+/*
+ * Set the block device that zram_writeback() writes pages to, or none
+ * if path is "none". Only possible before the device is initialized.
+ */
+int zram_set_backing_dev(struct zram *zram, const char *path)
+{
+	struct block_device *bdev;
+	struct bio_set *bs;
+	unsigned long nr_blocks, *bitmap;
+	char *name;
+	int ret = 0;
+
+	mutex_lock(&zram->init_lock);
+
+	if (zram->init_done) {
+		pr_info("Cannot change backing device for initialized "
+			"device\n");
+		ret = -EBUSY;
+		goto out;
+	}
+
+	zram_close_backing_dev(zram);
+	if (!strcmp(path, "none"))
+		goto out;
+
+	bdev = open_bdev_exclusive(path, FMODE_READ | FMODE_WRITE, zram);
+	if (IS_ERR(bdev)) {
+		ret = PTR_ERR(bdev);
+		goto out;
+	}
+
+	nr_blocks = i_size_read(bdev->bd_inode) >> PAGE_SHIFT;
+	bitmap = vzalloc(BITS_TO_LONGS(nr_blocks) * sizeof(long));
+	name = kstrdup(path, GFP_KERNEL);
+	/* A bio for every page of the largest request */
+	bs = bioset_create(queue_max_hw_sectors(zram->queue) >>
+			   SECTORS_PER_PAGE_SHIFT, sizeof(struct zram *));
+	if (!nr_blocks || !bitmap || !name || !bs) {
+		if (bs)
+			bioset_free(bs);
+		vfree(bitmap);
+		kfree(name);
+		close_bdev_exclusive(bdev, FMODE_READ | FMODE_WRITE);
+		ret = nr_blocks ? -ENOMEM : -EINVAL;
+		goto out;
+	}
+
+	zram->bdev = bdev;
+	zram->bd_bio_set = bs;
+	zram->bd_bitmap = bitmap;
+	zram->bd_nr_blocks = nr_blocks;
+	zram->backing_dev = name;
+
+	pr_info("%s: backing device %s, %lu pages\n",
+		zram->disk->disk_name, name, nr_blocks);
+
+out:
+	mutex_unlock(&zram->init_lock);
+	return ret;
+}
+
+static void zram_bd_end_io_sync(struct bio *bio, int error)
+{
+	complete(bio->bi_private);
+}
+
+static int zram_bd_write_page(struct zram *zram, struct page *page,
+			unsigned long blk_idx)
+{
+	DECLARE_COMPLETION_ONSTACK(done);
+	struct bio *bio;
+	int ret;
+
+	bio = bio_alloc(GFP_KERNEL, 1);
+	bio->bi_bdev = zram->bdev;
+	bio->bi_sector = blk_idx << SECTORS_PER_PAGE_SHIFT;
+	bio->bi_end_io = zram_bd_end_io_sync;
+	bio->bi_private = &done;
+	if (!bio_add_page(bio, page, PAGE_SIZE, 0)) {
+		bio_put(bio);
+		return -EIO;
+	}
+
+	submit_bio(WRITE, bio);
+	wait_for_completion(&done);
+
+	ret = test_bit(BIO_UPTODATE, &bio->bi_flags) ? 0 : -EIO;
+	bio_put(bio);
+
+	return ret;
+}
+
+/*
+ * Find a free block on the backing device and mark it used. Returns
+ * bd_nr_blocks if there is none.
+ */
+static unsigned long zram_bd_alloc_block(struct zram *zram)
+{
+	unsigned long blk_idx;
+
+	do {
+		blk_idx = find_first_zero_bit(zram->bd_bitmap,
+					zram->bd_nr_blocks);
+		if (blk_idx >= zram->bd_nr_blocks)
+			break;
+	} while (test_and_set_bit(blk_idx, zram->bd_bitmap));
+
+	return blk_idx;
+}
+
+/* Called with the slot locked */
+static int zram_wb_candidate(struct zram *zram, u32 index, int mode, u32 now)
+{
+	if (zram_test_flag(zram, index, ZRAM_ZERO) ||
+			zram_test_flag(zram, index, ZRAM_SAME) ||
+			zram_test_flag(zram, index, ZRAM_WB) ||
+			zram_test_flag(zram, index, ZRAM_UNDER_WB) ||
+			!zram->table[index].entry)
+		return 0;
+
+	if ((mode & ZRAM_WB_INCOMPRESSIBLE) &&
+			zram_test_flag(zram, index, ZRAM_UNCOMPRESSED))
+		return 1;
+
+	if ((mode & ZRAM_WB_IDLE) &&
+			now - zram->table[index].ac_time >= zram->idle_age)
+		return 1;
+
+	return 0;
+}
+
+/*
+ * Write incompressible and/or idle pages, as selected by mode, to the
+ * backing device and free their memory. They are read back from there
+ * when accessed.
+ *
+ * init_lock is only held to check the device and take wb_sem, which
+ * keeps the table and the backing device from being freed under us.
+ * The device can be used meanwhile; a reset makes us stop early.
+ */
+int zram_writeback(struct zram *zram, int mode)
+{
+	size_t index, num_pages;
+	struct page *page;
+	u32 now = zram_now();
+	int ret = 0;
+
+	mutex_lock(&zram->init_lock);
+	if (!zram->init_done || !zram->bdev) {
+		mutex_unlock(&zram->init_lock);
+		return -EINVAL;
+	}
+	down_read(&zram->wb_sem);
+	num_pages = zram->disksize >> PAGE_SHIFT;
+	mutex_unlock(&zram->init_lock);
+
+	page = alloc_page(GFP_KERNEL);
+	if (!page) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	for (index = 0; index < num_pages && zram->init_done; index++) {
+		unsigned long blk_idx;
+		void *mem;
+		int err;
+
+		zram_slot_lock(zram, index);
+		if (!zram_wb_candidate(zram, index, mode, now)) {
+			zram_slot_unlock(zram, index);
+			continue;
+		}
+
+		mem = kmap_atomic(page, KM_USER0);
+		err = zram_decompress_page(zram, index, mem);
+		kunmap_atomic(mem, KM_USER0);
+		if (unlikely(err != LZO_E_OK)) {
+			zram_slot_unlock(zram, index);
+			continue;
+		}
+
+		zram_set_flag(zram, index, ZRAM_UNDER_WB);
+		zram_slot_unlock(zram, index);
+
+		blk_idx = zram_bd_alloc_block(zram);
+		if (blk_idx < zram->bd_nr_blocks) {
+			err = zram_bd_write_page(zram, page, blk_idx);
+		} else {
+			err = -ENOSPC;
+		}
+
+		zram_slot_lock(zram, index);
+
+		/* Failed, or the page was freed or rewritten meanwhile */
+		if (err || !zram_test_flag(zram, index, ZRAM_UNDER_WB)) {
+			zram_clear_flag(zram, index, ZRAM_UNDER_WB);
+			zram_slot_unlock(zram, index);
+			if (blk_idx < zram->bd_nr_blocks)
+				clear_bit(blk_idx, zram->bd_bitmap);
+			if (err) {
+				ret = err;
+				break;
+			}
+			continue;
+		}
+
+		zram_free_page(zram, index);
+		zram_set_flag(zram, index, ZRAM_WB);
+		zram->table[index].blk_idx = blk_idx;
+		zram_slot_unlock(zram, index);
+
+		zram_stat_inc(&zram->stats.pages_wb);
+		zram_stat64_inc(zram, &zram->stats.bd_writes);
+		cond_resched();
+	}
+
+	__free_page(page);
+out:
+	up_read(&zram->wb_sem);
+	return ret;
+}
+
 void zram_slot_free_notify(struct block_device *bdev, unsigned long index)
 {
 	struct zram *zram;
 
 	zram = bdev->bd_disk->private_data;
+	zram_slot_lock(zram, index);
 	zram_free_page(zram, index);
+	zram_slot_unlock(zram, index);
 	zram_stat64_inc(zram, &zram->stats.notify_free);
 }
 
@@ -585,8 +1144,11 @@ static int create_device(struct zram *zram, int device_id)
 {
 	int ret = 0;
 
-	mutex_init(&zram->lock);
 	mutex_init(&zram->init_lock);
+	mutex_init(&zram->bd_read_lock);
+	init_rwsem(&zram->wb_sem);
+	spin_lock_init(&zram->hash_lock);
+	zram->idle_age = default_idle_age;
 	spin_lock_init(&zram->stat64_lock);
 
 	zram->queue = blk_alloc_queue(GFP_KERNEL);
@@ -722,6 +1284,7 @@ static void __exit zram_exit(void)
 		destroy_device(zram);
 		if (zram->init_done)
 			zram_reset_device(zram);
+		zram_close_backing_dev(zram);
 	}
 
 	unregister_blkdev(zram_major, "zram");
@@ -17,8 +17,9 @@
 
 #include <linux/spinlock.h>
 #include <linux/mutex.h>
+#include <linux/rwsem.h>
 
-#include "xvmalloc.h"
+#include "zsmalloc.h"
 
 /*
  * Some arbitrary value. This is just to catch
@@ -26,18 +27,6 @@
  */
 static const unsigned max_num_devices = 32;
 
-/*
- * Stored at beginning of each compressed object.
- *
- * It stores back-reference to table entry which points to this
- * object. This is required to support memory defragmentation.
- */
-struct zobj_header {
-#if 0
-	u32 table_idx;
-#endif
-};
-
 /*-- Configurable parameters */
 
 /* Default zram disk size: 25% of total RAM */
@@ -50,10 +39,10 @@ static const unsigned default_disksize_perc_ram = 25;
 static const unsigned max_zpage_size = PAGE_SIZE / 4 * 3;
 
 /*
- * NOTE: max_zpage_size must be less than or equal to:
- *   XV_MAX_ALLOC_SIZE - sizeof(struct zobj_header)
- * otherwise, xv_malloc() would always return failure.
+ * Default for the idle_age sysfs node: pages not accessed for this
+ * many seconds are written back by an idle writeback.
  */
+static const unsigned default_idle_age = 3600;
 
 /*-- End of configurable params */
 
@@ -70,19 +59,52 @@ enum zram_pageflags {
 	/* Page consists entirely of zeros */
 	ZRAM_ZERO,
 
+	/* Page is one word repeated, kept in table[].element */
+	ZRAM_SAME,
+
+	/* Page is on the backing device, in block table[].blk_idx */
+	ZRAM_WB,
+
+	/* Page is being written to the backing device */
+	ZRAM_UNDER_WB,
+
+	/* Protects the table entry, see zram_slot_lock() */
+	ZRAM_LOCK,
+
 	__NR_ZRAM_PAGEFLAGS,
 };
 
 /*-- Data structures */
 
+/*
+ * A stored object. Disk pages with identical compressed data share one,
+ * found through the zram->hash table by checksum.
+ */
+struct zram_entry {
+	struct hlist_node node;
+	unsigned long handle;
+	u32 checksum;		/* of the stored data */
+	u32 len;		/* object size */
+	unsigned int refcount;	/* disk pages using this object */
+};
+
 /* Allocated for each disk page */
 struct table {
-	struct page *page;
-	u16 offset;
-	u8 count;	/* object ref count (not yet used) */
-	u8 flags;
+	union {
+		struct zram_entry *entry;
+		unsigned long element;
+		unsigned long blk_idx;
+	};
+	unsigned long flags;
+	u32 ac_time;	/* last access, in seconds */
 } __attribute__((aligned(4)));
 
+/* Which pages zram_writeback() writes to the backing device */
+enum zram_wb_mode {
+	ZRAM_WB_INCOMPRESSIBLE = 1,
+	ZRAM_WB_IDLE = 2,
+};
+
 struct zram_stats {
 	u64 compr_size;		/* compressed size of pages stored */
 	u64 num_reads;		/* failed + successful */
@@ -91,31 +113,62 @@ struct zram_stats {
 	u64 failed_writes;	/* can happen when memory is too low */
 	u64 invalid_io;		/* non-page-aligned I/O requests */
 	u64 notify_free;	/* no. of swap slot free notifications */
-	u32 pages_zero;		/* no. of zero filled pages */
-	u32 pages_stored;	/* no. of pages currently stored */
-	u32 good_compress;	/* % of pages with compression ratio<=50% */
-	u32 pages_expand;	/* % of incompressible pages */
+	u64 stream_waits;	/* writes that waited for a compression stream */
+	u64 dedup_hits;		/* writes that found their data already stored */
+	u64 bd_reads;		/* pages read from the backing device */
+	u64 bd_writes;		/* pages written to the backing device */
+	atomic_t pages_zero;	/* no. of zero filled pages */
+	atomic_t pages_same;	/* no. of other same filled pages */
+	atomic_t pages_stored;	/* no. of pages currently stored */
+	atomic_t good_compress;	/* % of pages with compression ratio<=50% */
+	atomic_t pages_expand;	/* % of incompressible pages */
+	atomic_t pages_wb;	/* no. of pages on the backing device */
+};
+
+/*
+ * Compressor working memory and output buffer. There is one per CPU so
+ * that writes on different CPUs compress in parallel; the mutex is only
+ * contended when a writer is migrated or preempted while compressing.
+ */
+struct zram_stream {
+	struct mutex lock;
+	void *workmem;
+	void *buffer;
 };
 
 struct zram {
-	struct xv_pool *mem_pool;
-	void *compress_workmem;
-	void *compress_buffer;
+	struct zs_pool *mem_pool;
+	struct zram_stream __percpu *streams;
 	struct table *table;
+	struct hlist_head *hash;	/* zram_entry by checksum */
+	unsigned int hash_size;		/* power of two */
+	spinlock_t hash_lock;	/* protect hash and entry refcounts */
 	spinlock_t stat64_lock;	/* protect 64-bit stats */
-	struct mutex lock;	/* protect compression buffers against
-				 * concurrent writes */
 	struct request_queue *queue;
 	struct gendisk *disk;
 	int init_done;
 	/* Prevent concurrent execution of device init and reset */
 	struct mutex init_lock;
+	/* Held for read by zram_writeback(), for write by reset */
+	struct rw_semaphore wb_sem;
 	/*
 	 * This is the limit on amount of *uncompressed* worth of data
 	 * we can store in a disk.
 	 */
 	u64 disksize;	/* bytes */
 
+	/*
+	 * Optional block device that incompressible or idle pages are
+	 * written back to, see zram_writeback().
+	 */
+	struct block_device *bdev;
+	char *backing_dev;		/* its path */
+	unsigned long *bd_bitmap;	/* blocks in use */
+	unsigned long bd_nr_blocks;
+	struct bio_set *bd_bio_set;	/* bios for reading it */
+	struct mutex bd_read_lock;	/* one read request at a time */
+	unsigned int idle_age;		/* seconds */
+
 	struct zram_stats stats;
 };
 
@@ -128,4 +181,8 @@ extern struct attribute_group zram_disk_attr_group;
 extern int zram_init_device(struct zram *zram);
 extern void zram_reset_device(struct zram *zram);
 
+extern int zram_set_backing_dev(struct zram *zram, const char *path);
+extern void zram_close_backing_dev(struct zram *zram);
+extern int zram_writeback(struct zram *zram, int mode);
+
 #endif
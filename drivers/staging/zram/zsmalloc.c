@@ -0,0 +1,653 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+/*
+ * Objects are served from size classes ZS_SIZE_CLASS_DELTA bytes apart.
+ * Each class packs its objects back to back into zspages: groups of one
+ * to ZS_MAX_PAGES_PER_ZSPAGE 0-order pages, sized to waste as little as
+ * possible of the last page. An object may therefore span two pages,
+ * and such objects are accessed through a per-CPU bounce buffer.
+ *
+ * zs_malloc() returns a handle, not an address. The handle points to a
+ * small zs_handle which records where the object lives, so zs_compact()
+ * can move objects out of sparsely used zspages and free those.
+ *
+ * Locking: class->lock protects the zspages of a class and their slots.
+ * The pin bit of a handle is held while its object is mapped or being
+ * freed; compaction only moves objects whose pin it can take, and takes
+ * it under class->lock with a trylock, so the two never deadlock.
+ */
+
+#include <linux/errno.h>
+#include <linux/highmem.h>
+#include <linux/percpu.h>
+#include <linux/sched.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/bit_spinlock.h>
+
+#include "zsmalloc.h"
+#include "zsmalloc_int.h"
+
+static unsigned int get_size_class_index(size_t size)
+{
+	if (size <= ZS_MIN_ALLOC_SIZE)
+		return 0;
+
+	return DIV_ROUND_UP(size - ZS_MIN_ALLOC_SIZE, ZS_SIZE_CLASS_DELTA);
+}
+
+/*
+ * Number of pages per zspage that leaves the least space unused at the
+ * end of the zspage for objects of the given size.
+ */
+static unsigned int get_pages_per_zspage(unsigned int size)
+{
+	unsigned int i, best = 1, best_usage = 0;
+
+	for (i = 1; i <= ZS_MAX_PAGES_PER_ZSPAGE; i++) {
+		unsigned int zspage_size = i * PAGE_SIZE;
+		unsigned int usage;
+
+		usage = (zspage_size - zspage_size % size) * 100 / zspage_size;
+		if (usage > best_usage) {
+			best_usage = usage;
+			best = i;
+		}
+	}
+
+	return best;
+}
+
+static enum fullness_group get_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	unsigned int inuse = zspage->inuse;
+	unsigned int max = class->objs_per_zspage;
+
+	if (inuse == 0)
+		return ZS_EMPTY;
+	if (inuse == max)
+		return ZS_FULL;
+	if (inuse * ZS_FULLNESS_FRAC <= max * (ZS_FULLNESS_FRAC - 1))
+		return ZS_ALMOST_EMPTY;
+
+	return ZS_ALMOST_FULL;
+}
+
+static void insert_zspage(struct size_class *class, struct zspage *zspage)
+{
+	zspage->fullness = get_fullness_group(class, zspage);
+	if (zspage->fullness != ZS_EMPTY)
+		list_add(&zspage->list,
+			&class->fullness_list[zspage->fullness]);
+}
+
+static void remove_zspage(struct zspage *zspage)
+{
+	if (zspage->fullness != ZS_EMPTY)
+		list_del_init(&zspage->list);
+}
+
+/*
+ * Move a zspage to the list of its new fullness group, if that changed.
+ * Returns the new group; an empty zspage ends up on no list.
+ */
+static enum fullness_group fix_fullness_group(struct size_class *class,
+					struct zspage *zspage)
+{
+	if (get_fullness_group(class, zspage) != zspage->fullness) {
+		remove_zspage(zspage);
+		insert_zspage(class, zspage);
+	}
+
+	return zspage->fullness;
+}
+
+/* Zspage to allocate from: the fullest one that still has room */
+static struct zspage *find_get_zspage(struct size_class *class)
+{
+	enum fullness_group fg;
+
+	for (fg = ZS_ALMOST_FULL; fg >= ZS_ALMOST_EMPTY; fg--) {
+		if (!list_empty(&class->fullness_list[fg]))
+			return list_first_entry(&class->fullness_list[fg],
+						struct zspage, list);
+	}
+
+	return NULL;
+}
+
+static size_t zspage_header_size(struct size_class *class)
+{
+	return sizeof(struct zspage) +
+		class->objs_per_zspage * sizeof(unsigned long);
+}
+
+static struct zspage *alloc_zspage(struct size_class *class, gfp_t flags)
+{
+	struct zspage *zspage;
+	unsigned int i;
+
+	zspage = kzalloc(zspage_header_size(class), flags & ~__GFP_HIGHMEM);
+	if (!zspage)
+		return NULL;
+
+	for (i = 0; i < class->pages_per_zspage; i++) {
+		zspage->pages[i] = alloc_page(flags);
+		if (!zspage->pages[i])
+			goto fail;
+	}
+
+	INIT_LIST_HEAD(&zspage->list);
+	zspage->class = class;
+	zspage->fullness = ZS_EMPTY;
+	for (i = 0; i < class->objs_per_zspage; i++)
+		zspage->slots[i] = (i + 1) << 1 | 1;
+
+	return zspage;
+
+fail:
+	while (i--)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+	return NULL;
+}
+
+static void free_zspage(struct zs_pool *pool, struct zspage *zspage)
+{
+	struct size_class *class = zspage->class;
+	unsigned int i;
+
+	for (i = 0; i < class->pages_per_zspage; i++)
+		__free_page(zspage->pages[i]);
+	kfree(zspage);
+
+	atomic_long_sub(class->pages_per_zspage, &pool->pages_allocated);
+	atomic_long_sub(zspage_header_size(class), &pool->meta_bytes);
+}
+
+static unsigned int obj_alloc(struct size_class *class, struct zspage *zspage,
+			struct zs_handle *h)
+{
+	unsigned int idx = zspage->free_idx;
+
+	zspage->free_idx = zspage->slots[idx] >> 1;
+	zspage->slots[idx] = (unsigned long)h;
+	zspage->inuse++;
+	class->objs_inuse++;
+
+	h->zspage = zspage;
+	h->idx = idx;
+
+	return idx;
+}
+
+static void obj_free(struct size_class *class, struct zspage *zspage,
+			unsigned int idx)
+{
+	zspage->slots[idx] = zspage->free_idx << 1 | 1;
+	zspage->free_idx = idx;
+	zspage->inuse--;
+	class->objs_inuse--;
+}
+
+/*
+ * Copy the object at slot idx to or from buf, page by page, since the
+ * object may not be contiguous in the kernel mapping.
+ */
+static void obj_copy(struct zspage *zspage, unsigned int idx, void *buf,
+			int to_obj)
+{
+	unsigned int size = zspage->class->size;
+	unsigned long off = (unsigned long)idx * size;
+	char *p = buf;
+
+	while (size) {
+		unsigned int pg_off = off & ~PAGE_MASK;
+		unsigned int n = min_t(unsigned int, size, PAGE_SIZE - pg_off);
+		char *vaddr;
+
+		vaddr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT], KM_USER1);
+		if (to_obj)
+			memcpy(vaddr + pg_off, p, n);
+		else
+			memcpy(p, vaddr + pg_off, n);
+		kunmap_atomic(vaddr, KM_USER1);
+
+		p += n;
+		off += n;
+		size -= n;
+	}
+}
+
+/* Copy an object between two zspages of the same class */
+static void obj_migrate(struct zspage *dst, unsigned int didx,
+			struct zspage *src, unsigned int sidx)
+{
+	unsigned int size = src->class->size;
+	unsigned long soff = (unsigned long)sidx * size;
+	unsigned long doff = (unsigned long)didx * size;
+
+	while (size) {
+		unsigned int s_pg_off = soff & ~PAGE_MASK;
+		unsigned int d_pg_off = doff & ~PAGE_MASK;
+		unsigned int n;
+		char *s, *d;
+
+		n = min_t(unsigned int, size, PAGE_SIZE - s_pg_off);
+		n = min_t(unsigned int, n, PAGE_SIZE - d_pg_off);
+
+		s = kmap_atomic(src->pages[soff >> PAGE_SHIFT], KM_USER0);
+		d = kmap_atomic(dst->pages[doff >> PAGE_SHIFT], KM_USER1);
+		memcpy(d + d_pg_off, s + s_pg_off, n);
+		kunmap_atomic(d, KM_USER1);
+		kunmap_atomic(s, KM_USER0);
+
+		soff += n;
+		doff += n;
+		size -= n;
+	}
+}
+
+/**
+ * zs_malloc - Allocate an object of given size from pool.
+ * @pool: pool to allocate from
+ * @size: size of object to allocate, at most ZS_MAX_ALLOC_SIZE
+ * @flags: flags for the zspage and handle allocations
+ *
+ * Returns a handle to be passed to zs_map_object() and zs_free(),
+ * or 0 on failure.
+ */
+unsigned long zs_malloc(struct zs_pool *pool, size_t size, gfp_t flags)
+{
+	struct size_class *class;
+	struct zspage *zspage;
+	struct zs_handle *h;
+
+	if (unlikely(!size || size > ZS_MAX_ALLOC_SIZE))
+		return 0;
+
+	h = kmem_cache_alloc(pool->handle_cachep, flags & ~__GFP_HIGHMEM);
+	if (unlikely(!h))
+		return 0;
+	h->pin = 0;
+	atomic_long_add(sizeof(*h), &pool->meta_bytes);
+
+	class = &pool->size_class[get_size_class_index(size)];
+
+	spin_lock(&class->lock);
+	zspage = find_get_zspage(class);
+	if (!zspage) {
+		spin_unlock(&class->lock);
+
+		zspage = alloc_zspage(class, flags);
+		if (unlikely(!zspage)) {
+			atomic_long_sub(sizeof(*h), &pool->meta_bytes);
+			kmem_cache_free(pool->handle_cachep, h);
+			return 0;
+		}
+		atomic_long_add(class->pages_per_zspage,
+				&pool->pages_allocated);
+		atomic_long_add(zspage_header_size(class), &pool->meta_bytes);
+
+		spin_lock(&class->lock);
+		class->objs_allocated += class->objs_per_zspage;
+	}
+
+	obj_alloc(class, zspage, h);
+	fix_fullness_group(class, zspage);
+	spin_unlock(&class->lock);
+
+	return (unsigned long)h;
+}
+
+void zs_free(struct zs_pool *pool, unsigned long handle)
+{
+	struct zs_handle *h = (struct zs_handle *)handle;
+	struct size_class *class;
+	struct zspage *zspage;
+	enum fullness_group fg;
+
+	if (unlikely(!handle))
+		return;
+
+	bit_spin_lock(ZS_HANDLE_PIN_BIT, &h->pin);
+	zspage = h->zspage;
+	class = zspage->class;
+
+	spin_lock(&class->lock);
+	obj_free(class, zspage, h->idx);
+	fg = fix_fullness_group(class, zspage);
+	if (fg == ZS_EMPTY)
+		class->objs_allocated -= class->objs_per_zspage;
+	spin_unlock(&class->lock);
+
+	bit_spin_unlock(ZS_HANDLE_PIN_BIT, &h->pin);
+	kmem_cache_free(pool->handle_cachep, h);
+	atomic_long_sub(sizeof(*h), &pool->meta_bytes);
+
+	if (fg == ZS_EMPTY)
+		free_zspage(pool, zspage);
+}
+
+/**
+ * zs_map_object - Get a pointer to an object.
+ * @pool: pool the object was allocated from
+ * @handle: handle returned by zs_malloc()
+ * @mm: whether the object is going to be read, written or both
+ *
+ * The object cannot be moved or freed until zs_unmap_object(). As with
+ * kmap_atomic(), the caller must not sleep in between, and must unmap
+ * in the reverse order of any other atomic mappings it holds.
+ */
+void *zs_map_object(struct zs_pool *pool, unsigned long handle,
+			enum zs_mapmode mm)
+{
+	struct zs_handle *h = (struct zs_handle *)handle;
+	struct zs_map_area *area;
+	struct zspage *zspage;
+	unsigned int size;
+	unsigned long off;
+
+	/* also disables preemption, keeping us on this CPU's area */
+	bit_spin_lock(ZS_HANDLE_PIN_BIT, &h->pin);
+
+	zspage = h->zspage;
+	size = zspage->class->size;
+	off = (unsigned long)h->idx * size;
+
+	area = this_cpu_ptr(pool->area);
+	area->mm = mm;
+
+	if ((off & ~PAGE_MASK) + size <= PAGE_SIZE) {
+		area->vaddr = kmap_atomic(zspage->pages[off >> PAGE_SHIFT],
+					KM_USER1);
+		return area->vaddr + (off & ~PAGE_MASK);
+	}
+
+	area->vaddr = NULL;
+	if (mm != ZS_MM_WO)
+		obj_copy(zspage, h->idx, area->buf, 0);
+
+	return area->buf;
+}
+
+void zs_unmap_object(struct zs_pool *pool, unsigned long handle)
+{
+	struct zs_handle *h = (struct zs_handle *)handle;
+	struct zs_map_area *area;
+
+	area = this_cpu_ptr(pool->area);
+	if (area->vaddr)
+		kunmap_atomic(area->vaddr, KM_USER1);
+	else if (area->mm != ZS_MM_RO)
+		obj_copy(h->zspage, h->idx, area->buf, 1);
+
+	bit_spin_unlock(ZS_HANDLE_PIN_BIT, &h->pin);
+}
+
+/* Number of zspages that compaction could free in this class */
+static unsigned long zs_can_compact(struct size_class *class)
+{
+	return (class->objs_allocated - class->objs_inuse) /
+		class->objs_per_zspage;
+}
+
+/* Zspage to move objects out of: the emptiest we can find cheaply */
+static struct zspage *isolate_source_zspage(struct size_class *class)
+{
+	enum fullness_group fg;
+	struct zspage *zspage;
+
+	for (fg = ZS_ALMOST_EMPTY; fg <= ZS_ALMOST_FULL; fg++) {
+		if (list_empty(&class->fullness_list[fg]))
+			continue;
+
+		zspage = list_entry(class->fullness_list[fg].prev,
+					struct zspage, list);
+		remove_zspage(zspage);
+		return zspage;
+	}
+
+	return NULL;
+}
+
+/*
+ * Move as many objects as possible out of src into other zspages of
+ * the class. Returns nonzero if some object was pinned or no other
+ * zspage had room, i.e. if compaction of the class should stop.
+ */
+static int migrate_zspage(struct size_class *class, struct zspage *src)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < class->objs_per_zspage && src->inuse; idx++) {
+		struct zs_handle *h;
+		struct zspage *dst;
+		unsigned int didx;
+
+		if (src->slots[idx] & 1)
+			continue;
+
+		dst = find_get_zspage(class);
+		if (!dst)
+			return 1;
+
+		h = (struct zs_handle *)src->slots[idx];
+		if (!bit_spin_trylock(ZS_HANDLE_PIN_BIT, &h->pin))
+			return 1;
+
+		didx = obj_alloc(class, dst, h);
+		obj_migrate(dst, didx, src, idx);
+		obj_free(class, src, idx);
+		fix_fullness_group(class, dst);
+
+		bit_spin_unlock(ZS_HANDLE_PIN_BIT, &h->pin);
+	}
+
+	return 0;
+}
+
+static unsigned long compact_class(struct zs_pool *pool,
+				struct size_class *class)
+{
+	unsigned long freed = 0;
+	struct zspage *src;
+	int stop = 0;
+
+	spin_lock(&class->lock);
+	while (!stop && zs_can_compact(class)) {
+		src = isolate_source_zspage(class);
+		if (!src)
+			break;
+
+		stop = migrate_zspage(class, src);
+		insert_zspage(class, src);
+		if (src->fullness != ZS_EMPTY)
+			continue;
+
+		class->objs_allocated -= class->objs_per_zspage;
+		spin_unlock(&class->lock);
+
+		free_zspage(pool, src);
+		freed += class->pages_per_zspage;
+		cond_resched();
+
+		spin_lock(&class->lock);
+	}
+	spin_unlock(&class->lock);
+
+	return freed;
+}
+
+/**
+ * zs_compact - Move objects out of sparsely used zspages.
+ * @pool: pool to compact
+ *
+ * Returns the number of pages freed.
+ */
+unsigned long zs_compact(struct zs_pool *pool)
+{
+	unsigned long freed = 0;
+	int i;
+
+	for (i = ZS_SIZE_CLASSES - 1; i >= 0; i--)
+		freed += compact_class(pool, &pool->size_class[i]);
+
+	atomic_long_add(freed, &pool->pages_compacted);
+
+	return freed;
+}
+
+static int zs_shrink(struct shrinker *shrinker, int nr_to_scan,
+			gfp_t gfp_mask)
+{
+	struct zs_pool *pool = container_of(shrinker, struct zs_pool,
+					shrinker);
+	unsigned long pages = 0;
+	int i;
+
+	if (nr_to_scan)
+		zs_compact(pool);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+
+		spin_lock(&class->lock);
+		pages += zs_can_compact(class) * class->pages_per_zspage;
+		spin_unlock(&class->lock);
+	}
+
+	return min_t(unsigned long, pages, INT_MAX);
+}
+
+static void free_map_areas(struct zs_pool *pool)
+{
+	int cpu;
+
+	if (!pool->area)
+		return;
+
+	for_each_possible_cpu(cpu)
+		kfree(per_cpu_ptr(pool->area, cpu)->buf);
+	free_percpu(pool->area);
+}
+
+/*
+ * Create a memory pool. The name is used for the slab cache of handles
+ * and must be unique.
+ */
+struct zs_pool *zs_create_pool(const char *name)
+{
+	struct zs_pool *pool;
+	int i, cpu;
+
+	pool = kzalloc(sizeof(*pool), GFP_KERNEL);
+	if (!pool)
+		return NULL;
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+		enum fullness_group fg;
+
+		spin_lock_init(&class->lock);
+		for (fg = 0; fg < __NR_ZS_FULLNESS; fg++)
+			INIT_LIST_HEAD(&class->fullness_list[fg]);
+
+		class->size = min_t(unsigned int, ZS_MAX_ALLOC_SIZE,
+				ZS_MIN_ALLOC_SIZE + i * ZS_SIZE_CLASS_DELTA);
+		class->pages_per_zspage = get_pages_per_zspage(class->size);
+		class->objs_per_zspage = class->pages_per_zspage * PAGE_SIZE /
+					class->size;
+	}
+
+	pool->area = alloc_percpu(struct zs_map_area);
+	if (!pool->area)
+		goto fail;
+
+	for_each_possible_cpu(cpu) {
+		struct zs_map_area *area = per_cpu_ptr(pool->area, cpu);
+
+		area->buf = kmalloc(ZS_MAX_ALLOC_SIZE, GFP_KERNEL);
+		if (!area->buf)
+			goto fail;
+	}
+
+	snprintf(pool->name, sizeof(pool->name), "%s", name);
+	pool->handle_cachep = kmem_cache_create(pool->name,
+				sizeof(struct zs_handle), 0, 0, NULL);
+	if (!pool->handle_cachep)
+		goto fail;
+
+	pool->shrinker.shrink = zs_shrink;
+	pool->shrinker.seeks = DEFAULT_SEEKS;
+	register_shrinker(&pool->shrinker);
+
+	return pool;
+
+fail:
+	free_map_areas(pool);
+	kfree(pool);
+	return NULL;
+}
+
+/*
+ * Objects still allocated are freed along with the pool; their handles
+ * become invalid.
+ */
+void zs_destroy_pool(struct zs_pool *pool)
+{
+	int i;
+
+	unregister_shrinker(&pool->shrinker);
+
+	for (i = 0; i < ZS_SIZE_CLASSES; i++) {
+		struct size_class *class = &pool->size_class[i];
+		enum fullness_group fg;
+
+		for (fg = ZS_ALMOST_EMPTY; fg < __NR_ZS_FULLNESS; fg++) {
+			struct zspage *zspage, *tmp;
+
+			list_for_each_entry_safe(zspage, tmp,
+					&class->fullness_list[fg], list) {
+				unsigned int idx;
+
+				for (idx = 0; idx < class->objs_per_zspage;
+						idx++) {
+					if (!(zspage->slots[idx] & 1))
+						kmem_cache_free(
+							pool->handle_cachep,
+							(void *)zspage->slots[idx]);
+				}
+				free_zspage(pool, zspage);
+			}
+		}
+	}
+
+	kmem_cache_destroy(pool->handle_cachep);
+	free_map_areas(pool);
+	kfree(pool);
+}
+
+/*
+ * Memory used by the pool: the zspage pages, plus the zspage headers
+ * and handles allocated from the slab for every zspage and object.
+ */
+u64 zs_get_total_size_bytes(struct zs_pool *pool)
+{
+	return ((u64)atomic_long_read(&pool->pages_allocated) << PAGE_SHIFT) +
+		atomic_long_read(&pool->meta_bytes);
+}
+
+u64 zs_get_pages_compacted(struct zs_pool *pool)
+{
+	return atomic_long_read(&pool->pages_compacted);
+}
@@ -0,0 +1,115 @@
+/*
+ * zsmalloc memory allocator
+ *
+ * This code is released using a dual license strategy: BSD/GPL
+ * You can choose the licence that better fits your requirements.
+ *
+ * Released under the terms of 3-clause BSD License
+ * Released under the terms of GNU General Public License Version 2.0
+ */
+
+#ifndef _ZS_MALLOC_INT_H_
+#define _ZS_MALLOC_INT_H_
+
+#include <linux/kernel.h>
+#include <linux/list.h>
+#include <linux/mm.h>
+#include <linux/spinlock.h>
+#include <linux/types.h>
+
+/* User configurable params */
+
+/*
+ * A zspage is a group of up to this many 0-order pages that objects
+ * of one size class are packed into back to back, so an object may
+ * cross from one page into the next.
+ */
+#define ZS_MAX_PAGES_PER_ZSPAGE	4
+
+#define ZS_MIN_ALLOC_SIZE	32
+#define ZS_MAX_ALLOC_SIZE	PAGE_SIZE
+
+/* Size classes are separated by ZS_SIZE_CLASS_DELTA bytes */
+#define ZS_SIZE_CLASS_DELTA	(PAGE_SIZE >> 8)
+#define ZS_SIZE_CLASSES		(DIV_ROUND_UP(ZS_MAX_ALLOC_SIZE - \
+				ZS_MIN_ALLOC_SIZE, ZS_SIZE_CLASS_DELTA) + 1)
+
+/*
+ * A zspage with at most 3/4 of its objects in use is almost empty and
+ * a candidate for compaction; one above that is almost full and is
+ * preferred for new allocations.
+ */
+#define ZS_FULLNESS_FRAC	4
+
+/* End of user params */
+
+enum fullness_group {
+	ZS_EMPTY,
+	ZS_ALMOST_EMPTY,
+	ZS_ALMOST_FULL,
+	ZS_FULL,
+	__NR_ZS_FULLNESS,
+};
+
+/* Set in zs_handle.pin while the object is mapped or being freed */
+#define ZS_HANDLE_PIN_BIT	0
+
+/*
+ * What a zs_malloc() handle points to. Objects are found through this
+ * indirection so that compaction can move them to another zspage.
+ */
+struct zs_handle {
+	unsigned long pin;
+	struct zspage *zspage;
+	unsigned int idx;
+};
+
+struct size_class {
+	spinlock_t lock;
+	struct list_head fullness_list[__NR_ZS_FULLNESS];
+
+	unsigned int size;		/* object size */
+	unsigned int pages_per_zspage;
+	unsigned int objs_per_zspage;
+
+	/* stats, protected by lock */
+	unsigned long objs_allocated;	/* slots in all zspages */
+	unsigned long objs_inuse;
+};
+
+struct zspage {
+	struct list_head list;		/* in class->fullness_list[] */
+	struct size_class *class;
+	enum fullness_group fullness;
+	unsigned int inuse;		/* allocated objects */
+	unsigned int free_idx;		/* first free slot */
+	struct page *pages[ZS_MAX_PAGES_PER_ZSPAGE];
+
+	/*
+	 * One entry per object: the zs_handle of an allocated object,
+	 * or (next free slot << 1) | 1 for a free one.
+	 */
+	unsigned long slots[0];
+};
+
+/* Bounce buffer for mapping objects that cross a page boundary */
+struct zs_map_area {
+	char *buf;
+	char *vaddr;		/* kmap_atomic() address, if not bounced */
+	enum zs_mapmode mm;
+};
+
+struct zs_pool {
+	struct size_class size_class[ZS_SIZE_CLASSES];
+	struct kmem_cache *handle_cachep;
+	struct zs_map_area __percpu *area;
+	struct shrinker shrinker;
+	char name[16];
+
+	/* stats */
+	atomic_long_t pages_allocated;
+	atomic_long_t pages_compacted;
+	atomic_long_t meta_bytes;	/* zspage headers and handles */
+};
+
+#endif
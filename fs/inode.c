@@ -438,13 +438,25 @@ static void evict(struct inode *inode)
 {
 	const struct super_operations *op = inode->i_sb->s_op;
 
+	/*
+	 * Stop reclaim from leaving shadow entries behind (see
+	 * mm/workingset.c): once the flag is visible under tree_lock, no
+	 * new ones can appear after the final truncate below.
+	 */
+	mapping_set_exiting(&inode->i_data);
+	spin_lock_irq(&inode->i_data.tree_lock);
+	spin_unlock_irq(&inode->i_data.tree_lock);
+
 	if (op->evict_inode) {
 		op->evict_inode(inode);
 	} else {
-		if (inode->i_data.nrpages)
+		if (inode->i_data.nrpages || inode->i_data.nrshadows)
 			truncate_inode_pages(&inode->i_data, 0);
 		end_writeback(inode);
 	}
+	/* Not every ->evict_inode() truncates if there are no pages */
+	if (inode->i_data.nrshadows)
+		clear_shadow_entries(&inode->i_data, 0, ULONG_MAX);
 	if (S_ISBLK(inode->i_mode) && inode->i_bdev)
 		bd_forget(inode);
 	if (S_ISCHR(inode->i_mode) && inode->i_cdev)
@@ -139,6 +139,7 @@ int jffs2_erase_pending_blocks(struct jffs2_sb_info *c, int count)
 			c->used_size -= jeb->used_size;
 			c->dirty_size -= jeb->dirty_size;
 			jeb->wasted_size = jeb->used_size = jeb->dirty_size = jeb->free_size = 0;
+			jeb->no_summary = 0;
 			jffs2_free_jeb_node_refs(c, jeb);
 			list_add(&jeb->list, &c->erasing_list);
 			spin_unlock(&c->erase_completion_lock);
@@ -318,6 +319,7 @@ void jffs2_free_jeb_node_refs(struct jffs2_sb_info *c, struct jffs2_eraseblock *
 		if (ref->flash_offset == REF_LINK_NODE) {
 			ref = ref->next_in_ino;
 			jffs2_free_refblock(block);
+			atomic_dec(&c->nr_refblocks);
 			block = ref;
 			continue;
 		}
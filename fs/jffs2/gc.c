@@ -39,6 +39,26 @@ static int jffs2_garbage_collect_live(struct jffs2_sb_info *c,  struct jffs2_era
 			       struct jffs2_raw_node_ref *raw, struct jffs2_inode_info *f);
 
 /* Called with erase_completion_lock held */
+/* Blocks which were written without a summary have to be scanned in full
+   at every mount, until GC moves their nodes into blocks which do have one.
+   Dirty blocks get there soon enough, but clean ones are only collected
+   for wear levelling -- in which case, we may as well pick one of those. */
+static struct jffs2_eraseblock *jffs2_find_clean_gc_block(struct jffs2_sb_info *c)
+{
+	struct jffs2_eraseblock *jeb;
+
+	if (jffs2_sum_active()) {
+		list_for_each_entry(jeb, &c->clean_list, list) {
+			if (jeb->no_summary) {
+				D1(printk(KERN_DEBUG "Picking block at 0x%08x without summary\n", jeb->offset));
+				return jeb;
+			}
+		}
+	}
+
+	return list_entry(c->clean_list.next, struct jffs2_eraseblock, list);
+}
+
 static struct jffs2_eraseblock *jffs2_find_gc_block(struct jffs2_sb_info *c)
 {
 	struct jffs2_eraseblock *ret;
@@ -92,7 +112,10 @@ again:
 		return NULL;
 	}
 
-	ret = list_entry(nextlist->next, struct jffs2_eraseblock, list);
+	if (nextlist == &c->clean_list)
+		ret = jffs2_find_clean_gc_block(c);
+	else
+		ret = list_entry(nextlist->next, struct jffs2_eraseblock, list);
 	list_del(&ret->list);
 	c->gcblock = ret;
 	ret->gc_node = ret->first_node;
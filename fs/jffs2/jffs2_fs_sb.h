@@ -104,6 +104,9 @@ struct jffs2_sb_info {
 	struct jffs2_inode_cache **inocache_list;
 	spinlock_t inocache_lock;
 
+	atomic_t nr_refblocks;		/* Only kept for the memory usage */
+	atomic_t nr_frags;		/* report in /proc/fs/jffs2 */
+
 	/* Sem to allow jffs2_garbage_collect_deletion_dirent to
 	   drop the erase_completion_lock while it's holding a pointer
 	   to an obsoleted node. I don't like this. Alternatives welcomed. */
@@ -228,6 +228,7 @@ int jffs2_prealloc_raw_node_refs(struct jffs2_sb_info *c,
 			ref = *p = jffs2_alloc_refblock();
 			if (!ref)
 				return -ENOMEM;
+			atomic_inc(&c->nr_refblocks);
 		}
 		if (ref->flash_offset == REF_LINK_NODE) {
 			p = &ref->next_in_ino;
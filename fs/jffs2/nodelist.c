@@ -115,6 +115,7 @@ static void jffs2_obsolete_node_frag(struct jffs2_sb_info *c,
 
 	}
 	jffs2_free_node_frag(this);
+	atomic_dec(&c->nr_frags);
 }
 
 static void jffs2_fragtree_insert(struct jffs2_node_frag *newfrag, struct jffs2_node_frag *base)
@@ -144,7 +145,8 @@ static void jffs2_fragtree_insert(struct jffs2_node_frag *newfrag, struct jffs2_
 /*
  * Allocate and initializes a new fragment.
  */
-static struct jffs2_node_frag * new_fragment(struct jffs2_full_dnode *fn, uint32_t ofs, uint32_t size)
+static struct jffs2_node_frag * new_fragment(struct jffs2_sb_info *c, struct jffs2_full_dnode *fn,
+					     uint32_t ofs, uint32_t size)
 {
 	struct jffs2_node_frag *newfrag;
 
@@ -153,6 +155,7 @@ static struct jffs2_node_frag * new_fragment(struct jffs2_full_dnode *fn, uint32
 		newfrag->ofs = ofs;
 		newfrag->size = size;
 		newfrag->node = fn;
+		atomic_inc(&c->nr_frags);
 	} else {
 		JFFS2_ERROR("cannot allocate a jffs2_node_frag object\n");
 	}
@@ -168,13 +171,20 @@ static int no_overlapping_node(struct jffs2_sb_info *c, struct rb_root *root,
 		 	       struct jffs2_node_frag *newfrag,
 			       struct jffs2_node_frag *this, uint32_t lastend)
 {
-	if (lastend < newfrag->node->ofs) {
+	if (lastend < newfrag->node->ofs && this && !this->node) {
+		/* The last frag is a hole already; just make it bigger, rather
+		   than using up another frag for the rest of the hole */
+		dbg_fragtree2("extend hole frag %#04x-%#04x to %#04x.\n",
+			this->ofs, this->ofs + this->size, newfrag->node->ofs);
+		this->size = newfrag->node->ofs - this->ofs;
+	} else if (lastend < newfrag->node->ofs) {
 		/* put a hole in before the new fragment */
 		struct jffs2_node_frag *holefrag;
 
-		holefrag= new_fragment(NULL, lastend, newfrag->node->ofs - lastend);
+		holefrag= new_fragment(c, NULL, lastend, newfrag->node->ofs - lastend);
 		if (unlikely(!holefrag)) {
 			jffs2_free_node_frag(newfrag);
+			atomic_dec(&c->nr_frags);
 			return -ENOMEM;
 		}
 
@@ -276,7 +286,7 @@ static int jffs2_add_frag_to_fragtree(struct jffs2_sb_info *c, struct rb_root *r
 					this->ofs, this->ofs+this->size);
 
 			/* New second frag pointing to this's node */
-			newfrag2 = new_fragment(this->node, newfrag->ofs + newfrag->size,
+			newfrag2 = new_fragment(c, this->node, newfrag->ofs + newfrag->size,
 						this->ofs + this->size - newfrag->ofs - newfrag->size);
 			if (unlikely(!newfrag2))
 				return -ENOMEM;
@@ -366,7 +376,7 @@ int jffs2_add_full_dnode_to_inode(struct jffs2_sb_info *c, struct jffs2_inode_in
 	if (unlikely(!fn->size))
 		return 0;
 
-	newfrag = new_fragment(fn, fn->ofs, fn->size);
+	newfrag = new_fragment(c, fn, fn->ofs, fn->size);
 	if (unlikely(!newfrag))
 		return -ENOMEM;
 	newfrag->node->frags = 1;
@@ -513,6 +523,7 @@ void jffs2_free_raw_node_refs(struct jffs2_sb_info *c)
 				next = NULL;
 
 			jffs2_free_refblock(this);
+			atomic_dec(&c->nr_refblocks);
 			this = next;
 		}
 		c->blocks[i].first_node = c->blocks[i].last_node = NULL;
@@ -558,9 +569,9 @@ struct jffs2_node_frag *jffs2_lookup_node_frag(struct rb_root *fragtree, uint32_
 	return prev;
 }
 
-/* Pass 'c' argument to indicate that nodes should be marked obsolete as
+/* Pass 'deleted' to indicate that nodes should be marked obsolete as
    they're killed. */
-void jffs2_kill_fragtree(struct rb_root *root, struct jffs2_sb_info *c)
+void jffs2_kill_fragtree(struct rb_root *root, struct jffs2_sb_info *c, int deleted)
 {
 	struct jffs2_node_frag *frag;
 	struct jffs2_node_frag *parent;
@@ -584,7 +595,7 @@ void jffs2_kill_fragtree(struct rb_root *root, struct jffs2_sb_info *c)
 		if (frag->node && !(--frag->node->frags)) {
 			/* Not a hole, and it's the final remaining frag
 			   of this node. Free the node */
-			if (c)
+			if (deleted)
 				jffs2_mark_node_obsolete(c, frag->node->raw);
 
 			jffs2_free_full_dnode(frag->node);
@@ -598,6 +609,7 @@ void jffs2_kill_fragtree(struct rb_root *root, struct jffs2_sb_info *c)
 		}
 
 		jffs2_free_node_frag(frag);
+		atomic_dec(&c->nr_frags);
 		frag = parent;
 
 		cond_resched();
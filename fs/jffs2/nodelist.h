@@ -287,6 +287,7 @@ struct jffs2_eraseblock
 	struct jffs2_raw_node_ref *last_node;
 
 	struct jffs2_raw_node_ref *gc_node;	/* Next node to be garbage collected */
+	int no_summary;		/* Holds nodes, but was scanned without a summary */
 };
 
 static inline int jffs2_blocks_use_vmalloc(struct jffs2_sb_info *c)
@@ -365,7 +366,7 @@ void jffs2_del_ino_cache(struct jffs2_sb_info *c, struct jffs2_inode_cache *old)
 void jffs2_free_ino_caches(struct jffs2_sb_info *c);
 void jffs2_free_raw_node_refs(struct jffs2_sb_info *c);
 struct jffs2_node_frag *jffs2_lookup_node_frag(struct rb_root *fragtree, uint32_t offset);
-void jffs2_kill_fragtree(struct rb_root *root, struct jffs2_sb_info *c_delete);
+void jffs2_kill_fragtree(struct rb_root *root, struct jffs2_sb_info *c, int deleted);
 int jffs2_add_full_dnode_to_inode(struct jffs2_sb_info *c, struct jffs2_inode_info *f, struct jffs2_full_dnode *fn);
 uint32_t jffs2_truncate_fragtree (struct jffs2_sb_info *c, struct rb_root *list, uint32_t size);
 struct jffs2_raw_node_ref *jffs2_link_node_ref(struct jffs2_sb_info *c,
@@ -467,6 +468,19 @@ int jffs2_do_mount_fs(struct jffs2_sb_info *c);
 int jffs2_erase_pending_blocks(struct jffs2_sb_info *c, int count);
 void jffs2_free_jeb_node_refs(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb);
 
+#ifdef CONFIG_PROC_FS
+/* proc.c */
+void jffs2_proc_add_sb(struct jffs2_sb_info *c);
+void jffs2_proc_remove_sb(struct jffs2_sb_info *c);
+void jffs2_proc_init(void);
+void jffs2_proc_exit(void);
+#else
+static inline void jffs2_proc_add_sb(struct jffs2_sb_info *c) { }
+static inline void jffs2_proc_remove_sb(struct jffs2_sb_info *c) { }
+static inline void jffs2_proc_init(void) { }
+static inline void jffs2_proc_exit(void) { }
+#endif
+
 #ifdef CONFIG_JFFS2_FS_WRITEBUFFER
 /* wbuf.c */
 int jffs2_flush_wbuf_gc(struct jffs2_sb_info *c, uint32_t ino);
@@ -0,0 +1,115 @@
+/*
+ * JFFS2 -- Journalling Flash File System, Version 2.
+ *
+ * For licensing information, see the file 'LICENCE' in this directory.
+ *
+ */
+
+#include <linux/kernel.h>
+#include <linux/fs.h>
+#include <linux/proc_fs.h>
+#include <linux/seq_file.h>
+#include <linux/mtd/mtd.h>
+#include "nodelist.h"
+
+/*
+ * /proc/fs/jffs2/mtdN reports the memory a mounted file system uses for
+ * the structures which grow with the size of the flash (eraseblocks,
+ * node references and inode caches), and for the fragment trees of the
+ * inodes which are currently in core.
+ */
+
+static struct proc_dir_entry *jffs2_proc_root;
+
+static int jffs2_mem_show(struct seq_file *m, void *v)
+{
+	struct jffs2_sb_info *c = m->private;
+	struct jffs2_raw_node_ref *ref;
+	struct jffs2_inode_cache *ic;
+	unsigned long refs = 0, refblocks, inocaches = 0, frags;
+	size_t blocks_mem, refs_mem, ic_mem, frags_mem;
+	int i;
+
+	for (i = 0; i < c->nr_blocks; i++) {
+		struct jffs2_eraseblock *jeb = &c->blocks[i];
+
+		spin_lock(&c->erase_completion_lock);
+		for (ref = jeb->first_node; ref; ref = ref_next(ref))
+			refs++;
+		spin_unlock(&c->erase_completion_lock);
+		cond_resched();
+	}
+
+	spin_lock(&c->inocache_lock);
+	for (i = 0; i < c->inocache_hashsize; i++)
+		for (ic = c->inocache_list[i]; ic; ic = ic->next)
+			inocaches++;
+	spin_unlock(&c->inocache_lock);
+
+	refblocks = atomic_read(&c->nr_refblocks);
+	frags = atomic_read(&c->nr_frags);
+
+	blocks_mem = c->nr_blocks * sizeof(struct jffs2_eraseblock);
+	refs_mem = refblocks * (REFS_PER_BLOCK + 1) * sizeof(struct jffs2_raw_node_ref);
+	ic_mem = inocaches * sizeof(struct jffs2_inode_cache) +
+		c->inocache_hashsize * sizeof(struct jffs2_inode_cache *);
+	frags_mem = frags * sizeof(struct jffs2_node_frag);
+
+	seq_printf(m, "eraseblocks:   %8u  %10zu bytes\n", c->nr_blocks, blocks_mem);
+	seq_printf(m, "node refs:     %8lu  %10zu bytes (%lu refs in %lu blocks of %u)\n",
+		   refs, refs_mem, refblocks * REFS_PER_BLOCK, refblocks,
+		   (unsigned int)REFS_PER_BLOCK);
+	seq_printf(m, "inode caches:  %8lu  %10zu bytes\n", inocaches, ic_mem);
+	seq_printf(m, "fragments:     %8lu  %10zu bytes\n", frags, frags_mem);
+	seq_printf(m, "total:                   %10zu bytes\n",
+		   blocks_mem + refs_mem + ic_mem + frags_mem);
+	return 0;
+}
+
+static int jffs2_mem_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, jffs2_mem_show, PDE(inode)->data);
+}
+
+static const struct file_operations jffs2_mem_fops = {
+	.owner		= THIS_MODULE,
+	.open		= jffs2_mem_open,
+	.read		= seq_read,
+	.llseek		= seq_lseek,
+	.release	= single_release,
+};
+
+void jffs2_proc_add_sb(struct jffs2_sb_info *c)
+{
+	char name[16];
+
+	if (!jffs2_proc_root)
+		return;
+
+	snprintf(name, sizeof(name), "mtd%d", c->mtd->index);
+	if (!proc_create_data(name, S_IRUGO, jffs2_proc_root, &jffs2_mem_fops, c))
+		printk(KERN_WARNING "JFFS2: Failed to create /proc/fs/jffs2/%s\n", name);
+}
+
+void jffs2_proc_remove_sb(struct jffs2_sb_info *c)
+{
+	char name[16];
+
+	if (!jffs2_proc_root)
+		return;
+
+	snprintf(name, sizeof(name), "mtd%d", c->mtd->index);
+	remove_proc_entry(name, jffs2_proc_root);
+}
+
+void jffs2_proc_init(void)
+{
+	/* Not worth failing to load for */
+	jffs2_proc_root = proc_mkdir("fs/jffs2", NULL);
+}
+
+void jffs2_proc_exit(void)
+{
+	if (jffs2_proc_root)
+		remove_proc_entry("fs/jffs2", NULL);
+}
@@ -1323,6 +1323,7 @@ static int jffs2_do_read_inode_internal(struct jffs2_sb_info *c,
 		/* OK. We're happy */
 		f->metadata = frag_first(&f->fragtree)->node;
 		jffs2_free_node_frag(frag_first(&f->fragtree));
+		atomic_dec(&c->nr_frags);
 		f->fragtree = RB_ROOT;
 		break;
 	}
@@ -1437,7 +1438,7 @@ void jffs2_do_clear_inode(struct jffs2_sb_info *c, struct jffs2_inode_info *f)
 		jffs2_free_full_dnode(f->metadata);
 	}
 
-	jffs2_kill_fragtree(&f->fragtree, deleted?c:NULL);
+	jffs2_kill_fragtree(&f->fragtree, c, deleted);
 
 	if (f->target) {
 		kfree(f->target);
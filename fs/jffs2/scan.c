@@ -10,8 +10,11 @@
  */
 
 #include <linux/kernel.h>
+#include <linux/moduleparam.h>
 #include <linux/sched.h>
 #include <linux/slab.h>
+#include <linux/completion.h>
+#include <linux/workqueue.h>
 #include <linux/mtd/mtd.h>
 #include <linux/pagemap.h>
 #include <linux/crc32.h>
@@ -34,17 +37,45 @@
 
 static uint32_t pseudo_random;
 
+/*
+ * Eraseblocks without a summary have to be read and parsed in full.  To
+ * keep the flash busy while they are parsed, up to scan_ahead - 1 of the
+ * following eraseblocks are read in advance by work items, which also
+ * check the CRCs of the nodes they find.  The parsing is still done in
+ * order by the mounting thread, from memory as for a point()ed flash,
+ * and it skips the CRCs which were found good.
+ */
+static unsigned int scan_ahead = 4;
+module_param(scan_ahead, uint, 0644);
+MODULE_PARM_DESC(scan_ahead, "Eraseblocks being read or parsed at a time by the mount-time scan (0 or 1 to disable read-ahead)");
+
+struct jffs2_scan_ahead {
+	struct work_struct work;
+	struct completion done;
+	struct jffs2_sb_info *c;
+	struct jffs2_eraseblock *jeb;	/* NULL if not queued */
+	unsigned char *buf;		/* the whole eraseblock */
+	unsigned long *crc_ok;		/* nodes with good CRCs, by word offset */
+	int ret;
+};
+
 static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
-				  unsigned char *buf, uint32_t buf_size, struct jffs2_summary *s);
+				  unsigned char *buf, uint32_t buf_size, struct jffs2_summary *s,
+				  unsigned long *crc_ok);
+
+static int jffs2_fill_scan_buf(struct jffs2_sb_info *c, void *buf,
+			       uint32_t ofs, uint32_t len);
 
 /* These helper functions _must_ increase ofs and also do the dirty/used space accounting.
  * Returning an error will abort the mount - bad checksums etc. should just mark the space
  * as dirty.
  */
 static int jffs2_scan_inode_node(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
-				 struct jffs2_raw_inode *ri, uint32_t ofs, struct jffs2_summary *s);
+				 struct jffs2_raw_inode *ri, uint32_t ofs, struct jffs2_summary *s,
+				 int crc_checked);
 static int jffs2_scan_dirent_node(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
-				 struct jffs2_raw_dirent *rd, uint32_t ofs, struct jffs2_summary *s);
+				 struct jffs2_raw_dirent *rd, uint32_t ofs, struct jffs2_summary *s,
+				 int crc_checked);
 
 static inline int min_free(struct jffs2_sb_info *c)
 {
@@ -86,6 +117,147 @@ static int file_dirty(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb)
 	return 0;
 }
 
+/* Walk the nodes in an eraseblock the way jffs2_scan_eraseblock() will,
+   and note those whose header, node and (for dirents) name CRCs are good */
+static void jffs2_scan_check_crcs(struct jffs2_sb_info *c, unsigned char *buf,
+				  unsigned long *crc_ok)
+{
+	struct jffs2_unknown_node *node;
+	struct jffs2_unknown_node crcnode;
+	struct jffs2_raw_inode *ri;
+	struct jffs2_raw_dirent *rd;
+	uint32_t ofs = 0, totlen;
+
+	bitmap_zero(crc_ok, c->sector_size / 4);
+
+	while (ofs + sizeof(*node) <= c->sector_size) {
+		node = (struct jffs2_unknown_node *)&buf[ofs];
+
+		if (je16_to_cpu(node->magic) != JFFS2_MAGIC_BITMASK) {
+			ofs += 4;
+			continue;
+		}
+
+		crcnode.magic = node->magic;
+		crcnode.nodetype = cpu_to_je16( je16_to_cpu(node->nodetype) | JFFS2_NODE_ACCURATE);
+		crcnode.totlen = node->totlen;
+		totlen = je32_to_cpu(node->totlen);
+
+		if (crc32(0, &crcnode, sizeof(crcnode)-4) != je32_to_cpu(node->hdr_crc) ||
+		    totlen < sizeof(*node) || totlen > c->sector_size - ofs) {
+			ofs += 4;
+			continue;
+		}
+
+		switch(je16_to_cpu(node->nodetype)) {
+		case JFFS2_NODETYPE_INODE:
+			ri = (struct jffs2_raw_inode *)node;
+			if (totlen >= sizeof(*ri) &&
+			    crc32(0, ri, sizeof(*ri)-8) == je32_to_cpu(ri->node_crc))
+				__set_bit(ofs / 4, crc_ok);
+			break;
+
+		case JFFS2_NODETYPE_DIRENT:
+			rd = (struct jffs2_raw_dirent *)node;
+			/* Names with zeroes in them are left to the scan */
+			if (totlen >= sizeof(*rd) + rd->nsize &&
+			    crc32(0, rd, sizeof(*rd)-8) == je32_to_cpu(rd->node_crc) &&
+			    strnlen(rd->name, rd->nsize) == rd->nsize &&
+			    crc32(0, rd->name, rd->nsize) == je32_to_cpu(rd->name_crc))
+				__set_bit(ofs / 4, crc_ok);
+			break;
+		}
+
+		ofs += PAD(totlen);
+	}
+}
+
+static void jffs2_scan_ahead_work(struct work_struct *work)
+{
+	struct jffs2_scan_ahead *ra = container_of(work, struct jffs2_scan_ahead, work);
+	struct jffs2_sb_info *c = ra->c;
+	uint32_t ofs, len = EMPTY_SCAN_SIZE(c->sector_size);
+
+	/* Leave bad blocks, and blocks we can't read, to jffs2_scan_eraseblock() */
+	if (jffs2_cleanmarker_oob(c) && c->mtd->block_isbad(c->mtd, ra->jeb->offset)) {
+		ra->ret = -EIO;
+		goto out;
+	}
+
+	ra->ret = jffs2_fill_scan_buf(c, ra->buf, ra->jeb->offset, len);
+	if (ra->ret)
+		goto out;
+
+	/* Likewise blocks which start out empty: it only looks at their start */
+	for (ofs = 0; ofs < len && *(uint32_t *)&ra->buf[ofs] == 0xFFFFFFFF; ofs += 4)
+		;
+	if (ofs == len) {
+		ra->ret = 1;
+		goto out;
+	}
+
+	ra->ret = jffs2_fill_scan_buf(c, ra->buf + len, ra->jeb->offset + len,
+				      c->sector_size - len);
+	if (!ra->ret)
+		jffs2_scan_check_crcs(c, ra->buf, ra->crc_ok);
+out:
+	complete(&ra->done);
+}
+
+static void jffs2_scan_ahead_queue(struct jffs2_scan_ahead *ra,
+				   struct jffs2_eraseblock *jeb)
+{
+	ra->jeb = jeb;
+	INIT_COMPLETION(ra->done);
+	queue_work(system_unbound_wq, &ra->work);
+}
+
+static void jffs2_scan_ahead_free(struct jffs2_scan_ahead *ra, int nr)
+{
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		flush_work(&ra[i].work);
+		kfree(ra[i].crc_ok);
+		kfree(ra[i].buf);
+	}
+	kfree(ra);
+}
+
+static struct jffs2_scan_ahead *jffs2_scan_ahead_alloc(struct jffs2_sb_info *c, int *nr)
+{
+	struct jffs2_scan_ahead *ra;
+	int i, n = min_t(unsigned int, ACCESS_ONCE(scan_ahead), c->nr_blocks);
+
+	*nr = 0;
+
+	/* Respect kmalloc limitations, as for the ordinary scan buffer */
+	if (n < 2 || c->sector_size > 128*1024)
+		return NULL;
+
+	ra = kcalloc(n, sizeof(*ra), GFP_KERNEL);
+	if (!ra)
+		return NULL;
+
+	for (i = 0; i < n; i++) {
+		INIT_WORK(&ra[i].work, jffs2_scan_ahead_work);
+		init_completion(&ra[i].done);
+		ra[i].c = c;
+		ra[i].buf = kmalloc(c->sector_size, GFP_KERNEL);
+		ra[i].crc_ok = kmalloc(BITS_TO_LONGS(c->sector_size / 4) * sizeof(long),
+				       GFP_KERNEL);
+		if (!ra[i].buf || !ra[i].crc_ok) {
+			/* Not worth failing the mount for; just scan serially */
+			D1(printk(KERN_DEBUG "Can't allocate %d read-ahead buffers for the scan\n", n));
+			jffs2_scan_ahead_free(ra, i + 1);
+			return NULL;
+		}
+	}
+
+	*nr = n;
+	return ra;
+}
+
 int jffs2_scan_medium(struct jffs2_sb_info *c)
 {
 	int i, ret;
@@ -93,6 +265,8 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 	unsigned char *flashbuf = NULL;
 	uint32_t buf_size = 0;
 	struct jffs2_summary *s = NULL; /* summary info collected by the scan process */
+	struct jffs2_scan_ahead *ra = NULL;
+	int nr_ahead = 0, next_ahead = 0, ahead;
 #ifndef __ECOS
 	size_t pointlen;
 
@@ -125,7 +299,10 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 		flashbuf = kmalloc(buf_size, GFP_KERNEL);
 		if (!flashbuf)
 			return -ENOMEM;
+
+		ra = jffs2_scan_ahead_alloc(c, &nr_ahead);
 	}
+	ahead = nr_ahead;
 
 	if (jffs2_sum_active()) {
 		s = kzalloc(sizeof(struct jffs2_summary), GFP_KERNEL);
@@ -138,18 +315,40 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 
 	for (i=0; i<c->nr_blocks; i++) {
 		struct jffs2_eraseblock *jeb = &c->blocks[i];
+		struct jffs2_scan_ahead *slot = NULL;
 
 		cond_resched();
 
+		if (ahead) {
+			if (next_ahead <= i)
+				next_ahead = i + 1;
+			for (; next_ahead < c->nr_blocks && next_ahead < i + nr_ahead; next_ahead++)
+				jffs2_scan_ahead_queue(&ra[next_ahead % nr_ahead],
+						       &c->blocks[next_ahead]);
+		}
+
+		if (nr_ahead && ra[i % nr_ahead].jeb == jeb) {
+			slot = &ra[i % nr_ahead];
+			wait_for_completion(&slot->done);
+			slot->jeb = NULL;
+		}
+
 		/* reset summary info for next eraseblock scan */
 		jffs2_sum_reset_collected(s);
 
-		ret = jffs2_scan_eraseblock(c, jeb, buf_size?flashbuf:(flashbuf+jeb->offset),
-						buf_size, s);
+		if (slot && !slot->ret)
+			ret = jffs2_scan_eraseblock(c, jeb, slot->buf, 0, s, slot->crc_ok);
+		else
+			ret = jffs2_scan_eraseblock(c, jeb, buf_size?flashbuf:(flashbuf+jeb->offset),
+						    buf_size, s, NULL);
 
 		if (ret < 0)
 			goto out;
 
+		/* Blocks with summaries, or without nodes, need little reading.
+		   Only read ahead while the blocks need scanning in full. */
+		ahead = nr_ahead && (!jffs2_sum_active() || jeb->no_summary);
+
 		jffs2_dbg_acct_paranoia_check_nolock(c, jeb);
 
 		/* Now decide which list to put it on */
@@ -266,6 +465,8 @@ int jffs2_scan_medium(struct jffs2_sb_info *c)
 	}
 	ret = 0;
  out:
+	if (ra)
+		jffs2_scan_ahead_free(ra, nr_ahead);
 	if (buf_size)
 		kfree(flashbuf);
 #ifndef __ECOS
@@ -430,14 +631,16 @@ static int jffs2_scan_xref_node(struct jffs2_sb_info *c, struct jffs2_eraseblock
 #endif
 
 /* Called with 'buf_size == 0' if buf is in fact a pointer _directly_ into
-   the flash, XIP-style */
+   the flash, XIP-style, or to a copy of the whole eraseblock.  In the latter
+   case, crc_ok may point to the nodes whose CRCs were already found good. */
 static int jffs2_scan_eraseblock (struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
-				  unsigned char *buf, uint32_t buf_size, struct jffs2_summary *s) {
+				  unsigned char *buf, uint32_t buf_size, struct jffs2_summary *s,
+				  unsigned long *crc_ok) {
 	struct jffs2_unknown_node *node;
 	struct jffs2_unknown_node crcnode;
 	uint32_t ofs, prevofs, max_ofs;
 	uint32_t hdr_crc, buf_ofs, buf_len;
-	int err;
+	int err, crc_checked;
 	int noise = 0;
 
 
@@ -726,10 +929,15 @@ scan_more:
 			continue;
 		}
 		/* We seem to have a node of sorts. Check the CRC */
-		crcnode.magic = node->magic;
-		crcnode.nodetype = cpu_to_je16( je16_to_cpu(node->nodetype) | JFFS2_NODE_ACCURATE);
-		crcnode.totlen = node->totlen;
-		hdr_crc = crc32(0, &crcnode, sizeof(crcnode)-4);
+		crc_checked = crc_ok && test_bit((ofs - jeb->offset) / 4, crc_ok);
+		if (crc_checked) {
+			hdr_crc = je32_to_cpu(node->hdr_crc);
+		} else {
+			crcnode.magic = node->magic;
+			crcnode.nodetype = cpu_to_je16( je16_to_cpu(node->nodetype) | JFFS2_NODE_ACCURATE);
+			crcnode.totlen = node->totlen;
+			hdr_crc = crc32(0, &crcnode, sizeof(crcnode)-4);
+		}
 
 		if (hdr_crc != je32_to_cpu(node->hdr_crc)) {
 			noisy_printk(&noise, "jffs2_scan_eraseblock(): Node at 0x%08x {0x%04x, 0x%04x, 0x%08x) has invalid CRC 0x%08x (calculated 0x%08x)\n",
@@ -776,7 +984,7 @@ scan_more:
 				buf_ofs = ofs;
 				node = (void *)buf;
 			}
-			err = jffs2_scan_inode_node(c, jeb, (void *)node, ofs, s);
+			err = jffs2_scan_inode_node(c, jeb, (void *)node, ofs, s, crc_checked);
 			if (err) return err;
 			ofs += PAD(je32_to_cpu(node->totlen));
 			break;
@@ -792,7 +1000,7 @@ scan_more:
 				buf_ofs = ofs;
 				node = (void *)buf;
 			}
-			err = jffs2_scan_dirent_node(c, jeb, (void *)node, ofs, s);
+			err = jffs2_scan_dirent_node(c, jeb, (void *)node, ofs, s, crc_checked);
 			if (err) return err;
 			ofs += PAD(je32_to_cpu(node->totlen));
 			break;
@@ -918,7 +1126,11 @@ scan_more:
 		jeb->wasted_size = 0;
 	}
 
-	return jffs2_scan_classify_jeb(c, jeb);
+	err = jffs2_scan_classify_jeb(c, jeb);
+	/* Let GC know it may want to give this block a summary */
+	if (err == BLK_STATE_CLEAN || err == BLK_STATE_PARTDIRTY)
+		jeb->no_summary = 1;
+	return err;
 }
 
 struct jffs2_inode_cache *jffs2_scan_make_ino_cache(struct jffs2_sb_info *c, uint32_t ino)
@@ -948,7 +1160,8 @@ struct jffs2_inode_cache *jffs2_scan_make_ino_cache(struct jffs2_sb_info *c, uin
 }
 
 static int jffs2_scan_inode_node(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
-				 struct jffs2_raw_inode *ri, uint32_t ofs, struct jffs2_summary *s)
+				 struct jffs2_raw_inode *ri, uint32_t ofs, struct jffs2_summary *s,
+				 int crc_checked)
 {
 	struct jffs2_inode_cache *ic;
 	uint32_t crc, ino = je32_to_cpu(ri->ino);
@@ -964,8 +1177,8 @@ static int jffs2_scan_inode_node(struct jffs2_sb_info *c, struct jffs2_erasebloc
 	   Which means that the _full_ amount of time to get to proper write mode with GC
 	   operational may actually be _longer_ than before. Sucks to be me. */
 
-	/* Check the node CRC in any case. */
-	crc = crc32(0, ri, sizeof(*ri)-8);
+	/* Check the node CRC in any case, unless it has been already. */
+	crc = crc_checked ? je32_to_cpu(ri->node_crc) : crc32(0, ri, sizeof(*ri)-8);
 	if (crc != je32_to_cpu(ri->node_crc)) {
 		printk(KERN_NOTICE "jffs2_scan_inode_node(): CRC failed on "
 		       "node at 0x%08x: Read 0x%08x, calculated 0x%08x\n",
@@ -1003,7 +1216,8 @@ static int jffs2_scan_inode_node(struct jffs2_sb_info *c, struct jffs2_erasebloc
 }
 
 static int jffs2_scan_dirent_node(struct jffs2_sb_info *c, struct jffs2_eraseblock *jeb,
-				  struct jffs2_raw_dirent *rd, uint32_t ofs, struct jffs2_summary *s)
+				  struct jffs2_raw_dirent *rd, uint32_t ofs, struct jffs2_summary *s,
+				  int crc_checked)
 {
 	struct jffs2_full_dirent *fd;
 	struct jffs2_inode_cache *ic;
@@ -1015,7 +1229,7 @@ static int jffs2_scan_dirent_node(struct jffs2_sb_info *c, struct jffs2_eraseblo
 
 	/* We don't get here unless the node is still valid, so we don't have to
 	   mask in the ACCURATE bit any more. */
-	crc = crc32(0, rd, sizeof(*rd)-8);
+	crc = crc_checked ? je32_to_cpu(rd->node_crc) : crc32(0, rd, sizeof(*rd)-8);
 
 	if (crc != je32_to_cpu(rd->node_crc)) {
 		printk(KERN_NOTICE "jffs2_scan_dirent_node(): Node CRC failed on node at 0x%08x: Read 0x%08x, calculated 0x%08x\n",
@@ -1041,7 +1255,7 @@ static int jffs2_scan_dirent_node(struct jffs2_sb_info *c, struct jffs2_eraseblo
 	memcpy(&fd->name, rd->name, checkedlen);
 	fd->name[checkedlen] = 0;
 
-	crc = crc32(0, fd->name, rd->nsize);
+	crc = crc_checked ? je32_to_cpu(rd->name_crc) : crc32(0, fd->name, rd->nsize);
 	if (crc != je32_to_cpu(rd->name_crc)) {
 		printk(KERN_NOTICE "jffs2_scan_dirent_node(): Name CRC failed on node at 0x%08x: Read 0x%08x, calculated 0x%08x\n",
 		       ofs, je32_to_cpu(rd->name_crc), crc);
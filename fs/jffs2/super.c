@@ -176,6 +176,8 @@ static int jffs2_fill_super(struct super_block *sb, void *data, int silent)
 	sb->s_flags |= MS_POSIXACL;
 #endif
 	ret = jffs2_do_fill_super(sb, data, silent);
+	if (!ret)
+		jffs2_proc_add_sb(c);
 	return ret;
 }
 
@@ -192,6 +194,8 @@ static void jffs2_put_super (struct super_block *sb)
 
 	D2(printk(KERN_DEBUG "jffs2: jffs2_put_super()\n"));
 
+	jffs2_proc_remove_sb(c);
+
 	if (sb->s_dirt)
 		jffs2_write_super(sb);
 
@@ -276,14 +280,16 @@ static int __init init_jffs2_fs(void)
 		printk(KERN_ERR "JFFS2 error: Failed to initialise slab caches\n");
 		goto out_compressors;
 	}
+	jffs2_proc_init();
 	ret = register_filesystem(&jffs2_fs_type);
 	if (ret) {
 		printk(KERN_ERR "JFFS2 error: Failed to register filesystem\n");
-		goto out_slab;
+		goto out_proc;
 	}
 	return 0;
 
- out_slab:
+ out_proc:
+	jffs2_proc_exit();
 	jffs2_destroy_slab_caches();
  out_compressors:
 	jffs2_compressors_exit();
@@ -295,6 +301,7 @@ static int __init init_jffs2_fs(void)
 static void __exit exit_jffs2_fs(void)
 {
 	unregister_filesystem(&jffs2_fs_type);
+	jffs2_proc_exit();
 	jffs2_destroy_slab_caches();
 	jffs2_compressors_exit();
 	kmem_cache_destroy(jffs2_inode_cachep);
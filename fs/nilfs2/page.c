@@ -404,6 +404,7 @@ repeat:
 			page_cache_release(dpage);
 		} else {
 			struct page *page2;
+			void **slot;
 
 			/* move the page to the destination cache */
 			spin_lock_irq(&smap->tree_lock);
@@ -414,7 +415,15 @@ repeat:
 			spin_unlock_irq(&smap->tree_lock);
 
 			spin_lock_irq(&dmap->tree_lock);
-			err = radix_tree_insert(&dmap->page_tree, offset, page);
+			slot = radix_tree_lookup_slot(&dmap->page_tree, offset);
+			if (slot && radix_tree_exceptional_entry(*slot)) {
+				/* take over the slot of an evicted page */
+				radix_tree_replace_slot(slot, page);
+				dmap->nrshadows--;
+				err = 0;
+			} else
+				err = radix_tree_insert(&dmap->page_tree,
+							offset, page);
 			if (unlikely(err < 0)) {
 				WARN_ON(err == -EEXIST);
 				page->mapping = NULL;
@@ -26,30 +26,45 @@
 struct squashfs_decompressor {
 	void	*(*init)(struct squashfs_sb_info *);
 	void	(*free)(void *);
-	int	(*decompress)(struct squashfs_sb_info *, void **,
+	int	(*decompress)(struct squashfs_sb_info *, void *, void **,
 		struct buffer_head **, int, int, int, int, int);
 	int	id;
 	char	*name;
 	int	supported;
 };
 
+/*
+ * Decompressor thread modes.  These decide how many decompressor streams
+ * a filesystem has, and how concurrent readers share them.  Create
+ * returns the mode's private data, which is stored in msblk->stream.  The
+ * buffer_heads passed to decompress are up to date.
+ */
+struct squashfs_decompressor_thread_ops {
+	void	*(*create)(struct squashfs_sb_info *);
+	void	(*destroy)(struct squashfs_sb_info *);
+	int	(*decompress)(struct squashfs_sb_info *, void **,
+		struct buffer_head **, int, int, int, int, int);
+	int	(*max_decompressors)(struct squashfs_sb_info *);
+	char	*name;
+};
+
 static inline void *squashfs_decompressor_init(struct squashfs_sb_info *msblk)
 {
-	return msblk->decompressor->init(msblk);
+	return msblk->thread_ops->create(msblk);
 }
 
 static inline void squashfs_decompressor_free(struct squashfs_sb_info *msblk,
 	void *s)
 {
-	if (msblk->decompressor)
-		msblk->decompressor->free(s);
+	if (msblk->decompressor && s)
+		msblk->thread_ops->destroy(msblk);
 }
 
 static inline int squashfs_decompress(struct squashfs_sb_info *msblk,
 	void **buffer, struct buffer_head **bh, int b, int offset, int length,
 	int srclength, int pages)
 {
-	return msblk->decompressor->decompress(msblk, buffer, bh, b, offset,
+	return msblk->thread_ops->decompress(msblk, buffer, bh, b, offset,
 		length, srclength, pages);
 }
 #endif
@@ -54,10 +54,29 @@ extern int squashfs_read_table(struct super_block *, void *, u64, int);
 /* decompressor.c */
 extern const struct squashfs_decompressor *squashfs_lookup_decompressor(int);
 
+/* decompressor_single.c */
+extern const struct squashfs_decompressor_thread_ops
+				squashfs_decompressor_single;
+
+/* decompressor_multi.c */
+extern const struct squashfs_decompressor_thread_ops
+				squashfs_decompressor_multi;
+
+/* decompressor_multi_percpu.c */
+extern const struct squashfs_decompressor_thread_ops
+				squashfs_decompressor_percpu;
+
 /* export.c */
 extern __le64 *squashfs_read_inode_lookup_table(struct super_block *, u64,
 				unsigned int);
 
+/* file.c */
+extern void squashfs_copy_cache(struct page *, struct squashfs_cache_entry *,
+				int, int);
+
+/* file_xxx.c */
+extern int squashfs_readpage_block(struct page *, u64, int);
+
 /* fragment.c */
 extern int squashfs_frag_lookup(struct super_block *, unsigned int, u64 *);
 extern __le64 *squashfs_read_fragment_index_table(struct super_block *,
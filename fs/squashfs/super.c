@@ -36,6 +36,9 @@
 #include <linux/module.h>
 #include <linux/magic.h>
 #include <linux/xattr.h>
+#include <linux/parser.h>
+#include <linux/seq_file.h>
+#include <linux/mount.h>
 
 #include "squashfs_fs.h"
 #include "squashfs_fs_sb.h"
@@ -74,6 +77,96 @@ static const struct squashfs_decompressor *supported_squashfs_filesystem(short
 }
 
 
+#if defined(CONFIG_SQUASHFS_DECOMP_MULTI_PERCPU)
+#define SQUASHFS_DEFAULT_THREAD_OPS	(&squashfs_decompressor_percpu)
+#elif defined(CONFIG_SQUASHFS_DECOMP_MULTI)
+#define SQUASHFS_DEFAULT_THREAD_OPS	(&squashfs_decompressor_multi)
+#else
+#define SQUASHFS_DEFAULT_THREAD_OPS	(&squashfs_decompressor_single)
+#endif
+
+enum {
+	Opt_threads,
+	Opt_err
+};
+
+static const match_table_t squashfs_tokens = {
+	{Opt_threads, "threads=%s"},
+	{Opt_err, NULL}
+};
+
+
+static int squashfs_parse_threads(struct squashfs_sb_info *msblk, char *str)
+{
+	unsigned long num;
+
+	msblk->max_thread_num = 0;
+
+	if (!strcmp(str, "single")) {
+		msblk->thread_ops = &squashfs_decompressor_single;
+		return 0;
+	} else if (!strcmp(str, "multi")) {
+		msblk->thread_ops = &squashfs_decompressor_multi;
+		return 0;
+	} else if (!strcmp(str, "percpu")) {
+		msblk->thread_ops = &squashfs_decompressor_percpu;
+		return 0;
+	}
+
+	/*
+	 * Each decompressor comes with a data block cache entry, so do not
+	 * allow silly numbers.
+	 */
+	if (strict_strtoul(str, 10, &num) || num == 0 ||
+			num > num_possible_cpus() * 2)
+		return -EINVAL;
+
+	if (num == 1)
+		msblk->thread_ops = &squashfs_decompressor_single;
+	else {
+		msblk->thread_ops = &squashfs_decompressor_multi;
+		msblk->max_thread_num = num;
+	}
+
+	return 0;
+}
+
+
+static int squashfs_parse_options(struct squashfs_sb_info *msblk, char *data)
+{
+	substring_t args[MAX_OPT_ARGS];
+	char *p, *str;
+	int err;
+
+	msblk->thread_ops = SQUASHFS_DEFAULT_THREAD_OPS;
+
+	while ((p = strsep(&data, ",")) != NULL) {
+		if (!*p)
+			continue;
+
+		switch (match_token(p, squashfs_tokens, args)) {
+		case Opt_threads:
+			str = match_strdup(&args[0]);
+			if (str == NULL)
+				return -ENOMEM;
+			err = squashfs_parse_threads(msblk, str);
+			kfree(str);
+			if (err) {
+				ERROR("Invalid threads mount option \"%s\"\n",
+					p);
+				return err;
+			}
+			break;
+		default:
+			ERROR("Unrecognized mount option \"%s\"\n", p);
+			return -EINVAL;
+		}
+	}
+
+	return 0;
+}
+
+
 static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 {
 	struct squashfs_sb_info *msblk;
@@ -101,10 +194,13 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 		goto failure;
 	}
 
+	err = squashfs_parse_options(msblk, data);
+	if (err)
+		goto failed_mount;
+
 	msblk->devblksize = sb_min_blocksize(sb, BLOCK_SIZE);
 	msblk->devblksize_log2 = ffz(~msblk->devblksize);
 
-	mutex_init(&msblk->read_data_mutex);
 	mutex_init(&msblk->meta_index_mutex);
 
 	/*
@@ -208,8 +304,12 @@ static int squashfs_fill_super(struct super_block *sb, void *data, int silent)
 	if (msblk->block_cache == NULL)
 		goto failed_mount;
 
-	/* Allocate read_page block */
-	msblk->read_page = squashfs_cache_init("data", 1, msblk->block_size);
+	/*
+	 * Allocate read_page blocks, one for each reader which may be
+	 * decompressing at the same time
+	 */
+	msblk->read_page = squashfs_cache_init("data",
+		msblk->thread_ops->max_decompressors(msblk), msblk->block_size);
 	if (msblk->read_page == NULL) {
 		ERROR("Failed to allocate read_page block\n");
 		goto failed_mount;
@@ -344,6 +444,19 @@ static int squashfs_statfs(struct dentry *dentry, struct kstatfs *buf)
 }
 
 
+static int squashfs_show_options(struct seq_file *s, struct vfsmount *mnt)
+{
+	struct squashfs_sb_info *msblk = mnt->mnt_sb->s_fs_info;
+
+	if (msblk->max_thread_num)
+		seq_printf(s, ",threads=%d", msblk->max_thread_num);
+	else
+		seq_printf(s, ",threads=%s", msblk->thread_ops->name);
+
+	return 0;
+}
+
+
 static int squashfs_remount(struct super_block *sb, int *flags, char *data)
 {
 	*flags |= MS_RDONLY;
@@ -458,6 +571,7 @@ static const struct super_operations squashfs_super_ops = {
 	.alloc_inode = squashfs_alloc_inode,
 	.destroy_inode = squashfs_destroy_inode,
 	.statfs = squashfs_statfs,
+	.show_options = squashfs_show_options,
 	.put_super = squashfs_put_super,
 	.remount_fs = squashfs_remount
 };
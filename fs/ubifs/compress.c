@@ -25,9 +25,17 @@
 /*
  * This file provides a single place to access to compression and
  * decompression.
+ *
+ * Every compressor has a context with its own cryptoapi handle for each CPU,
+ * so that writers and readers running on different CPUs, or on different
+ * UBIFS volumes, do not wait for each other. The context is picked by the CPU
+ * the caller is running on, but the caller may be preempted and migrate while
+ * using it, so the context is still protected by mutexes.
  */
 
 #include <linux/crypto.h>
+#include <linux/percpu.h>
+#include <linux/ktime.h>
 #include "ubifs.h"
 
 /* Fake description object for the "none" compressor */
@@ -38,11 +46,8 @@ static struct ubifs_compressor none_compr = {
 };
 
 #ifdef CONFIG_UBIFS_FS_LZO
-static DEFINE_MUTEX(lzo_mutex);
-
 static struct ubifs_compressor lzo_compr = {
 	.compr_type = UBIFS_COMPR_LZO,
-	.comp_mutex = &lzo_mutex,
 	.name = "lzo",
 	.capi_name = "lzo",
 };
@@ -54,13 +59,8 @@ static struct ubifs_compressor lzo_compr = {
 #endif
 
 #ifdef CONFIG_UBIFS_FS_ZLIB
-static DEFINE_MUTEX(deflate_mutex);
-static DEFINE_MUTEX(inflate_mutex);
-
 static struct ubifs_compressor zlib_compr = {
 	.compr_type = UBIFS_COMPR_ZLIB,
-	.comp_mutex = &deflate_mutex,
-	.decomp_mutex = &inflate_mutex,
 	.name = "zlib",
 	.capi_name = "deflate",
 };
@@ -74,6 +74,38 @@ static struct ubifs_compressor zlib_compr = {
 /* All UBIFS compressors */
 struct ubifs_compressor *ubifs_compressors[UBIFS_COMPR_TYPES_CNT];
 
+#ifdef CONFIG_UBIFS_FS_DEBUG
+#define stats_start() ktime_get()
+
+/**
+ * stats_account - account a compressor call.
+ * @stats: the statistics to update
+ * @start: when the call started, see 'stats_start()'
+ * @in_len: input length
+ * @out_len: output length
+ */
+static void stats_account(struct ubifs_compr_stats *stats, ktime_t start,
+			  int in_len, int out_len)
+{
+	stats->calls += 1;
+	stats->in_bytes += in_len;
+	stats->out_bytes += out_len;
+	stats->ns += ktime_to_ns(ktime_sub(ktime_get(), start));
+}
+#else
+#define stats_start() ktime_set(0, 0)
+#define stats_account(stats, start, in_len, out_len) ((void)(start))
+#endif
+
+/**
+ * get_ctx - get the compressor context of the current CPU.
+ * @compr: compressor description object
+ */
+static inline struct ubifs_compr_ctx *get_ctx(struct ubifs_compressor *compr)
+{
+	return per_cpu_ptr(compr->ctx, raw_smp_processor_id());
+}
+
 /**
  * ubifs_compress - compress data.
  * @in_buf: data to compress
@@ -97,6 +129,8 @@ void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
 {
 	int err;
 	struct ubifs_compressor *compr = ubifs_compressors[*compr_type];
+	struct ubifs_compr_ctx *ctx;
+	ktime_t start;
 
 	if (*compr_type == UBIFS_COMPR_NONE)
 		goto no_compr;
@@ -105,12 +139,14 @@ void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
 	if (in_len < UBIFS_MIN_COMPR_LEN)
 		goto no_compr;
 
-	if (compr->comp_mutex)
-		mutex_lock(compr->comp_mutex);
-	err = crypto_comp_compress(compr->cc, in_buf, in_len, out_buf,
+	ctx = get_ctx(compr);
+	mutex_lock(&ctx->comp_mutex);
+	start = stats_start();
+	err = crypto_comp_compress(ctx->cc, in_buf, in_len, out_buf,
 				   (unsigned int *)out_len);
-	if (compr->comp_mutex)
-		mutex_unlock(compr->comp_mutex);
+	if (!err)
+		stats_account(&ctx->comp_stats, start, in_len, *out_len);
+	mutex_unlock(&ctx->comp_mutex);
 	if (unlikely(err)) {
 		ubifs_warn("cannot compress %d bytes, compressor %s, "
 			   "error %d, leave data uncompressed",
@@ -150,6 +186,8 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 {
 	int err;
 	struct ubifs_compressor *compr;
+	struct ubifs_compr_ctx *ctx;
+	ktime_t start;
 
 	if (unlikely(compr_type < 0 || compr_type >= UBIFS_COMPR_TYPES_CNT)) {
 		ubifs_err("invalid compression type %d", compr_type);
@@ -169,12 +207,14 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 		return 0;
 	}
 
-	if (compr->decomp_mutex)
-		mutex_lock(compr->decomp_mutex);
-	err = crypto_comp_decompress(compr->cc, in_buf, in_len, out_buf,
+	ctx = get_ctx(compr);
+	mutex_lock(&ctx->decomp_mutex);
+	start = stats_start();
+	err = crypto_comp_decompress(ctx->cc, in_buf, in_len, out_buf,
 				     (unsigned int *)out_len);
-	if (compr->decomp_mutex)
-		mutex_unlock(compr->decomp_mutex);
+	if (!err)
+		stats_account(&ctx->decomp_stats, start, in_len, *out_len);
+	mutex_unlock(&ctx->decomp_mutex);
 	if (err)
 		ubifs_err("cannot decompress %d bytes, compressor %s, "
 			  "error %d", in_len, compr->name, err);
@@ -182,6 +222,67 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
 	return err;
 }
 
+#ifdef CONFIG_UBIFS_FS_DEBUG
+/**
+ * ubifs_compr_get_stats - get compressor statistics.
+ * @compr: compressor description object
+ * @comp: compression statistics are returned here
+ * @decomp: decompression statistics are returned here
+ *
+ * This function sums up the statistics of all the contexts of @compr.
+ */
+void ubifs_compr_get_stats(struct ubifs_compressor *compr,
+			   struct ubifs_compr_stats *comp,
+			   struct ubifs_compr_stats *decomp)
+{
+	int cpu;
+
+	memset(comp, 0, sizeof(struct ubifs_compr_stats));
+	memset(decomp, 0, sizeof(struct ubifs_compr_stats));
+	if (!compr->ctx)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct ubifs_compr_ctx *ctx = per_cpu_ptr(compr->ctx, cpu);
+
+		mutex_lock(&ctx->comp_mutex);
+		comp->calls += ctx->comp_stats.calls;
+		comp->in_bytes += ctx->comp_stats.in_bytes;
+		comp->out_bytes += ctx->comp_stats.out_bytes;
+		comp->ns += ctx->comp_stats.ns;
+		mutex_unlock(&ctx->comp_mutex);
+
+		mutex_lock(&ctx->decomp_mutex);
+		decomp->calls += ctx->decomp_stats.calls;
+		decomp->in_bytes += ctx->decomp_stats.in_bytes;
+		decomp->out_bytes += ctx->decomp_stats.out_bytes;
+		decomp->ns += ctx->decomp_stats.ns;
+		mutex_unlock(&ctx->decomp_mutex);
+	}
+}
+#endif
+
+/**
+ * compr_exit - de-initialize a compressor.
+ * @compr: compressor description object
+ */
+static void compr_exit(struct ubifs_compressor *compr)
+{
+	int cpu;
+
+	if (!compr->ctx)
+		return;
+
+	for_each_possible_cpu(cpu) {
+		struct ubifs_compr_ctx *ctx = per_cpu_ptr(compr->ctx, cpu);
+
+		if (ctx->cc)
+			crypto_free_comp(ctx->cc);
+	}
+	free_percpu(compr->ctx);
+	compr->ctx = NULL;
+}
+
 /**
  * compr_init - initialize a compressor.
  * @compr: compressor description object
@@ -191,12 +292,28 @@ int ubifs_decompress(const void *in_buf, int in_len, void *out_buf,
  */
 static int __init compr_init(struct ubifs_compressor *compr)
 {
+	int cpu, err;
+
 	if (compr->capi_name) {
-		compr->cc = crypto_alloc_comp(compr->capi_name, 0, 0);
-		if (IS_ERR(compr->cc)) {
-			ubifs_err("cannot initialize compressor %s, error %ld",
-				  compr->name, PTR_ERR(compr->cc));
-			return PTR_ERR(compr->cc);
+		compr->ctx = alloc_percpu(struct ubifs_compr_ctx);
+		if (!compr->ctx)
+			return -ENOMEM;
+
+		for_each_possible_cpu(cpu) {
+			struct ubifs_compr_ctx *ctx;
+
+			ctx = per_cpu_ptr(compr->ctx, cpu);
+			mutex_init(&ctx->comp_mutex);
+			mutex_init(&ctx->decomp_mutex);
+			ctx->cc = crypto_alloc_comp(compr->capi_name, 0, 0);
+			if (IS_ERR(ctx->cc)) {
+				err = PTR_ERR(ctx->cc);
+				ctx->cc = NULL;
+				ubifs_err("cannot initialize compressor %s, "
+					  "error %d", compr->name, err);
+				compr_exit(compr);
+				return err;
+			}
 		}
 	}
 
@@ -204,17 +321,6 @@ static int __init compr_init(struct ubifs_compressor *compr)
 	return 0;
 }
 
-/**
- * compr_exit - de-initialize a compressor.
- * @compr: compressor description object
- */
-static void compr_exit(struct ubifs_compressor *compr)
-{
-	if (compr->capi_name)
-		crypto_free_comp(compr->cc);
-	return;
-}
-
 /**
  * ubifs_compressors_init - initialize UBIFS compressors.
  *
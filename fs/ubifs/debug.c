@@ -2719,24 +2719,83 @@ void ubifs_debugging_exit(struct ubifs_info *c)
  */
 static struct dentry *dfs_rootdir;
 
+/* The "compr_stats" file in the root directory */
+static struct dentry *dfs_compr_stats;
+
+static ssize_t read_compr_stats(struct file *file, char __user *u,
+				size_t count, loff_t *ppos)
+{
+	struct ubifs_compr_stats comp, decomp;
+	struct ubifs_compressor *compr;
+	int i, len = 0;
+	ssize_t ret;
+	char *buf;
+
+	buf = kmalloc(PAGE_SIZE, GFP_KERNEL);
+	if (!buf)
+		return -ENOMEM;
+
+	for (i = 0; i < UBIFS_COMPR_TYPES_CNT; i++) {
+		compr = ubifs_compressors[i];
+		if (!compr || !compr->ctx)
+			continue;
+
+		ubifs_compr_get_stats(compr, &comp, &decomp);
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%s compress:   %llu calls, %llu -> %llu "
+				 "bytes, %llu us\n", compr->name, comp.calls,
+				 comp.in_bytes, comp.out_bytes,
+				 div_u64(comp.ns, NSEC_PER_USEC));
+		len += scnprintf(buf + len, PAGE_SIZE - len,
+				 "%s decompress: %llu calls, %llu -> %llu "
+				 "bytes, %llu us\n", compr->name, decomp.calls,
+				 decomp.in_bytes, decomp.out_bytes,
+				 div_u64(decomp.ns, NSEC_PER_USEC));
+	}
+
+	ret = simple_read_from_buffer(u, count, ppos, buf, len);
+	kfree(buf);
+	return ret;
+}
+
+static const struct file_operations dfs_compr_fops = {
+	.read = read_compr_stats,
+	.owner = THIS_MODULE,
+	.llseek = default_llseek,
+};
+
 /**
  * dbg_debugfs_init - initialize debugfs file-system.
  *
  * UBIFS uses debugfs file-system to expose various debugging knobs to
  * user-space. This function creates "ubifs" directory in the debugfs
- * file-system. Returns zero in case of success and a negative error code in
+ * file-system, with the "compr_stats" file which shows the compressor
+ * statistics. Returns zero in case of success and a negative error code in
  * case of failure.
  */
 int dbg_debugfs_init(void)
 {
+	int err;
+
 	dfs_rootdir = debugfs_create_dir("ubifs", NULL);
 	if (IS_ERR(dfs_rootdir)) {
-		int err = PTR_ERR(dfs_rootdir);
+		err = PTR_ERR(dfs_rootdir);
 		ubifs_err("cannot create \"ubifs\" debugfs directory, "
 			  "error %d\n", err);
 		return err;
 	}
 
+	dfs_compr_stats = debugfs_create_file("compr_stats", S_IRUGO,
+					      dfs_rootdir, NULL,
+					      &dfs_compr_fops);
+	if (IS_ERR(dfs_compr_stats)) {
+		err = PTR_ERR(dfs_compr_stats);
+		ubifs_err("cannot create \"compr_stats\" debugfs file, "
+			  "error %d\n", err);
+		debugfs_remove(dfs_rootdir);
+		return err;
+	}
+
 	return 0;
 }
 
@@ -2745,6 +2804,7 @@ int dbg_debugfs_init(void)
  */
 void dbg_debugfs_exit(void)
 {
+	debugfs_remove(dfs_compr_stats);
 	debugfs_remove(dfs_rootdir);
 }
 
@@ -53,6 +53,7 @@
 #include <linux/mount.h>
 #include <linux/namei.h>
 #include <linux/slab.h>
+#include <linux/workqueue.h>
 
 static int read_block(struct inode *inode, void *addr, unsigned int block,
 		      struct ubifs_data_node *dn)
@@ -698,13 +699,123 @@ out_err:
 	return -EINVAL;
 }
 
+/* Minimum number of pages worth a separate bulk-read work item */
+#define BU_CHUNK_PAGES 4
+
+/* Maximum number of bulk-read work items per bulk-read */
+#define BU_MAX_CHUNKS 8
+
+struct bu_job;
+
+/**
+ * struct bu_chunk - bulk-read work item.
+ * @work: the work item
+ * @job: the bulk-read this work item belongs to
+ * @first: index of the first page to populate in @job->pages
+ * @cnt: how many pages to populate
+ */
+struct bu_chunk {
+	struct work_struct work;
+	struct bu_job *job;
+	int first;
+	int cnt;
+};
+
+/**
+ * struct bu_job - bulk-read pages populated by work items.
+ * @c: UBIFS file-system description object
+ * @bu: bulk-read information with the data nodes already read
+ * @n: first zbranch slot to look at
+ * @pending: number of work items which have not finished yet
+ * @page_cnt: number of pages in @pages
+ * @pages: locked pages to populate
+ * @chunks: the work items
+ *
+ * Once the data nodes are read and the first page is populated, the rest of
+ * the pages are handed over to work items, which decompress the data nodes in
+ * parallel and unlock the pages when they are done. The pages stay locked
+ * until then, so anyone who wants them waits in 'lock_page()' as usual. The
+ * last work item to finish frees @bu, its buffer and the job itself.
+ */
+struct bu_job {
+	struct ubifs_info *c;
+	struct bu_info *bu;
+	int n;
+	atomic_t pending;
+	int page_cnt;
+	struct page *pages[UBIFS_MAX_BULK_READ >> UBIFS_BLOCKS_PER_PAGE_SHIFT];
+	struct bu_chunk chunks[BU_MAX_CHUNKS];
+};
+
+/**
+ * bu_work - populate a part of bulk-read pages.
+ * @work: the work item
+ */
+static void bu_work(struct work_struct *work)
+{
+	struct bu_chunk *chunk = container_of(work, struct bu_chunk, work);
+	struct bu_job *job = chunk->job;
+	int i, err = 0, n = job->n;
+
+	for (i = chunk->first; i < chunk->first + chunk->cnt; i++) {
+		struct page *page = job->pages[i];
+
+		/*
+		 * Pages which are not populated because of an error are left
+		 * not up-to-date and will be read by 'ubifs_readpage()'.
+		 */
+		if (!err)
+			err = populate_page(job->c, page, job->bu, &n);
+		unlock_page(page);
+		page_cache_release(page);
+	}
+
+	if (atomic_dec_and_test(&job->pending)) {
+		kfree(job->bu->buf);
+		kfree(job->bu);
+		kfree(job);
+	}
+}
+
+/**
+ * bu_submit - hand bulk-read pages over to work items.
+ * @job: the pages to populate
+ *
+ * The pages are split between up to one work item per online CPU, but each
+ * work item gets at least %BU_CHUNK_PAGES pages.
+ */
+static void bu_submit(struct bu_job *job)
+{
+	int i, per_chunk, chunk_cnt;
+
+	chunk_cnt = DIV_ROUND_UP(job->page_cnt, BU_CHUNK_PAGES);
+	chunk_cnt = min_t(int, chunk_cnt, num_online_cpus());
+	chunk_cnt = clamp_t(int, chunk_cnt, 1, BU_MAX_CHUNKS);
+	per_chunk = DIV_ROUND_UP(job->page_cnt, chunk_cnt);
+	chunk_cnt = DIV_ROUND_UP(job->page_cnt, per_chunk);
+
+	atomic_set(&job->pending, chunk_cnt);
+	for (i = 0; i < chunk_cnt; i++) {
+		struct bu_chunk *chunk = &job->chunks[i];
+
+		INIT_WORK(&chunk->work, bu_work);
+		chunk->job = job;
+		chunk->first = i * per_chunk;
+		chunk->cnt = min(per_chunk, job->page_cnt - chunk->first);
+		queue_work(ubifs_bu_wq, &chunk->work);
+	}
+}
+
 /**
  * ubifs_do_bulk_read - do bulk-read.
  * @c: UBIFS file-system description object
  * @bu: bulk-read information
  * @page1: first page to read
  *
- * This function returns %1 if the bulk-read is done, otherwise %0 is returned.
+ * If @bu has no buffer, it was allocated by the caller, and this function
+ * takes care of freeing it. In this case the pages after @page1 are populated
+ * asynchronously by work items, see &struct bu_job. This function returns %1
+ * if the bulk-read is done, otherwise %0 is returned.
  */
 static int ubifs_do_bulk_read(struct ubifs_info *c, struct bu_info *bu,
 			      struct page *page1)
@@ -714,7 +825,8 @@ static int ubifs_do_bulk_read(struct ubifs_info *c, struct bu_info *bu,
 	struct inode *inode = mapping->host;
 	struct ubifs_inode *ui = ubifs_inode(inode);
 	int err, page_idx, page_cnt, ret = 0, n = 0;
-	int allocate = bu->buf ? 0 : 1;
+	int allocate = bu->buf ? 0 : 1, borrowed = 0;
+	struct bu_job *job = NULL;
 	loff_t isize;
 
 	err = ubifs_tnc_get_bu_keys(c, bu);
@@ -750,8 +862,22 @@ static int ubifs_do_bulk_read(struct ubifs_info *c, struct bu_info *bu,
 			ubifs_assert(bu->buf_len > 0);
 			ubifs_assert(bu->buf_len <= c->leb_size);
 			bu->buf = kmalloc(bu->buf_len, GFP_NOFS | __GFP_NOWARN);
-			if (!bu->buf)
-				goto out_bu_off;
+			if (!bu->buf) {
+				/*
+				 * Fall back to the pre-allocated buffer, if it
+				 * is not in use, and populate the pages
+				 * synchronously.
+				 */
+				if (!mutex_trylock(&c->bu_mutex))
+					goto out_bu_off;
+				if (!c->bu.buf ||
+				    bu->buf_len > c->max_bu_buf_len) {
+					mutex_unlock(&c->bu_mutex);
+					goto out_bu_off;
+				}
+				bu->buf = c->bu.buf;
+				borrowed = 1;
+			}
 		}
 
 		err = ubifs_tnc_bulk_read(c, bu);
@@ -771,6 +897,16 @@ static int ubifs_do_bulk_read(struct ubifs_info *c, struct bu_info *bu,
 		goto out_free;
 	end_index = ((isize - 1) >> PAGE_CACHE_SHIFT);
 
+	if (allocate && !borrowed && page_cnt > 1) {
+		job = kmalloc(sizeof(struct bu_job), GFP_NOFS | __GFP_NOWARN);
+		if (job) {
+			job->c = c;
+			job->bu = bu;
+			job->n = n;
+			job->page_cnt = 0;
+		}
+	}
+
 	for (page_idx = 1; page_idx < page_cnt; page_idx++) {
 		pgoff_t page_offset = offset + page_idx;
 		struct page *page;
@@ -781,6 +917,11 @@ static int ubifs_do_bulk_read(struct ubifs_info *c, struct bu_info *bu,
 					   GFP_NOFS | __GFP_COLD);
 		if (!page)
 			break;
+		if (job && !PageUptodate(page)) {
+			/* Will be unlocked by the work item */
+			job->pages[job->page_cnt++] = page;
+			continue;
+		}
 		if (!PageUptodate(page))
 			err = populate_page(c, page, bu, &n);
 		unlock_page(page);
@@ -791,9 +932,22 @@ static int ubifs_do_bulk_read(struct ubifs_info *c, struct bu_info *bu,
 
 	ui->last_page_read = offset + page_idx - 1;
 
+	if (job) {
+		if (job->page_cnt) {
+			/* @bu and its buffer now belong to the work items */
+			bu_submit(job);
+			return ret;
+		}
+		kfree(job);
+	}
+
 out_free:
-	if (allocate)
+	if (borrowed)
+		mutex_unlock(&c->bu_mutex);
+	else if (allocate)
 		kfree(bu->buf);
+	if (allocate)
+		kfree(bu);
 	return ret;
 
 out_warn:
@@ -851,29 +1005,27 @@ static int ubifs_bulk_read(struct page *page)
 	}
 
 	/*
-	 * If possible, try to use pre-allocated bulk-read information, which
-	 * is protected by @c->bu_mutex.
+	 * Prefer own bulk-read information, because it can be handed over to
+	 * the work items which populate the pages. Otherwise use the
+	 * pre-allocated one, which is protected by @c->bu_mutex.
 	 */
-	if (mutex_trylock(&c->bu_mutex))
-		bu = &c->bu;
-	else {
-		bu = kmalloc(sizeof(struct bu_info), GFP_NOFS | __GFP_NOWARN);
-		if (!bu)
-			goto out_unlock;
-
+	bu = kmalloc(sizeof(struct bu_info), GFP_NOFS | __GFP_NOWARN);
+	if (bu) {
 		bu->buf = NULL;
 		allocated = 1;
-	}
+	} else if (mutex_trylock(&c->bu_mutex))
+		bu = &c->bu;
+	else
+		goto out_unlock;
 
 	bu->buf_len = c->max_bu_buf_len;
 	data_key_init(c, &bu->key, inode->i_ino,
 		      page->index << UBIFS_BLOCKS_PER_PAGE_SHIFT);
+	/* Frees @bu if it was allocated */
 	err = ubifs_do_bulk_read(c, bu, page);
 
 	if (!allocated)
 		mutex_unlock(&c->bu_mutex);
-	else
-		kfree(bu);
 
 out_unlock:
 	mutex_unlock(&ui->ui_mutex);
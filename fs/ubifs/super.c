@@ -36,6 +36,7 @@
 #include <linux/mount.h>
 #include <linux/math64.h>
 #include <linux/writeback.h>
+#include <linux/workqueue.h>
 #include "ubifs.h"
 
 /*
@@ -47,6 +48,9 @@
 /* Slab cache for UBIFS inodes */
 struct kmem_cache *ubifs_inode_slab;
 
+/* Work queue which populates bulk-read pages */
+struct workqueue_struct *ubifs_bu_wq;
+
 /* UBIFS TNC shrinker description */
 static struct shrinker ubifs_shrinker_info = {
 	.shrink = ubifs_shrinker,
@@ -426,6 +430,9 @@ static int ubifs_show_options(struct seq_file *s, struct vfsmount *mnt)
 	else if (c->mount_opts.bulk_read == 1)
 		seq_printf(s, ",no_bulk_read");
 
+	if (c->mount_opts.bu_window)
+		seq_printf(s, ",bulk_read_window=%d", c->bu_window);
+
 	if (c->mount_opts.chk_data_crc == 2)
 		seq_printf(s, ",chk_data_crc");
 	else if (c->mount_opts.chk_data_crc == 1)
@@ -476,6 +483,20 @@ static int ubifs_sync_fs(struct super_block *sb, int wait)
 	return ubi_sync(c->vi.ubi_num);
 }
 
+/**
+ * set_bu_buf_len - calculate bulk-read buffer size.
+ * @c: UBIFS file-system description object
+ *
+ * The buffer has to be large enough for @c->bu_window data nodes of maximum
+ * size, but there is no point in making it larger than a LEB.
+ */
+static void set_bu_buf_len(struct ubifs_info *c)
+{
+	c->max_bu_buf_len = c->bu_window * UBIFS_MAX_DATA_NODE_SZ;
+	if (c->max_bu_buf_len > c->leb_size)
+		c->max_bu_buf_len = c->leb_size;
+}
+
 /**
  * init_constants_early - initialize UBIFS constants.
  * @c: UBIFS file-system description object
@@ -586,9 +607,7 @@ static int init_constants_early(struct ubifs_info *c)
 	c->leb_overhead = c->leb_size % UBIFS_MAX_DATA_NODE_SZ;
 
 	/* Buffer size for bulk-reads */
-	c->max_bu_buf_len = UBIFS_MAX_BULK_READ * UBIFS_MAX_DATA_NODE_SZ;
-	if (c->max_bu_buf_len > c->leb_size)
-		c->max_bu_buf_len = c->leb_size;
+	set_bu_buf_len(c);
 	return 0;
 }
 
@@ -905,6 +924,7 @@ static int check_volume_empty(struct ubifs_info *c)
  * Opt_norm_unmount: run a journal commit before un-mounting
  * Opt_bulk_read: enable bulk-reads
  * Opt_no_bulk_read: disable bulk-reads
+ * Opt_bulk_read_window: maximum number of data blocks to bulk-read
  * Opt_chk_data_crc: check CRCs when reading data nodes
  * Opt_no_chk_data_crc: do not check CRCs when reading data nodes
  * Opt_override_compr: override default compressor
@@ -915,6 +935,7 @@ enum {
 	Opt_norm_unmount,
 	Opt_bulk_read,
 	Opt_no_bulk_read,
+	Opt_bulk_read_window,
 	Opt_chk_data_crc,
 	Opt_no_chk_data_crc,
 	Opt_override_compr,
@@ -926,6 +947,7 @@ static const match_table_t tokens = {
 	{Opt_norm_unmount, "norm_unmount"},
 	{Opt_bulk_read, "bulk_read"},
 	{Opt_no_bulk_read, "no_bulk_read"},
+	{Opt_bulk_read_window, "bulk_read_window=%d"},
 	{Opt_chk_data_crc, "chk_data_crc"},
 	{Opt_no_chk_data_crc, "no_chk_data_crc"},
 	{Opt_override_compr, "compr=%s"},
@@ -998,6 +1020,24 @@ static int ubifs_parse_options(struct ubifs_info *c, char *options,
 			c->mount_opts.bulk_read = 1;
 			c->bulk_read = 0;
 			break;
+		case Opt_bulk_read_window:
+		{
+			int window;
+
+			if (match_int(&args[0], &window))
+				return -EINVAL;
+			if (window < UBIFS_BLOCKS_PER_PAGE ||
+			    window > UBIFS_MAX_BULK_READ) {
+				ubifs_err("bulk-read window must be between "
+					  "%d and %d data blocks",
+					  (int)UBIFS_BLOCKS_PER_PAGE,
+					  UBIFS_MAX_BULK_READ);
+				return -EINVAL;
+			}
+			c->mount_opts.bu_window = 1;
+			c->bu_window = window;
+			break;
+		}
 		case Opt_chk_data_crc:
 			c->mount_opts.chk_data_crc = 2;
 			c->no_chk_data_crc = 0;
@@ -1788,8 +1828,8 @@ static void ubifs_put_super(struct super_block *sb)
 
 static int ubifs_remount_fs(struct super_block *sb, int *flags, char *data)
 {
-	int err;
 	struct ubifs_info *c = sb->s_fs_info;
+	int err, bu_window = c->bu_window;
 
 	dbg_gen("old flags %#lx, new flags %#x", sb->s_flags, *flags);
 
@@ -1819,6 +1859,13 @@ static int ubifs_remount_fs(struct super_block *sb, int *flags, char *data)
 		ubifs_remount_ro(c);
 	}
 
+	mutex_lock(&c->bu_mutex);
+	if (c->bu_window != bu_window) {
+		/* The pre-allocated buffer has to be re-sized */
+		kfree(c->bu.buf);
+		c->bu.buf = NULL;
+		set_bu_buf_len(c);
+	}
 	if (c->bulk_read == 1)
 		bu_init(c);
 	else {
@@ -1826,6 +1873,7 @@ static int ubifs_remount_fs(struct super_block *sb, int *flags, char *data)
 		kfree(c->bu.buf);
 		c->bu.buf = NULL;
 	}
+	mutex_unlock(&c->bu_mutex);
 
 	ubifs_assert(c->lst.taken_empty_lebs > 0);
 	return 0;
@@ -1948,6 +1996,7 @@ static int ubifs_fill_super(struct super_block *sb, void *data, int silent)
 	INIT_LIST_HEAD(&c->orph_new);
 
 	c->vfs_sb = sb;
+	c->bu_window = UBIFS_DEF_BULK_READ;
 	c->highest_inum = UBIFS_FIRST_INO;
 	c->lhead_lnum = c->ltail_lnum = UBIFS_LOG_LNUM;
 
@@ -2202,12 +2251,24 @@ static int __init ubifs_init(void)
 	if (err)
 		goto out_shrinker;
 
+	/*
+	 * Bulk-read pages are decompressed by work items which are not bound
+	 * to the CPU which did the read, so that they run in parallel.
+	 */
+	ubifs_bu_wq = alloc_workqueue("ubifs_bu", WQ_UNBOUND, 0);
+	if (!ubifs_bu_wq) {
+		err = -ENOMEM;
+		goto out_compr;
+	}
+
 	err = dbg_debugfs_init();
 	if (err)
-		goto out_compr;
+		goto out_wq;
 
 	return 0;
 
+out_wq:
+	destroy_workqueue(ubifs_bu_wq);
 out_compr:
 	ubifs_compressors_exit();
 out_shrinker:
@@ -2226,6 +2287,7 @@ static void __exit ubifs_exit(void)
 	ubifs_assert(atomic_long_read(&ubifs_clean_zn_cnt) == 0);
 
 	dbg_debugfs_exit();
+	destroy_workqueue(ubifs_bu_wq);
 	ubifs_compressors_exit();
 	unregister_shrinker(&ubifs_shrinker_info);
 	kmem_cache_destroy(ubifs_inode_slab);
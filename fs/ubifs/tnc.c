@@ -1586,16 +1586,16 @@ int ubifs_tnc_get_bu_keys(struct ubifs_info *c, struct bu_info *bu)
 		/* Allow for holes */
 		next_block = key_block(c, key);
 		bu->blk_cnt += (next_block - block - 1);
-		if (bu->blk_cnt >= UBIFS_MAX_BULK_READ)
+		if (bu->blk_cnt >= c->bu_window)
 			goto out;
 		block = next_block;
 		/* Add this key */
 		bu->zbranch[bu->cnt++] = *zbr;
 		bu->blk_cnt += 1;
 		/* See if we have room for more */
-		if (bu->cnt >= UBIFS_MAX_BULK_READ)
+		if (bu->cnt >= c->bu_window)
 			goto out;
-		if (bu->blk_cnt >= UBIFS_MAX_BULK_READ)
+		if (bu->blk_cnt >= c->bu_window)
 			goto out;
 	}
 out:
@@ -1611,8 +1611,8 @@ out:
 	 * An enormous hole could cause bulk-read to encompass too many
 	 * page cache pages, so limit the number here.
 	 */
-	if (bu->blk_cnt > UBIFS_MAX_BULK_READ)
-		bu->blk_cnt = UBIFS_MAX_BULK_READ;
+	if (bu->blk_cnt > c->bu_window)
+		bu->blk_cnt = c->bu_window;
 	/*
 	 * Ensure that bulk-read covers a whole number of page cache
 	 * pages.
@@ -154,8 +154,9 @@
 /* Maximum expected tree height for use by bottom_up_buf */
 #define BOTTOM_UP_HEIGHT 64
 
-/* Maximum number of data nodes to bulk-read */
-#define UBIFS_MAX_BULK_READ 32
+/* Maximum and default number of data blocks to bulk-read */
+#define UBIFS_MAX_BULK_READ 64
+#define UBIFS_DEF_BULK_READ 32
 
 /*
  * Lockdep classes for UBIFS inode @ui_mutex.
@@ -809,20 +810,48 @@ struct ubifs_node_range {
 	int max_len;
 };
 
+/**
+ * struct ubifs_compr_stats - compressor statistics.
+ * @calls: how many times the compressor was called
+ * @in_bytes: how many bytes were passed to the compressor
+ * @out_bytes: how many bytes the compressor produced
+ * @ns: time spent in the compressor in nanoseconds
+ */
+struct ubifs_compr_stats {
+	unsigned long long calls;
+	unsigned long long in_bytes;
+	unsigned long long out_bytes;
+	unsigned long long ns;
+};
+
+/**
+ * struct ubifs_compr_ctx - per-CPU compressor context.
+ * @cc: cryptoapi compressor handle
+ * @comp_mutex: serializes compression with @cc
+ * @decomp_mutex: serializes decompression with @cc
+ * @comp_stats: compression statistics, protected by @comp_mutex
+ * @decomp_stats: decompression statistics, protected by @decomp_mutex
+ */
+struct ubifs_compr_ctx {
+	struct crypto_comp *cc;
+	struct mutex comp_mutex;
+	struct mutex decomp_mutex;
+#ifdef CONFIG_UBIFS_FS_DEBUG
+	struct ubifs_compr_stats comp_stats;
+	struct ubifs_compr_stats decomp_stats;
+#endif
+};
+
 /**
  * struct ubifs_compressor - UBIFS compressor description structure.
  * @compr_type: compressor type (%UBIFS_COMPR_LZO, etc)
- * @cc: cryptoapi compressor handle
- * @comp_mutex: mutex used during compression
- * @decomp_mutex: mutex used during decompression
+ * @ctx: per-CPU compressor contexts
  * @name: compressor name
  * @capi_name: cryptoapi compressor name
  */
 struct ubifs_compressor {
 	int compr_type;
-	struct crypto_comp *cc;
-	struct mutex *comp_mutex;
-	struct mutex *decomp_mutex;
+	struct ubifs_compr_ctx __percpu *ctx;
 	const char *name;
 	const char *capi_name;
 };
@@ -920,6 +949,8 @@ struct ubifs_orphan {
  *                  specified in @compr_type)
  * @compr_type: compressor type to override the superblock compressor with
  *              (%UBIFS_COMPR_NONE, etc)
+ * @bu_window: bulk-read window was specified (%0 - use the default, %1 - use
+ *             @c->bu_window)
  */
 struct ubifs_mount_opts {
 	unsigned int unmount_mode:2;
@@ -927,6 +958,7 @@ struct ubifs_mount_opts {
 	unsigned int chk_data_crc:2;
 	unsigned int override_compr:1;
 	unsigned int compr_type:2;
+	unsigned int bu_window:1;
 };
 
 struct ubifs_debug_info;
@@ -999,6 +1031,7 @@ struct ubifs_debug_info;
  * @mst_offs: offset of valid master node
  * @mst_mutex: protects the master node area, @mst_node, and @mst_offs
  *
+ * @bu_window: maximum number of data blocks to bulk-read
  * @max_bu_buf_len: maximum bulk-read buffer length
  * @bu_mutex: protects the pre-allocated bulk-read buffer and @c->bu
  * @bu: pre-allocated bulk-read information
@@ -1246,6 +1279,7 @@ struct ubifs_info {
 	int mst_offs;
 	struct mutex mst_mutex;
 
+	int bu_window;
 	int max_bu_buf_len;
 	struct mutex bu_mutex;
 	struct bu_info bu;
@@ -1426,6 +1460,7 @@ extern struct list_head ubifs_infos;
 extern spinlock_t ubifs_infos_lock;
 extern atomic_long_t ubifs_clean_zn_cnt;
 extern struct kmem_cache *ubifs_inode_slab;
+extern struct workqueue_struct *ubifs_bu_wq;
 extern const struct super_operations ubifs_super_operations;
 extern const struct address_space_operations ubifs_file_address_operations;
 extern const struct file_operations ubifs_file_operations;
@@ -1738,6 +1773,11 @@ void ubifs_compress(const void *in_buf, int in_len, void *out_buf, int *out_len,
 		    int *compr_type);
 int ubifs_decompress(const void *buf, int len, void *out, int *out_len,
 		     int compr_type);
+#ifdef CONFIG_UBIFS_FS_DEBUG
+void ubifs_compr_get_stats(struct ubifs_compressor *compr,
+			   struct ubifs_compr_stats *comp,
+			   struct ubifs_compr_stats *decomp);
+#endif
 
 #include "debug.h"
 #include "misc.h"
@@ -14,6 +14,8 @@
 #include <linux/backing-dev.h>
 #include <linux/sysctl.h>
 #include <linux/sysfs.h>
+#include <linux/kthread.h>
+#include <linux/freezer.h>
 #include "internal.h"
 
 /*
@@ -73,6 +75,7 @@ static unsigned long isolate_freepages_block(struct zone *zone,
 			break;
 	}
 	cursor = pfn_to_page(blockpfn);
+	__count_vm_events(COMPACTFREE_SCANNED, end_pfn - blockpfn);
 
 	/* Isolate free pages. This assumes the block is valid */
 	for (; blockpfn < end_pfn; blockpfn++, cursor++) {
@@ -233,7 +236,7 @@ static bool too_many_isolated(struct zone *zone)
 static unsigned long isolate_migratepages(struct zone *zone,
 					struct compact_control *cc)
 {
-	unsigned long low_pfn, end_pfn;
+	unsigned long low_pfn, end_pfn, start_pfn;
 	struct list_head *migratelist = &cc->migratepages;
 
 	/* Do not scan outside zone boundaries */
@@ -261,6 +264,7 @@ static unsigned long isolate_migratepages(struct zone *zone,
 	}
 
 	/* Time to isolate some pages for migration */
+	start_pfn = low_pfn;
 	spin_lock_irq(&zone->lru_lock);
 	for (; low_pfn < end_pfn; low_pfn++) {
 		struct page *page;
@@ -290,6 +294,7 @@ static unsigned long isolate_migratepages(struct zone *zone,
 
 	spin_unlock_irq(&zone->lru_lock);
 	cc->migrate_pfn = low_pfn;
+	count_vm_events(COMPACTMIGRATE_SCANNED, low_pfn - start_pfn);
 
 	return cc->nr_migratepages;
 }
@@ -582,6 +587,200 @@ int sysctl_extfrag_handler(struct ctl_table *table, int write,
 	return 0;
 }
 
+/*
+ * kcompactd compacts a node in the background, so that high-order
+ * allocations find free blocks without stalling in direct compaction or
+ * lumpy reclaim. It is woken when kswapd has balanced a node for a
+ * high-order allocation, and by allocations that have to enter the slow
+ * path when a zone is fragmented. It is woken at most once every
+ * kcompactd_interval_centisecs, and not at all if that is 0.
+ */
+int sysctl_kcompactd_interval_centisecs = 50;
+
+/*
+ * Worth compacting in the background: there is free memory to migrate
+ * into, an order-@order page would not leave the zone above its high
+ * watermark, and the shortage is not due to a lack of memory. A negative
+ * fragmentation index means there are free blocks of the order, just not
+ * enough of them for the watermark.
+ */
+static bool kcompactd_zone_suitable(struct zone *zone, int order)
+{
+	unsigned long watermark = low_wmark_pages(zone) + (2UL << order);
+	int fragindex;
+
+	if (!zone_watermark_ok(zone, 0, watermark, 0, 0))
+		return false;
+
+	if (zone_watermark_ok(zone, order, high_wmark_pages(zone), 0, 0))
+		return false;
+
+	fragindex = fragmentation_index(zone, order);
+	return fragindex < 0 || fragindex > sysctl_extfrag_threshold;
+}
+
+static bool kcompactd_node_suitable(pg_data_t *pgdat, int order,
+				    int classzone_idx)
+{
+	int zoneid;
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+
+		if (populated_zone(zone) &&
+		    kcompactd_zone_suitable(zone, order))
+			return true;
+	}
+	return false;
+}
+
+static void kcompactd_do_work(pg_data_t *pgdat)
+{
+	int order = pgdat->kcompactd_max_order;
+	int classzone_idx = pgdat->kcompactd_classzone_idx;
+	int zoneid;
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+	count_vm_event(KCOMPACTD_WAKE);
+
+	for (zoneid = 0; zoneid <= classzone_idx; zoneid++) {
+		struct zone *zone = &pgdat->node_zones[zoneid];
+		struct compact_control cc = {
+			.nr_freepages = 0,
+			.nr_migratepages = 0,
+			.order = order,
+			.migratetype = MIGRATE_MOVABLE,
+			.zone = zone,
+		};
+		int status;
+
+		if (!populated_zone(zone))
+			continue;
+		if (compaction_deferred(zone))
+			continue;
+		if (!kcompactd_zone_suitable(zone, order))
+			continue;
+		if (kthread_should_stop())
+			break;
+
+		INIT_LIST_HEAD(&cc.freepages);
+		INIT_LIST_HEAD(&cc.migratepages);
+
+		status = compact_zone(zone, &cc);
+
+		if (zone_watermark_ok(zone, order, low_wmark_pages(zone), 0, 0)) {
+			zone->compact_considered = 0;
+			zone->compact_defer_shift = 0;
+		} else if (status == COMPACT_COMPLETE) {
+			/* The whole zone was scanned without success */
+			defer_compaction(zone);
+		}
+
+		VM_BUG_ON(!list_empty(&cc.freepages));
+		VM_BUG_ON(!list_empty(&cc.migratepages));
+	}
+
+	pgdat->kcompactd_next = jiffies +
+		msecs_to_jiffies(sysctl_kcompactd_interval_centisecs * 10);
+}
+
+static int kcompactd(void *p)
+{
+	pg_data_t *pgdat = (pg_data_t *)p;
+	const struct cpumask *cpumask = cpumask_of_node(pgdat->node_id);
+
+	if (!cpumask_empty(cpumask))
+		set_cpus_allowed_ptr(current, cpumask);
+	set_freezable();
+
+	pgdat->kcompactd_max_order = 0;
+	pgdat->kcompactd_classzone_idx = pgdat->nr_zones - 1;
+	pgdat->kcompactd_next = jiffies;
+
+	while (!kthread_should_stop()) {
+		wait_event_freezable(pgdat->kcompactd_wait,
+				     pgdat->kcompactd_max_order ||
+				     kthread_should_stop());
+		if (pgdat->kcompactd_max_order)
+			kcompactd_do_work(pgdat);
+	}
+	return 0;
+}
+
+/**
+ * wakeup_kcompactd - ask kcompactd to compact a node in the background
+ * @pgdat: node to compact
+ * @order: order of the allocation that should succeed afterwards
+ * @classzone_idx: highest zone of the node to compact
+ *
+ * May be called from atomic context.
+ */
+void wakeup_kcompactd(pg_data_t *pgdat, int order, int classzone_idx)
+{
+	if (!sysctl_kcompactd_interval_centisecs)
+		return;
+
+	if (!waitqueue_active(&pgdat->kcompactd_wait))
+		return;
+
+	if (time_before(jiffies, pgdat->kcompactd_next))
+		return;
+
+	if (!kcompactd_node_suitable(pgdat, order, classzone_idx))
+		return;
+
+	if (pgdat->kcompactd_max_order < order)
+		pgdat->kcompactd_max_order = order;
+	if (pgdat->kcompactd_classzone_idx > classzone_idx)
+		pgdat->kcompactd_classzone_idx = classzone_idx;
+
+	wake_up_interruptible(&pgdat->kcompactd_wait);
+}
+
+/*
+ * This kcompactd start function will be called by init and node-hot-add.
+ */
+int kcompactd_run(int nid)
+{
+	pg_data_t *pgdat = NODE_DATA(nid);
+	int ret = 0;
+
+	if (pgdat->kcompactd)
+		return 0;
+
+	pgdat->kcompactd = kthread_run(kcompactd, pgdat, "kcompactd%d", nid);
+	if (IS_ERR(pgdat->kcompactd)) {
+		printk(KERN_ERR "Failed to start kcompactd on node %d\n", nid);
+		pgdat->kcompactd = NULL;
+		ret = -1;
+	}
+	return ret;
+}
+
+/*
+ * Called by memory hotplug when all memory in a node is offlined.
+ */
+void kcompactd_stop(int nid)
+{
+	struct task_struct *kcompactd = NODE_DATA(nid)->kcompactd;
+
+	if (kcompactd) {
+		kthread_stop(kcompactd);
+		NODE_DATA(nid)->kcompactd = NULL;
+	}
+}
+
+static int __init kcompactd_init(void)
+{
+	int nid;
+
+	for_each_node_state(nid, N_HIGH_MEMORY)
+		kcompactd_run(nid);
+	return 0;
+}
+module_init(kcompactd_init)
+
 #if defined(CONFIG_SYSFS) && defined(CONFIG_NUMA)
 ssize_t sysfs_compact_node(struct sys_device *dev,
 			struct sysdev_attribute *attr,
@@ -19,6 +19,7 @@
 #include <linux/pagevec.h>
 #include <linux/migrate.h>
 #include <linux/page_cgroup.h>
+#include <linux/pfn.h>
 
 #include <asm/pgtable.h>
 
@@ -57,6 +58,40 @@ static struct {
 	unsigned long find_total;
 } swap_cache_info;
 
+/* Read ahead by virtual address in the faulting vma, not by swap offset */
+int sysctl_swap_vma_readahead __read_mostly = 1;
+
+/*
+ * vma->swap_readahead_info packs the page aligned address of the last
+ * swap fault in the vma, the readahead window used for it and the number
+ * of readahead pages that were hit since.
+ */
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) |	\
+	 ((hits) & SWAP_RA_HITS_MASK))
+
+/* A vma starts out as if a few readahead pages had been hit */
+#define SWAP_RA_INIT_HITS	4
+
+/* Upper bound on the window, whatever page_cluster says */
+#define SWAP_RA_ORDER_CEILING	5
+
+static inline unsigned long swap_ra_val(struct vm_area_struct *vma)
+{
+	return atomic_long_read(&vma->swap_readahead_info) ? :
+		SWAP_RA_VAL(0, 0, SWAP_RA_INIT_HITS);
+}
+
 void show_swap_cache_info(void)
 {
 	printk("%lu pages in swap cache\n", total_swapcache_pages);
@@ -256,15 +291,33 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
  * unlocked and with its refcount incremented - we rely on the kernel
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
+ *
+ * If the page was brought in by readahead, count the hit, and credit it
+ * to the readahead window of vma when one is given.
  */
-struct page * lookup_swap_cache(swp_entry_t entry)
+struct page * lookup_swap_cache(swp_entry_t entry,
+			struct vm_area_struct *vma, unsigned long addr)
 {
 	struct page *page;
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		/* PG_readahead is PG_reclaim while under writeback */
+		if (!PageWriteback(page) && TestClearPageReadahead(page)) {
+			count_vm_event(SWAP_RA_HIT);
+			if (vma && sysctl_swap_vma_readahead) {
+				unsigned long ra_val = swap_ra_val(vma);
+				unsigned long hits = SWAP_RA_HITS(ra_val);
+
+				hits = min(hits + 1, SWAP_RA_HITS_MAX);
+				atomic_long_set(&vma->swap_readahead_info,
+					SWAP_RA_VAL(addr, SWAP_RA_WIN(ra_val),
+						    hits));
+			}
+		}
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
@@ -276,8 +329,9 @@ struct page * lookup_swap_cache(swp_entry_t entry)
  * A failure return means that either the page allocation failed or that
  * the swap entry is no longer in use.
  */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry,
+			gfp_t gfp_mask, struct vm_area_struct *vma,
+			unsigned long addr, int readahead)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
@@ -331,6 +385,10 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			 * Initiate read into locked page and return.
 			 */
 			lru_cache_add_anon(new_page);
+			if (readahead) {
+				SetPageReadahead(new_page);
+				count_vm_event(SWAP_RA);
+			}
 			swap_readpage(new_page);
 			return new_page;
 		}
@@ -349,6 +407,12 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	return __read_swap_cache_async(entry, gfp_mask, vma, addr, 0);
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -386,8 +450,9 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	nr_pages = valid_swaphandles(entry, &offset);
 	for (end_offset = offset + nr_pages; offset < end_offset; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
+		page = __read_swap_cache_async(swp_entry(swp_type(entry), offset),
+					gfp_mask, vma, addr,
+					offset != swp_offset(entry));
 		if (!page)
 			break;
 		page_cache_release(page);
@@ -395,3 +460,112 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
+
+/*
+ * Size the readahead window for a fault at fpfn from the previous fault
+ * at prev_pfn, the window used for that one and the number of readahead
+ * pages hit since. Without hits, only sequential faults read ahead.
+ */
+static unsigned int swap_ra_window(unsigned long prev_pfn, unsigned long fpfn,
+			unsigned int hits, unsigned int prev_win,
+			unsigned int max_win)
+{
+	unsigned int win = hits + 2;
+
+	if (win == 2) {
+		if (fpfn != prev_pfn + 1 && fpfn != prev_pfn - 1)
+			win = 1;
+	} else {
+		win = roundup_pow_of_two(max(win, 4U));
+	}
+
+	/* Shrink the window gradually when the hits stop */
+	win = max(win, prev_win / 2);
+
+	return min(win, max_win);
+}
+
+/**
+ * swapin_vma_readahead - swap in pages around a fault in hope we need them
+ * @entry: swap entry of this memory
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma this address belongs to
+ * @addr: faulting address
+ * @pmd: pmd mapping the page table of addr
+ *
+ * Returns the struct page for entry and addr, after queueing swapin.
+ *
+ * Unlike swapin_readahead(), which reads neighbours in the swap area, read
+ * the swap entries of the ptes around addr in the vma: slots next to each
+ * other on swap rarely belong together once swap has fragmented. The
+ * window follows the direction of sequential faults, and grows and
+ * shrinks with the number of pages from the previous readahead that were
+ * actually faulted in. Falls back to swapin_readahead() when disabled
+ * with the swap_vma_readahead sysctl.
+ *
+ * Caller must hold down_read on the vma->vm_mm.
+ */
+struct page *swapin_vma_readahead(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			pmd_t *pmd)
+{
+	pte_t ptes[1 << SWAP_RA_ORDER_CEILING], *orig_pte, *pte;
+	unsigned long ra_val, fpfn, pfn, lpfn, rpfn, start, end;
+	unsigned int max_win, win, i;
+	struct page *page;
+
+	if (!sysctl_swap_vma_readahead)
+		return swapin_readahead(entry, gfp_mask, vma, addr);
+
+	max_win = 1 << min(page_cluster, SWAP_RA_ORDER_CEILING);
+	if (max_win == 1)
+		goto skip;
+
+	fpfn = PFN_DOWN(addr);
+	ra_val = swap_ra_val(vma);
+	pfn = PFN_DOWN(SWAP_RA_ADDR(ra_val));
+	win = swap_ra_window(pfn, fpfn, SWAP_RA_HITS(ra_val),
+			     SWAP_RA_WIN(ra_val), max_win);
+	atomic_long_set(&vma->swap_readahead_info, SWAP_RA_VAL(addr, win, 0));
+	if (win == 1)
+		goto skip;
+
+	/* Read ahead in the direction of the faults, or around this one */
+	if (fpfn == pfn + 1)
+		lpfn = fpfn;
+	else if (pfn == fpfn + 1)
+		lpfn = fpfn - min(fpfn, (unsigned long)win - 1);
+	else
+		lpfn = fpfn - min(fpfn, (unsigned long)(win - 1) / 2);
+	rpfn = lpfn + win;
+
+	/* Stay within the vma and the page table of addr */
+	start = max3(lpfn, PFN_DOWN(vma->vm_start), PFN_DOWN(addr & PMD_MASK));
+	end = min3(rpfn, PFN_DOWN(vma->vm_end),
+		   PFN_DOWN((addr & PMD_MASK) + PMD_SIZE));
+
+	/* Copy the ptes: the page table cannot stay mapped while we sleep */
+	orig_pte = pte_offset_map(pmd, addr);
+	pte = orig_pte - (fpfn - start);
+	for (i = 0; i < end - start; i++)
+		ptes[i] = *pte++;
+	pte_unmap(orig_pte);
+
+	for (pfn = start, i = 0; pfn < end; pfn++, i++) {
+		swp_entry_t ra_entry;
+
+		if (pfn == fpfn || pte_none(ptes[i]) ||
+		    pte_present(ptes[i]) || pte_file(ptes[i]))
+			continue;
+		ra_entry = pte_to_swp_entry(ptes[i]);
+		if (unlikely(non_swap_entry(ra_entry)))
+			continue;
+		page = __read_swap_cache_async(ra_entry, gfp_mask, vma,
+					       pfn << PAGE_SHIFT, 1);
+		if (page)
+			page_cache_release(page);
+	}
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+skip:
+	return read_swap_cache_async(entry, gfp_mask, vma, addr);
+}
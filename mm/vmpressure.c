@@ -0,0 +1,270 @@
+/*
+ * linux/mm/vmpressure.c
+ *
+ * Memory pressure notifications for userspace.
+ *
+ * Reclaim reports how many pages it scanned and how many of those it
+ * managed to reclaim. Once a window of scanned pages has been collected
+ * for a memory cgroup, the share of scanned pages that could not be
+ * reclaimed is turned into a pressure level and sent to the eventfds
+ * registered on the cgroup's memory.pressure_level file. Global reclaim
+ * is accounted to the root cgroup.
+ *
+ * Released under the GPL, see the file COPYING for details.
+ */
+
+#include <linux/kernel.h>
+#include <linux/slab.h>
+#include <linux/eventfd.h>
+#include <linux/swap.h>
+#include <linux/vmpressure.h>
+
+/*
+ * The window size is the number of scanned pages before we try to
+ * analyze the scanned/reclaimed ratio. Smaller windows give more
+ * frequent, but noisier, notifications. SWAP_CLUSTER_MAX * 16 is 2MB
+ * worth of 4KB pages.
+ */
+static const unsigned long vmpressure_win = SWAP_CLUSTER_MAX * 16;
+
+/*
+ * Percentages of scanned pages that were not reclaimed at which the
+ * medium and critical levels are reached.
+ */
+static const unsigned int vmpressure_level_med = 60;
+static const unsigned int vmpressure_level_critical = 95;
+
+/*
+ * Reclaim priority at which the level is considered critical regardless
+ * of the ratio: at DEF_PRIORITY - 10 reclaim scans the whole LRU and is
+ * close to giving up and invoking the OOM killer.
+ */
+static const int vmpressure_level_critical_prio = DEF_PRIORITY - 10;
+
+enum vmpressure_levels {
+	VMPRESSURE_LOW = 0,
+	VMPRESSURE_MEDIUM,
+	VMPRESSURE_CRITICAL,
+	VMPRESSURE_NUM_LEVELS,
+};
+
+static const char * const vmpressure_str_levels[] = {
+	[VMPRESSURE_LOW] = "low",
+	[VMPRESSURE_MEDIUM] = "medium",
+	[VMPRESSURE_CRITICAL] = "critical",
+};
+
+struct vmpressure_event {
+	struct eventfd_ctx *efd;
+	enum vmpressure_levels level;
+	struct list_head node;
+};
+
+static enum vmpressure_levels vmpressure_level(unsigned long pressure)
+{
+	if (pressure >= vmpressure_level_critical)
+		return VMPRESSURE_CRITICAL;
+	else if (pressure >= vmpressure_level_med)
+		return VMPRESSURE_MEDIUM;
+	return VMPRESSURE_LOW;
+}
+
+static enum vmpressure_levels vmpressure_calc_level(unsigned long scanned,
+						    unsigned long reclaimed)
+{
+	unsigned long pressure;
+
+	/*
+	 * reclaimed can be larger than scanned, for example when a
+	 * scanned page frees several pages of buffers or when lumpy
+	 * reclaim frees the neighbours of the pages it scans.
+	 */
+	if (reclaimed >= scanned)
+		return VMPRESSURE_LOW;
+
+	pressure = (scanned - reclaimed) * 100 / scanned;
+	return vmpressure_level(pressure);
+}
+
+static bool vmpressure_event(struct vmpressure *vmpr,
+			     unsigned long scanned, unsigned long reclaimed)
+{
+	struct vmpressure_event *ev;
+	enum vmpressure_levels level;
+	bool signalled = false;
+
+	level = vmpressure_calc_level(scanned, reclaimed);
+
+	mutex_lock(&vmpr->events_lock);
+	list_for_each_entry(ev, &vmpr->events, node) {
+		if (level >= ev->level) {
+			eventfd_signal(ev->efd, 1);
+			signalled = true;
+		}
+	}
+	mutex_unlock(&vmpr->events_lock);
+
+	return signalled;
+}
+
+static void vmpressure_work_fn(struct work_struct *work)
+{
+	struct vmpressure *vmpr = container_of(work, struct vmpressure, work);
+	unsigned long scanned;
+	unsigned long reclaimed;
+
+	spin_lock(&vmpr->sr_lock);
+	scanned = vmpr->scanned;
+	reclaimed = vmpr->reclaimed;
+	vmpr->scanned = 0;
+	vmpr->reclaimed = 0;
+	spin_unlock(&vmpr->sr_lock);
+
+	/* A concurrent work item may have taken the window already */
+	if (!scanned)
+		return;
+
+	/*
+	 * Pressure in a cgroup is pressure in its hierarchical parents
+	 * too, unless a listener in the cgroup has already been told.
+	 */
+	do {
+		if (vmpressure_event(vmpr, scanned, reclaimed))
+			break;
+	} while ((vmpr = vmpressure_parent(vmpr)));
+}
+
+/**
+ * vmpressure() - account memory pressure through scanned/reclaimed ratio
+ * @gfp: reclaimer's gfp mask
+ * @mem: cgroup that reclaim was performed for, NULL for global reclaim
+ * @scanned: number of pages scanned
+ * @reclaimed: number of pages reclaimed
+ *
+ * Called from shrink_zone(), which is used by both direct reclaim and
+ * balance_pgdat(). Only accumulates the numbers; the level is computed
+ * and the events are sent from a work item once a window is full.
+ */
+void vmpressure(gfp_t gfp, struct mem_cgroup *mem,
+		unsigned long scanned, unsigned long reclaimed)
+{
+	struct vmpressure *vmpr = memcg_to_vmpressure(mem);
+
+	if (!vmpr)
+		return;
+
+	/*
+	 * Only allocations that can use highmem or movable memory, or
+	 * that may do IO, reclaim from the LRU for real. Trouble in
+	 * GFP_NOIO/GFP_NOFS-only reclaim says little about memory as a
+	 * whole.
+	 */
+	if (!(gfp & (__GFP_HIGHMEM | __GFP_MOVABLE | __GFP_IO | __GFP_FS)))
+		return;
+
+	if (!scanned)
+		return;
+
+	spin_lock(&vmpr->sr_lock);
+	vmpr->scanned += scanned;
+	vmpr->reclaimed += reclaimed;
+	scanned = vmpr->scanned;
+	spin_unlock(&vmpr->sr_lock);
+
+	if (scanned < vmpressure_win)
+		return;
+	schedule_work(&vmpr->work);
+}
+
+/**
+ * vmpressure_prio() - account memory pressure through reclaim priority
+ * @gfp: reclaimer's gfp mask
+ * @mem: cgroup that reclaim was performed for, NULL for global reclaim
+ * @prio: reclaim priority
+ *
+ * Called from do_try_to_free_pages() for every priority level. Once the
+ * priority has dropped to vmpressure_level_critical_prio, a full window
+ * of unreclaimed pages is accounted, which raises a critical event.
+ */
+void vmpressure_prio(gfp_t gfp, struct mem_cgroup *mem, int prio)
+{
+	if (prio > vmpressure_level_critical_prio)
+		return;
+
+	vmpressure(gfp, mem, vmpressure_win, 0);
+}
+
+/**
+ * vmpressure_register_event() - bind an eventfd to a pressure level
+ * @vmpr: vmpressure of the cgroup the event is registered on
+ * @eventfd: eventfd context to signal
+ * @args: "low", "medium" or "critical"
+ *
+ * The eventfd is signalled whenever the pressure level is at or above
+ * the requested level.
+ */
+int vmpressure_register_event(struct vmpressure *vmpr,
+			      struct eventfd_ctx *eventfd, const char *args)
+{
+	struct vmpressure_event *ev;
+	int level;
+
+	for (level = 0; level < VMPRESSURE_NUM_LEVELS; level++) {
+		if (!strcmp(vmpressure_str_levels[level], args))
+			break;
+	}
+
+	if (level >= VMPRESSURE_NUM_LEVELS)
+		return -EINVAL;
+
+	ev = kzalloc(sizeof(*ev), GFP_KERNEL);
+	if (!ev)
+		return -ENOMEM;
+
+	ev->efd = eventfd;
+	ev->level = level;
+
+	mutex_lock(&vmpr->events_lock);
+	list_add(&ev->node, &vmpr->events);
+	mutex_unlock(&vmpr->events_lock);
+
+	return 0;
+}
+
+/**
+ * vmpressure_unregister_event() - unbind an eventfd from its level
+ * @vmpr: vmpressure of the cgroup the event was registered on
+ * @eventfd: eventfd context that was registered
+ */
+void vmpressure_unregister_event(struct vmpressure *vmpr,
+				 struct eventfd_ctx *eventfd)
+{
+	struct vmpressure_event *ev, *tmp;
+
+	mutex_lock(&vmpr->events_lock);
+	list_for_each_entry_safe(ev, tmp, &vmpr->events, node) {
+		if (ev->efd != eventfd)
+			continue;
+		list_del(&ev->node);
+		kfree(ev);
+		break;
+	}
+	mutex_unlock(&vmpr->events_lock);
+}
+
+void vmpressure_init(struct vmpressure *vmpr)
+{
+	spin_lock_init(&vmpr->sr_lock);
+	mutex_init(&vmpr->events_lock);
+	INIT_LIST_HEAD(&vmpr->events);
+	INIT_WORK(&vmpr->work, vmpressure_work_fn);
+}
+
+/*
+ * Make sure there is no pending work item before the cgroup the
+ * vmpressure is embedded in goes away.
+ */
+void vmpressure_cleanup(struct vmpressure *vmpr)
+{
+	flush_work(&vmpr->work);
+}
@@ -38,6 +38,8 @@
 #include <linux/kthread.h>
 #include <linux/freezer.h>
 #include <linux/memcontrol.h>
+#include <linux/compaction.h>
+#include <linux/vmpressure.h>
 #include <linux/delayacct.h>
 #include <linux/sysctl.h>
 
@@ -90,6 +92,9 @@ struct scan_control {
 	 */
 	enum lumpy_mode lumpy_reclaim_mode;
 
+	/* Reclaim pages even if they were referenced recently */
+	int ignore_references;
+
 	/* Which cgroup do we reclaim from */
 	struct mem_cgroup *mem_cgroup;
 
@@ -447,9 +452,11 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
 
 /*
  * Same as remove_mapping, but if the page is removed from the mapping, it
- * gets returned with a refcount of 0.
+ * gets returned with a refcount of 0.  @reclaimed is set when the page is
+ * evicted by reclaim, which leaves a shadow entry behind for file pages.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -495,10 +502,19 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
 
-		__remove_from_page_cache(page);
+		/*
+		 * Remember the eviction for refault detection, unless the
+		 * inode is going away: its final truncate may already have
+		 * run and would not see a shadow stored behind its back.
+		 */
+		if (reclaimed && page_is_file_cache(page) &&
+		    !mapping_exiting(mapping))
+			shadow = workingset_eviction(mapping, page);
+		__remove_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -521,7 +537,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -621,8 +637,8 @@ static enum page_references page_check_references(struct page *page,
 	referenced_ptes = page_referenced(page, 1, sc->mem_cgroup, &vm_flags);
 	referenced_page = TestClearPageReferenced(page);
 
-	/* Lumpy reclaim - ignore references */
-	if (sc->lumpy_reclaim_mode != LUMPY_MODE_NONE)
+	/* Lumpy reclaim or targeted reclaim - ignore references */
+	if (sc->lumpy_reclaim_mode != LUMPY_MODE_NONE || sc->ignore_references)
 		return PAGEREF_RECLAIM;
 
 	/*
@@ -869,7 +885,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -930,6 +946,49 @@ keep_lumpy:
 	return nr_reclaimed;
 }
 
+/**
+ * reclaim_pages_from_list - reclaim a list of isolated pages
+ * @page_list: pages isolated with isolate_lru_page()
+ *
+ * The pages must be accounted in NR_ISOLATED_ANON or NR_ISOLATED_FILE by
+ * the caller. They are reclaimed regardless of their references; the ones
+ * that cannot be reclaimed are put back on the LRU.
+ *
+ * Returns the number of pages reclaimed.
+ */
+unsigned long reclaim_pages_from_list(struct list_head *page_list)
+{
+	struct scan_control sc = {
+		.gfp_mask = GFP_KERNEL,
+		.may_writepage = 1,
+		.may_unmap = 1,
+		.may_swap = 1,
+		.swappiness = vm_swappiness,
+		.ignore_references = 1,
+	};
+	unsigned long nr_reclaimed = 0;
+	LIST_HEAD(single);
+
+	while (!list_empty(page_list)) {
+		struct page *page = lru_to_page(page_list);
+		struct zone *zone = page_zone(page);
+		int file = page_is_file_cache(page);
+
+		/* shrink_page_list() wants all pages from one zone */
+		list_move(&page->lru, &single);
+		ClearPageActive(page);
+		nr_reclaimed += shrink_page_list(&single, zone, &sc);
+		mod_zone_page_state(zone, NR_ISOLATED_ANON + file, -1);
+
+		if (!list_empty(&single)) {
+			page = lru_to_page(&single);
+			list_del(&page->lru);
+			putback_lru_page(page);
+		}
+	}
+	return nr_reclaimed;
+}
+
 /*
  * Attempt to remove the specified page from its LRU.  Only take this page
  * if it is of the appropriate PageActive status.  Pages which are being
@@ -1815,6 +1874,7 @@ static void shrink_zone(int priority, struct zone *zone,
 	enum lru_list l;
 	unsigned long nr_reclaimed = sc->nr_reclaimed;
 	unsigned long nr_to_reclaim = sc->nr_to_reclaim;
+	unsigned long nr_scanned = sc->nr_scanned;
 
 	get_scan_count(zone, sc, nr, priority);
 
@@ -1842,6 +1902,8 @@ static void shrink_zone(int priority, struct zone *zone,
 			break;
 	}
 
+	vmpressure(sc->gfp_mask, sc->mem_cgroup, sc->nr_scanned - nr_scanned,
+		   nr_reclaimed - sc->nr_reclaimed);
 	sc->nr_reclaimed = nr_reclaimed;
 
 	/*
@@ -1960,6 +2022,7 @@ static unsigned long do_try_to_free_pages(struct zonelist *zonelist,
 		count_vm_event(ALLOCSTALL);
 
 	for (priority = DEF_PRIORITY; priority >= 0; priority--) {
+		vmpressure_prio(sc->gfp_mask, sc->mem_cgroup, priority);
 		sc->nr_scanned = 0;
 		if (!priority)
 			disable_swap_token();
@@ -2449,6 +2512,14 @@ static int kswapd(void *p)
 				if (!sleeping_prematurely(pgdat, order, remaining)) {
 					trace_mm_vmscan_kswapd_sleep(pgdat->node_id);
 					restore_pgdat_percpu_threshold(pgdat);
+					/*
+					 * The node is balanced: let kcompactd
+					 * defragment it for the order we
+					 * reclaimed for.
+					 */
+					if (order)
+						wakeup_kcompactd(pgdat, order,
+							pgdat->nr_zones - 1);
 					schedule();
 					reduce_pgdat_percpu_threshold(pgdat);
 				} else {
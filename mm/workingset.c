@@ -0,0 +1,143 @@
+/*
+ * mm/workingset.c
+ *
+ * Workingset detection: remember when file pages were evicted, so that
+ * refaults of a working set that does not fit into the inactive list can
+ * be recognised and the refaulting pages activated straight away.
+ *
+ * Released under the GPL, see the file COPYING for details.
+ */
+
+#include <linux/mm.h>
+#include <linux/mmzone.h>
+#include <linux/radix-tree.h>
+#include <linux/swap.h>
+#include <linux/vmstat.h>
+
+/*
+ * Double CLOCK lists
+ *
+ * Per zone, two clock lists are maintained for file pages: the inactive
+ * list, which is used for reclaim, and the active list, which pages are
+ * promoted to when they are accessed a second time while still on the
+ * inactive list.  The size of the active list is kept in check by
+ * inactive_file_is_low(), so that the inactive list can always hold
+ * enough pages to recognise the second access.
+ *
+ * A working set that is bigger than the inactive list but smaller than
+ * all of memory never gets there: each page is evicted before it is used
+ * again, so it never reaches the active list and the cache thrashes on
+ * the inactive list while the active list holds on to older pages.
+ *
+ * Access frequency and refault distance
+ *
+ * Every eviction and every activation moves the pages on the inactive
+ * list one slot further towards the tail, so their sum is a clock that
+ * measures how far the inactive list has turned: zone->inactive_age.
+ *
+ * When a page is evicted, the current value of the clock is stored in
+ * the page cache slot the page leaves behind (a shadow entry).  When the
+ * page is faulted back in, the difference between the clock now and the
+ * stored value is its refault distance: the number of pages that would
+ * have had to fit on the inactive list on top of it for the page to have
+ * been accessed a second time before it was reclaimed.
+ *
+ * Those extra slots can only come out of the active list, so a page
+ * whose refault distance is no bigger than the active list is part of a
+ * working set that would fit in memory if the active list gave way.
+ * Such a page is activated on refault, which makes it compete with the
+ * active pages on equal terms; if it really is used more often than they
+ * are, the old active pages are the ones that get deactivated.
+ *
+ * Shadow entries
+ *
+ * Shadow entries are radix tree exceptional entries that hold the zone
+ * the page was evicted from and the value of its inactive_age.  They
+ * are only stored by reclaim, replace the page at its own index and are
+ * cleared again by truncation, invalidation and inode eviction, so there
+ * is never more than one per file page that was in the cache.
+ */
+
+#define EVICTION_SHIFT	(RADIX_TREE_EXCEPTIONAL_SHIFT + \
+			 ZONES_SHIFT + NODES_SHIFT)
+#define EVICTION_MASK	(~0UL >> EVICTION_SHIFT)
+
+static void *pack_shadow(unsigned long eviction, struct zone *zone)
+{
+	eviction = (eviction << NODES_SHIFT) | zone_to_nid(zone);
+	eviction = (eviction << ZONES_SHIFT) | zone_idx(zone);
+	eviction = (eviction << RADIX_TREE_EXCEPTIONAL_SHIFT);
+
+	return (void *)(eviction | RADIX_TREE_EXCEPTIONAL_ENTRY);
+}
+
+static void unpack_shadow(void *shadow, struct zone **zone,
+			  unsigned long *distance)
+{
+	unsigned long entry = (unsigned long)shadow;
+	unsigned long eviction;
+	unsigned long refault;
+	int zid, nid;
+
+	entry >>= RADIX_TREE_EXCEPTIONAL_SHIFT;
+	zid = entry & ((1UL << ZONES_SHIFT) - 1);
+	entry >>= ZONES_SHIFT;
+	nid = entry & ((1UL << NODES_SHIFT) - 1);
+	entry >>= NODES_SHIFT;
+	eviction = entry;
+
+	*zone = NODE_DATA(nid)->node_zones + zid;
+
+	refault = atomic_long_read(&(*zone)->inactive_age);
+	*distance = (refault - eviction) & EVICTION_MASK;
+}
+
+/**
+ * workingset_eviction - note the eviction of a page from memory
+ * @mapping: address space the page was backing
+ * @page: the page being evicted
+ *
+ * Returns a shadow entry to be stored in @mapping->page_tree in place
+ * of the evicted @page so that a later refault can be detected.
+ */
+void *workingset_eviction(struct address_space *mapping, struct page *page)
+{
+	struct zone *zone = page_zone(page);
+	unsigned long eviction;
+
+	eviction = atomic_long_inc_return(&zone->inactive_age);
+	return pack_shadow(eviction, zone);
+}
+
+/**
+ * workingset_refault - evaluate the refault of a previously evicted page
+ * @shadow: shadow entry of the evicted page
+ *
+ * Calculates and evaluates the refault distance of the previously
+ * evicted page in the context of the zone it was allocated in.
+ *
+ * Returns %true if the page should be activated, %false otherwise.
+ */
+bool workingset_refault(void *shadow)
+{
+	unsigned long refault_distance;
+	struct zone *zone;
+
+	unpack_shadow(shadow, &zone, &refault_distance);
+	inc_zone_state(zone, WORKINGSET_REFAULT);
+
+	if (refault_distance <= zone_page_state(zone, NR_ACTIVE_FILE)) {
+		inc_zone_state(zone, WORKINGSET_ACTIVATE);
+		return true;
+	}
+	return false;
+}
+
+/**
+ * workingset_activation - note a page activation
+ * @page: page that is being activated
+ */
+void workingset_activation(struct page *page)
+{
+	atomic_long_inc(&page_zone(page)->inactive_age);
+}